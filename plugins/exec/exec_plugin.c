@@ -42,17 +42,38 @@
 #include <gdk/gdkkeysyms.h>
 #include <gtk/gtk.h>
 #include <glib.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #define GET_PLUGIN_DATA(gp) (RemminaPluginExecData*)g_object_get_data(G_OBJECT(gp), "plugin-data")
 
+/* Size of each non-blocking read from the child pipes */
+#define EXEC_READ_SIZE 65536
+/* Maximum amount of data read from a pipe before giving back control to the main loop */
+#define EXEC_READ_BUDGET (1024 * 1024)
+/* Output not yet shown is capped to the newest EXEC_PENDING_MAX bytes */
+#define EXEC_PENDING_MAX (4 * 1024 * 1024)
+/* Lines kept in the text view */
+#define EXEC_SCROLLBACK_LINES 10000
+
 typedef struct _RemminaPluginExecData {
 	GtkWidget *log_view;
 	GtkTextBuffer *log_buffer;
-	GtkTextBuffer *err;
 	GtkWidget *sw;
+
+	/* Output read from the child and not yet inserted in the text view */
+	GString *pending;
+	/* Incomplete UTF-8 sequence at the end of the last read, per pipe */
+	gchar partial[2][4];
+	gsize partial_len[2];
+	guint tick_id;
+	guint out_watch;
+	guint err_watch;
+	/* Full output of the child, when execoutputfile is set */
+	FILE *spill;
 } RemminaPluginExecData;
 
 static RemminaPluginService *remmina_plugin_service = NULL;
@@ -64,48 +85,146 @@ cb_child_watch( GPid pid, gint status)
 	g_spawn_close_pid( pid );
 }
 
-	static gboolean
-cb_out_watch (GIOChannel *channel, GIOCondition cond, RemminaProtocolWidget *gp)
+/* Append raw child output to the pending text, as valid UTF-8.
+ * Returns the length of an incomplete sequence left at the end of data */
+static gsize exec_pending_append(RemminaPluginExecData *gpdata, const gchar *data, gsize len)
 {
-	gchar *string;
-	gsize  size;
+	const gchar *end;
 
-	RemminaPluginExecData *gpdata = GET_PLUGIN_DATA(gp);
+	while (len > 0) {
+		if (g_utf8_validate(data, len, &end)) {
+			g_string_append_len(gpdata->pending, data, len);
+			len = 0;
+			break;
+		}
+		g_string_append_len(gpdata->pending, data, end - data);
+		len -= end - data;
+		data = end;
+		/* A character split between two reads is completed by the next one */
+		if (len < 4 && g_utf8_get_char_validated(data, len) == (gunichar)-2)
+			break;
+		/* Replace one invalid byte */
+		g_string_append(gpdata->pending, "\xef\xbf\xbd");
+		data++;
+		len--;
+	}
 
-	if( cond == G_IO_HUP )
-	{
-		g_io_channel_unref( channel );
-		return FALSE;
+	/* Drop the oldest output when the view cannot keep up, it would be
+	 * removed by the scrollback limit anyway */
+	if (gpdata->pending->len > EXEC_PENDING_MAX) {
+		end = g_utf8_find_next_char(gpdata->pending->str + gpdata->pending->len - EXEC_PENDING_MAX, NULL);
+		g_string_erase(gpdata->pending, 0, end - gpdata->pending->str);
 	}
 
-	g_io_channel_read_line( channel, &string, &size, NULL, NULL );
-	gtk_text_buffer_insert_at_cursor( gpdata->log_buffer, string, -1 );
-	g_free( string );
+	return len;
+}
 
-	return TRUE;
+/* Insert the pending output in the text view, at most once per frame */
+static gboolean exec_flush_tick(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer user_data)
+{
+	RemminaPluginExecData *gpdata = (RemminaPluginExecData *)user_data;
+	GtkTextIter start, end;
+	gint lines;
+
+	gpdata->tick_id = 0;
+	if (gpdata->pending->len == 0)
+		return G_SOURCE_REMOVE;
+
+	gtk_text_buffer_get_end_iter(gpdata->log_buffer, &end);
+	gtk_text_buffer_insert(gpdata->log_buffer, &end, gpdata->pending->str, gpdata->pending->len);
+	g_string_truncate(gpdata->pending, 0);
+
+	lines = gtk_text_buffer_get_line_count(gpdata->log_buffer);
+	if (lines > EXEC_SCROLLBACK_LINES) {
+		gtk_text_buffer_get_start_iter(gpdata->log_buffer, &start);
+		gtk_text_buffer_get_iter_at_line(gpdata->log_buffer, &end, lines - EXEC_SCROLLBACK_LINES);
+		gtk_text_buffer_delete(gpdata->log_buffer, &start, &end);
+	}
+
+	gtk_text_buffer_get_end_iter(gpdata->log_buffer, &end);
+	gtk_text_buffer_place_cursor(gpdata->log_buffer, &end);
+	return G_SOURCE_REMOVE;
 }
 
-	static gboolean
-cb_err_watch (GIOChannel *channel, GIOCondition cond, RemminaProtocolWidget *gp)
+/* Read the output of the command, idx is 0 for stdout and 1 for stderr */
+static gboolean exec_read_output(GIOChannel *channel, GIOCondition cond, RemminaProtocolWidget *gp, gint idx)
 {
-	gchar *string;
-	gsize  size;
+	gchar buffer[EXEC_READ_SIZE + 4];
+	gsize size, total, carry;
+	GIOStatus status = G_IO_STATUS_NORMAL;
 
 	RemminaPluginExecData *gpdata = GET_PLUGIN_DATA(gp);
 
-	if( cond == G_IO_HUP )
+	/* Drain what is available with large reads, without blocking */
+	for (total = 0; total < EXEC_READ_BUDGET; total += size) {
+		carry = gpdata->partial_len[idx];
+		memcpy(buffer, gpdata->partial[idx], carry);
+		status = g_io_channel_read_chars( channel, buffer + carry, EXEC_READ_SIZE, &size, NULL );
+		if (size > 0) {
+			if (gpdata->spill)
+				fwrite(buffer + carry, 1, size, gpdata->spill);
+			carry = exec_pending_append(gpdata, buffer, carry + size);
+			memcpy(gpdata->partial[idx], buffer + (gpdata->partial_len[idx] + size - carry), carry);
+			gpdata->partial_len[idx] = carry;
+		}
+		if (status != G_IO_STATUS_NORMAL)
+			break;
+	}
+
+	if (gpdata->pending->len > 0 && !gpdata->tick_id)
+		gpdata->tick_id = gtk_widget_add_tick_callback(gpdata->log_view, exec_flush_tick, gpdata, NULL);
+
+	if (status == G_IO_STATUS_EOF || status == G_IO_STATUS_ERROR ||
+	    (status == G_IO_STATUS_AGAIN && (cond & G_IO_HUP)))
 	{
-		g_io_channel_unref( channel );
+		/* The watch owns the channel, removing it closes the pipe */
+		if (idx == 0)
+			gpdata->out_watch = 0;
+		else
+			gpdata->err_watch = 0;
+		if (gpdata->spill)
+			fflush(gpdata->spill);
 		return FALSE;
 	}
 
-	g_io_channel_read_line( channel, &string, &size, NULL, NULL );
-	gtk_text_buffer_insert_at_cursor( gpdata->err, string, -1 );
-	g_free( string );
-
 	return TRUE;
 }
 
+	static gboolean
+cb_output_watch (GIOChannel *channel, GIOCondition cond, RemminaProtocolWidget *gp)
+{
+	return exec_read_output(channel, cond, gp, 0);
+}
+
+	static gboolean
+cb_error_watch (GIOChannel *channel, GIOCondition cond, RemminaProtocolWidget *gp)
+{
+	return exec_read_output(channel, cond, gp, 1);
+}
+
+static GIOChannel *exec_output_channel_new(gint fd)
+{
+	GIOChannel *channel;
+
+	channel = g_io_channel_unix_new(fd);
+	g_io_channel_set_close_on_unref(channel, TRUE);
+	/* Raw bytes, validated as UTF-8 when they are shown */
+	g_io_channel_set_encoding(channel, NULL, NULL);
+	g_io_channel_set_buffered(channel, FALSE);
+	g_io_channel_set_flags(channel, g_io_channel_get_flags(channel) | G_IO_FLAG_NONBLOCK, NULL);
+	return channel;
+}
+
+static void remmina_plugin_exec_free(gpointer data)
+{
+	RemminaPluginExecData *gpdata = (RemminaPluginExecData *)data;
+
+	g_string_free(gpdata->pending, TRUE);
+	if (gpdata->spill)
+		fclose(gpdata->spill);
+	g_free(gpdata);
+}
+
 static void remmina_plugin_exec_init(RemminaProtocolWidget *gp)
 {
 	TRACE_CALL(__func__);
@@ -114,7 +233,8 @@ static void remmina_plugin_exec_init(RemminaProtocolWidget *gp)
 	remmina_plugin_service->log_printf("[%s] Plugin init\n", PLUGIN_NAME);
 
 	gpdata = g_new0(RemminaPluginExecData, 1);
-	g_object_set_data_full(G_OBJECT(gp), "plugin-data", gpdata, g_free);
+	gpdata->pending = g_string_sized_new(EXEC_READ_SIZE);
+	g_object_set_data_full(G_OBJECT(gp), "plugin-data", gpdata, remmina_plugin_exec_free);
 
 	gpdata->log_view = gtk_text_view_new();
 	gtk_text_view_set_wrap_mode(GTK_TEXT_VIEW(gpdata->log_view), GTK_WRAP_CHAR);
@@ -139,6 +259,7 @@ static gboolean remmina_plugin_exec_run(RemminaProtocolWidget *gp)
 	TRACE_CALL(__func__);
 	RemminaFile* remminafile;
 	const gchar *cmd;
+	const gchar *spill;
 	gchar *stdout_buffer;
 	gchar *stderr_buffer;
 	char **argv;
@@ -191,12 +312,22 @@ static gboolean remmina_plugin_exec_run(RemminaProtocolWidget *gp)
 		}
 		g_child_watch_add(child_pid, (GChildWatchFunc)cb_child_watch, gp );
 
+		/* Optionally keep the full output, the view only keeps the last lines */
+		spill = remmina_plugin_service->file_get_string(remminafile, "execoutputfile");
+		if (spill) {
+			gpdata->spill = fopen(spill, "w");
+			if (!gpdata->spill)
+				remmina_plugin_service->log_printf("[%s] Unable to open %s\n", PLUGIN_NAME, spill);
+		}
+
 		/* Create channels that will be used to read data from pipes. */
-		out_ch = g_io_channel_unix_new(child_stdout);
-		err_ch = g_io_channel_unix_new(child_stderr);
+		out_ch = exec_output_channel_new(child_stdout);
+		err_ch = exec_output_channel_new(child_stderr);
 		/* Add watches to channels */
-		g_io_add_watch(out_ch, G_IO_IN | G_IO_HUP, (GIOFunc)cb_out_watch, gp );
-		g_io_add_watch(err_ch, G_IO_IN | G_IO_HUP, (GIOFunc)cb_err_watch, gp );
+		gpdata->out_watch = g_io_add_watch(out_ch, G_IO_IN | G_IO_HUP, (GIOFunc)cb_output_watch, gp );
+		gpdata->err_watch = g_io_add_watch(err_ch, G_IO_IN | G_IO_HUP, (GIOFunc)cb_error_watch, gp );
+		g_io_channel_unref(out_ch);
+		g_io_channel_unref(err_ch);
 
 	}else {
 		dialog = GTK_DIALOG(gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL,
@@ -245,7 +376,22 @@ static gboolean remmina_plugin_exec_run(RemminaProtocolWidget *gp)
 static gboolean remmina_plugin_exec_close(RemminaProtocolWidget *gp)
 {
 	TRACE_CALL(__func__);
+	RemminaPluginExecData *gpdata = GET_PLUGIN_DATA(gp);
+
 	remmina_plugin_service->log_printf("[%s] Plugin close\n", PLUGIN_NAME);
+	/* Stop reading: the watches and the tick callback use gpdata */
+	if (gpdata->out_watch) {
+		g_source_remove(gpdata->out_watch);
+		gpdata->out_watch = 0;
+	}
+	if (gpdata->err_watch) {
+		g_source_remove(gpdata->err_watch);
+		gpdata->err_watch = 0;
+	}
+	if (gpdata->tick_id) {
+		gtk_widget_remove_tick_callback(gpdata->log_view, gpdata->tick_id);
+		gpdata->tick_id = 0;
+	}
 	remmina_plugin_service->protocol_plugin_emit_signal(gp, "disconnect");
 	return FALSE;
 }
@@ -263,6 +409,7 @@ static const RemminaProtocolSetting remmina_plugin_exec_basic_settings[] =
 {
 	{ REMMINA_PROTOCOL_SETTING_TYPE_TEXT,	"execcommand",  N_("Command"),  FALSE,  NULL,   NULL},
 	{ REMMINA_PROTOCOL_SETTING_TYPE_CHECK,	"runasync", N_("Asynchrounous execution"),  FALSE,  NULL,   NULL},
+	{ REMMINA_PROTOCOL_SETTING_TYPE_TEXT,	"execoutputfile", N_("Save the full output to file"),  FALSE,  NULL,   NULL},
 	{ REMMINA_PROTOCOL_SETTING_TYPE_END,	NULL,	    NULL,	    FALSE,  NULL,   NULL }
 };
 
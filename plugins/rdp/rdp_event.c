@@ -39,6 +39,7 @@
 #include "rdp_plugin.h"
 #include "rdp_event.h"
 #include "rdp_cliprdr.h"
+#include "rdp_graphics.h"
 #include "rdp_settings.h"
 #include <gdk/gdkkeysyms.h>
 #include <cairo/cairo-xlib.h>
@@ -111,61 +112,61 @@ static void remmina_rdp_event_release_all_keys(RemminaProtocolWidget* gp)
 	TRACE_CALL(__func__);
 	rfContext* rfi = GET_PLUGIN_DATA(gp);
 	RemminaPluginRdpEvent rdp_event = { 0 };
-	int i;
+	GHashTableIter iter;
+	gpointer key;
+	guint32 word;
+	guint i;
+	gint bit;
 
 	/* Send all release key events for previously pressed keys */
-	for (i = 0; i < rfi->pressed_keys->len; i++) {
-		rdp_event = g_array_index(rfi->pressed_keys, RemminaPluginRdpEvent, i);
-		if ((rdp_event.type == REMMINA_RDP_EVENT_TYPE_SCANCODE ||
-		     rdp_event.type == REMMINA_RDP_EVENT_TYPE_SCANCODE_UNICODE) &&
-		    rdp_event.key_event.up == False) {
-			rdp_event.key_event.up = True;
+	rdp_event.type = REMMINA_RDP_EVENT_TYPE_SCANCODE;
+	rdp_event.key_event.up = True;
+	for (i = 0; i < G_N_ELEMENTS(rfi->pressed_scancodes); i++) {
+		word = rfi->pressed_scancodes[i];
+		while (word) {
+			bit = g_bit_nth_lsf(word, -1);
+			word &= ~(1u << bit);
+			rdp_event.key_event.key_code = ((i << 5) | bit) & 0xFF;
+			rdp_event.key_event.extended = ((i << 5) | bit) & 0x100;
 			remmina_rdp_event_event_push(gp, &rdp_event);
 		}
+		rfi->pressed_scancodes[i] = 0;
 	}
 
-	g_array_set_size(rfi->pressed_keys, 0);
-}
-
-static void remmina_rdp_event_release_key(RemminaProtocolWidget* gp, RemminaPluginRdpEvent rdp_event)
-{
-	TRACE_CALL(__func__);
-	gint i;
-	rfContext* rfi = GET_PLUGIN_DATA(gp);
-	RemminaPluginRdpEvent rdp_event_2 = { 0 };
-
-	rdp_event_2.type = REMMINA_RDP_EVENT_TYPE_SCANCODE;
-
-	if ((rdp_event.type == REMMINA_RDP_EVENT_TYPE_SCANCODE ||
-	     rdp_event.type == REMMINA_RDP_EVENT_TYPE_SCANCODE_UNICODE) &&
-	    rdp_event.key_event.up ) {
-		/* Unregister the keycode only */
-		for (i = 0; i < rfi->pressed_keys->len; i++) {
-			rdp_event_2 = g_array_index(rfi->pressed_keys, RemminaPluginRdpEvent, i);
-
-			if (rdp_event_2.key_event.key_code == rdp_event.key_event.key_code &&
-			    rdp_event_2.key_event.unicode_code == rdp_event.key_event.unicode_code &&
-			    rdp_event_2.key_event.extended == rdp_event.key_event.extended) {
-				g_array_remove_index_fast(rfi->pressed_keys, i);
-				break;
-			}
-		}
+	rdp_event.type = REMMINA_RDP_EVENT_TYPE_SCANCODE_UNICODE;
+	rdp_event.key_event.key_code = 0;
+	rdp_event.key_event.extended = False;
+	g_hash_table_iter_init(&iter, rfi->pressed_unicode);
+	while (g_hash_table_iter_next(&iter, &key, NULL)) {
+		rdp_event.key_event.unicode_code = GPOINTER_TO_UINT(key);
+		remmina_rdp_event_event_push(gp, &rdp_event);
 	}
+	g_hash_table_remove_all(rfi->pressed_unicode);
 }
 
 static void keypress_list_add(RemminaProtocolWidget *gp, RemminaPluginRdpEvent rdp_event)
 {
 	TRACE_CALL(__func__);
 	rfContext* rfi = GET_PLUGIN_DATA(gp);
-	if (!rdp_event.key_event.key_code)
-		return;
+	guint index;
 
-	if (rdp_event.key_event.up) {
-		remmina_rdp_event_release_key(gp, rdp_event);
-	} else {
-		g_array_append_val(rfi->pressed_keys, rdp_event);
+	if (rdp_event.type == REMMINA_RDP_EVENT_TYPE_SCANCODE_UNICODE) {
+		if (rdp_event.key_event.up)
+			g_hash_table_remove(rfi->pressed_unicode, GUINT_TO_POINTER(rdp_event.key_event.unicode_code));
+		else
+			g_hash_table_add(rfi->pressed_unicode, GUINT_TO_POINTER(rdp_event.key_event.unicode_code));
+		return;
 	}
 
+	if (!rdp_event.key_event.key_code)
+		return;
+
+	/* Key repeat sets the same bit again, so a single release clears it */
+	index = rdp_event.key_event.key_code | (rdp_event.key_event.extended ? 0x100 : 0);
+	if (rdp_event.key_event.up)
+		rfi->pressed_scancodes[index >> 5] &= ~(1u << (index & 31));
+	else
+		rfi->pressed_scancodes[index >> 5] |= 1u << (index & 31);
 }
 
 
@@ -570,15 +571,16 @@ static void remmina_rdp_event_init_keymap(rfContext* rfi, const gchar* strmap)
 	long int v1, v2;
 	const char *s;
 	char *endptr;
-	RemminaPluginRdpKeymapEntry ke;
+	guint map[256];
+	gboolean mapped[256] = { FALSE };
+	gint i;
+
+	for (i = 0; i < 256; i++)
+		map[i] = i;
+	rfi->has_keymap = FALSE;
 
-	if (strmap == NULL || strmap[0] == 0) {
-		rfi->keymap = NULL;
-		return;
-	}
 	s = strmap;
-	rfi->keymap = g_array_new(FALSE, TRUE, sizeof(RemminaPluginRdpKeymapEntry));
-	while(1) {
+	while (s && *s) {
 		v1 = strtol(s, &endptr, 10);
 		if (endptr == s) break;
 		s = endptr;
@@ -587,17 +589,24 @@ static void remmina_rdp_event_init_keymap(rfContext* rfi, const gchar* strmap)
 		v2 = strtol(s, &endptr, 10);
 		if (endptr == s) break;
 		s = endptr;
-		ke.orig_keycode = v1 & 0x7fffffff;
-		ke.translated_keycode = v2 & 0x7fffffff;
-		g_array_append_val(rfi->keymap, ke);
+		v1 &= 0x7fffffff;
+		v2 &= 0x7fffffff;
+		/* X11 keycodes fit in 8 bits, so larger entries could never
+		 * match. The first entry for a keycode wins. The map is not
+		 * applied when the client keymap is in use. */
+		if (!rfi->use_client_keymap && v1 < 256 && v2 < 256 && !mapped[v1]) {
+			map[v1] = v2;
+			mapped[v1] = TRUE;
+		}
+		rfi->has_keymap = TRUE;
 		if (*s != ',') break;
 		s++;
 	}
-	if (rfi->keymap->len == 0) {
-		g_array_unref(rfi->keymap);
-		rfi->keymap = NULL;
-	}
 
+	/* Translate once for the keyboard layout selected at plugin init,
+	 * instead of on every key event */
+	for (i = 0; i < 256; i++)
+		rfi->keymap[i] = freerdp_keyboard_get_rdp_scancode_from_x11_keycode(map[i]);
 }
 
 static gboolean remmina_rdp_event_on_key(GtkWidget* widget, GdkEventKey* event, RemminaProtocolWidget* gp)
@@ -606,10 +615,8 @@ static gboolean remmina_rdp_event_on_key(GtkWidget* widget, GdkEventKey* event,
 	guint32 unicode_keyval;
 	guint16 hardware_keycode;
 	rfContext* rfi = GET_PLUGIN_DATA(gp);
-	RemminaPluginRdpEvent rdp_event;
-	RemminaPluginRdpKeymapEntry* kep;
+	RemminaPluginRdpEvent rdp_event = { 0 };
 	DWORD scancode = 0;
-	int ik;
 
 	if (!rfi || !rfi->connected || rfi->is_reconnecting)
 		return FALSE;
@@ -650,16 +657,10 @@ static gboolean remmina_rdp_event_on_key(GtkWidget* widget, GdkEventKey* event,
 	default:
 		if (!rfi->use_client_keymap) {
 			hardware_keycode = event->hardware_keycode;
-			if (rfi->keymap) {
-				for(ik = 0; ik < rfi->keymap->len; ik++) {
-					kep = &g_array_index(rfi->keymap, RemminaPluginRdpKeymapEntry, ik);
-					if (hardware_keycode == kep->orig_keycode) {
-						hardware_keycode = kep->translated_keycode;
-						break;
-					}
-				}
-			}
-			scancode = freerdp_keyboard_get_rdp_scancode_from_x11_keycode(hardware_keycode);
+			if (hardware_keycode < G_N_ELEMENTS(rfi->keymap))
+				scancode = rfi->keymap[hardware_keycode];
+			else
+				scancode = freerdp_keyboard_get_rdp_scancode_from_x11_keycode(hardware_keycode);
 			if (scancode) {
 				rdp_event.key_event.key_code = scancode & 0xFF;
 				rdp_event.key_event.extended = scancode & 0x100;
@@ -681,7 +682,10 @@ static gboolean remmina_rdp_event_on_key(GtkWidget* widget, GdkEventKey* event,
 			    unicode_keyval == 0 ||                                                      // impossible to translate
 			    (event->state & (GDK_MOD1_MASK | GDK_CONTROL_MASK | GDK_SUPER_MASK)) != 0   // a modifier not recognized by gdk_keyval_to_unicode()
 			    ) {
-				scancode = freerdp_keyboard_get_rdp_scancode_from_x11_keycode(event->hardware_keycode);
+				if (event->hardware_keycode < G_N_ELEMENTS(rfi->keymap))
+					scancode = rfi->keymap[event->hardware_keycode];
+				else
+					scancode = freerdp_keyboard_get_rdp_scancode_from_x11_keycode(event->hardware_keycode);
 				rdp_event.key_event.key_code = scancode & 0xFF;
 				rdp_event.key_event.extended = scancode & 0x100;
 				if (rdp_event.key_event.key_code) {
@@ -752,7 +756,7 @@ void remmina_rdp_event_init(RemminaProtocolWidget* gp)
 	/* Read special keymap from profile file, if exists */
 	remmina_rdp_event_init_keymap(rfi, remmina_plugin_service->pref_get_value("rdp_map_keycode"));
 
-	if (rfi->use_client_keymap && rfi->keymap) {
+	if (rfi->use_client_keymap && rfi->has_keymap) {
 		fprintf(stderr, "RDP profile error: you cannot define both rdp_map_hardware_keycode and have 'Use client keuboard mapping' enabled\n");
 	}
 
@@ -780,7 +784,7 @@ void remmina_rdp_event_init(RemminaProtocolWidget* gp)
 		rfi->clipboard.clipboard_handler = g_signal_connect(clipboard, "owner-change", G_CALLBACK(remmina_rdp_event_on_clipboard), gp);
 	}
 
-	rfi->pressed_keys = g_array_new(FALSE, TRUE, sizeof(RemminaPluginRdpEvent));
+	rfi->pressed_unicode = g_hash_table_new(g_direct_hash, g_direct_equal);
 	rfi->event_queue = g_async_queue_new_full(g_free);
 	rfi->ui_queue = g_async_queue_new();
 	pthread_mutex_init(&rfi->ui_queue_mutex, NULL);
@@ -828,6 +832,19 @@ void remmina_rdp_event_free_event(RemminaProtocolWidget* gp, RemminaPluginRdpUiO
 		free(obj->nocodec.bitmap);
 		break;
 
+	case REMMINA_RDP_UI_CURSOR:
+		if (obj->cursor.entry)
+			rf_cursor_entry_unref(obj->cursor.entry);
+		break;
+
+	case REMMINA_RDP_UI_SCREENSHOT:
+		/* Never delivered, the requester still expects an answer */
+		if (obj->screenshot.func)
+			obj->screenshot.func(gp, NULL, obj->screenshot.user_data);
+		if (obj->screenshot.shot)
+			remmina_rdp_screenshot_release(obj->screenshot.shot);
+		break;
+
 	default:
 		break;
 	}
@@ -841,6 +858,7 @@ void remmina_rdp_event_uninit(RemminaProtocolWidget* gp)
 	TRACE_CALL(__func__);
 	rfContext* rfi = GET_PLUGIN_DATA(gp);
 	RemminaPluginRdpUiObject* ui;
+	RemminaPluginRdpEvent* event;
 
 	if (!rfi) return;
 
@@ -867,10 +885,14 @@ void remmina_rdp_event_uninit(RemminaProtocolWidget* gp)
 
 	g_hash_table_destroy(rfi->object_table);
 
-	g_array_free(rfi->pressed_keys, TRUE);
-	if (rfi->keymap) {
-		g_array_free(rfi->keymap, TRUE);
-		rfi->keymap = NULL;
+	g_hash_table_destroy(rfi->pressed_unicode);
+	/* Answer screenshot requests the libfreerdp thread did not serve */
+	while ((event = (RemminaPluginRdpEvent*)g_async_queue_try_pop(rfi->event_queue)) != NULL) {
+		if (event->type == REMMINA_RDP_EVENT_TYPE_SCREENSHOT)
+			event->screenshot.func(gp, NULL, event->screenshot.user_data);
+		else if (event->type == REMMINA_RDP_EVENT_TYPE_TEXT)
+			g_free(event->text_event.text);
+		g_free(event);
 	}
 	g_async_queue_unref(rfi->event_queue);
 	rfi->event_queue = NULL;
@@ -976,40 +998,23 @@ static void remmina_rdp_event_reconnect_progress(RemminaProtocolWidget* gp, Remm
 	gdk_window_invalidate_rect(gtk_widget_get_window(rfi->drawing_area), NULL, TRUE);
 }
 
-static BOOL remmina_rdp_event_create_cursor(RemminaProtocolWidget* gp, RemminaPluginRdpUiObject* ui)
+/* The shape was converted by the libfreerdp thread, only build the GdkCursor once */
+static GdkCursor* remmina_rdp_event_get_cursor(RemminaProtocolWidget* gp, rfCursorEntry* entry)
 {
 	TRACE_CALL(__func__);
 	GdkPixbuf* pixbuf;
 	rfContext* rfi = GET_PLUGIN_DATA(gp);
-	rdpPointer* pointer = (rdpPointer*)ui->cursor.pointer;
 	cairo_surface_t* surface;
-	UINT8* data = malloc(pointer->width * pointer->height * 4);
-
-	if (freerdp_image_copy_from_pointer_data(
-		    (BYTE*)data, PIXEL_FORMAT_BGRA32,
-		    pointer->width * 4, 0, 0, pointer->width, pointer->height,
-		    pointer->xorMaskData, pointer->lengthXorMask,
-		    pointer->andMaskData, pointer->lengthAndMask,
-		    pointer->xorBpp, &(ui->cursor.context->gdi->palette)) < 0) {
-		free(data);
-		return FALSE;
-	}
-
-	surface = cairo_image_surface_create_for_data(data, CAIRO_FORMAT_ARGB32, pointer->width, pointer->height, cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, pointer->width));
-	pixbuf = gdk_pixbuf_get_from_surface(surface, 0, 0, pointer->width, pointer->height);
-	cairo_surface_destroy(surface);
-	free(data);
-	((rfPointer*)ui->cursor.pointer)->cursor = gdk_cursor_new_from_pixbuf(rfi->display, pixbuf, pointer->xPos, pointer->yPos);
-	g_object_unref(pixbuf);
 
-	return TRUE;
-}
+	if (!entry->cursor) {
+		surface = cairo_image_surface_create_for_data((unsigned char*)entry->pixels, CAIRO_FORMAT_ARGB32, entry->width, entry->height, cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, entry->width));
+		pixbuf = gdk_pixbuf_get_from_surface(surface, 0, 0, entry->width, entry->height);
+		cairo_surface_destroy(surface);
+		entry->cursor = gdk_cursor_new_from_pixbuf(rfi->display, pixbuf, entry->xhot, entry->yhot);
+		g_object_unref(pixbuf);
+	}
 
-static void remmina_rdp_event_free_cursor(RemminaProtocolWidget* gp, RemminaPluginRdpUiObject* ui)
-{
-	TRACE_CALL(__func__);
-	g_object_unref(ui->cursor.pointer->cursor);
-	ui->cursor.pointer->cursor = NULL;
+	return entry->cursor;
 }
 
 static BOOL remmina_rdp_event_set_pointer_position(RemminaProtocolWidget *gp, gint x, gint y)
@@ -1053,18 +1058,12 @@ static void remmina_rdp_event_cursor(RemminaProtocolWidget* gp, RemminaPluginRdp
 {
 	TRACE_CALL(__func__);
 	rfContext* rfi = GET_PLUGIN_DATA(gp);
+	GdkCursor* cursor;
 
 	switch (ui->cursor.type) {
-	case REMMINA_RDP_POINTER_NEW:
-		ui->retval = remmina_rdp_event_create_cursor(gp, ui) ? 1 : 0;
-		break;
-
-	case REMMINA_RDP_POINTER_FREE:
-		remmina_rdp_event_free_cursor(gp, ui);
-		break;
-
 	case REMMINA_RDP_POINTER_SET:
-		gdk_window_set_cursor(gtk_widget_get_window(rfi->drawing_area), ui->cursor.pointer->cursor);
+		gdk_window_set_cursor(gtk_widget_get_window(rfi->drawing_area),
+			ui->cursor.entry ? remmina_rdp_event_get_cursor(gp, ui->cursor.entry) : NULL);
 		ui->retval = 1;
 		break;
 
@@ -1073,9 +1072,9 @@ static void remmina_rdp_event_cursor(RemminaProtocolWidget* gp, RemminaPluginRdp
 		break;
 
 	case REMMINA_RDP_POINTER_NULL:
-		gdk_window_set_cursor(gtk_widget_get_window(rfi->drawing_area),
-			gdk_cursor_new_for_display(gdk_display_get_default(),
-				GDK_BLANK_CURSOR));
+		cursor = gdk_cursor_new_for_display(gdk_display_get_default(), GDK_BLANK_CURSOR);
+		gdk_window_set_cursor(gtk_widget_get_window(rfi->drawing_area), cursor);
+		g_object_unref(cursor);
 		ui->retval = 1;
 		break;
 
@@ -1123,6 +1122,18 @@ static void remmina_rdp_event_process_event(RemminaProtocolWidget* gp, RemminaPl
 	}
 }
 
+static void remmina_rdp_event_screenshot(RemminaProtocolWidget* gp, RemminaPluginRdpUiObject* ui)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginRdpScreenshotFunc func;
+
+	/* The callee now owns the screenshot */
+	func = ui->screenshot.func;
+	ui->screenshot.func = NULL;
+	func(gp, ui->screenshot.shot, ui->screenshot.user_data);
+	ui->screenshot.shot = NULL;
+}
+
 static void remmina_rdp_event_process_ui_event(RemminaProtocolWidget* gp, RemminaPluginRdpUiObject* ui)
 {
 	TRACE_CALL(__func__);
@@ -1151,6 +1162,10 @@ static void remmina_rdp_event_process_ui_event(RemminaProtocolWidget* gp, Remmin
 		remmina_rdp_event_process_event(gp, ui);
 		break;
 
+	case REMMINA_RDP_UI_SCREENSHOT:
+		remmina_rdp_event_screenshot(gp, ui);
+		break;
+
 	default:
 		break;
 	}
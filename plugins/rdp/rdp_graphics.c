@@ -41,143 +41,63 @@
 #include "rdp_graphics.h"
 
 #include <freerdp/codec/color.h>
-#include <freerdp/codec/bitmap.h>
 #include <winpr/memory.h>
 
-//#define RF_BITMAP
-//#define RF_GLYPH
+/* Bitmaps and glyphs are not handled here: gdi_init() registers the
+ * libfreerdp GDI classes, which decode bitmap and glyph orders straight into
+ * the primary buffer, in the format of our cairo surface, and keep them in
+ * the libfreerdp bitmap, offscreen and glyph caches. */
 
-/* Bitmap Class */
+/* Cursor cache */
 
-BOOL rf_Bitmap_New(rdpContext* context, rdpBitmap* bitmap)
-{
-	TRACE_CALL(__func__);
-#ifdef RF_BITMAP
-	UINT8* data;
-	Pixmap pixmap;
-	XImage* image;
-	rfContext* rfi = (rfContext*)context;
-
-	XSetFunction(rfi->display, rfi->gc, GXcopy);
-	pixmap = XCreatePixmap(rfi->display, rfi->drawable, bitmap->width, bitmap->height, rfi->depth);
-
-	if (bitmap->data != NULL) {
-		data = freerdp_image_convert(bitmap->data, NULL,
-			bitmap->width, bitmap->height, rfi->srcBpp, rfi->bpp, rfi->clrconv);
-
-		if (bitmap->ephemeral != TRUE) {
-			image = XCreateImage(rfi->display, rfi->visual, rfi->depth,
-				ZPixmap, 0, (char*)data, bitmap->width, bitmap->height, rfi->scanline_pad, 0);
-
-			XPutImage(rfi->display, pixmap, rfi->gc, image, 0, 0, 0, 0, bitmap->width, bitmap->height);
-			XFree(image);
+/* Distinct shapes kept for reuse, the cache restarts empty when full */
+#define RF_CURSOR_CACHE_SIZE 128
 
-			if (data != bitmap->data) && (data != NULL)
-				free(data);
-		}else  {
-			if (data != bitmap->data) && (data != NULL)
-				free(bitmap->data);
-
-			bitmap->data = data;
-		}
-	}
-
-	((rfBitmap*)bitmap)->pixmap = pixmap;
-#endif
-	return TRUE;
-}
-
-void rf_Bitmap_Free(rdpContext* context, rdpBitmap* bitmap)
+static rfCursorEntry* rf_cursor_entry_ref(rfCursorEntry* entry)
 {
-	TRACE_CALL(__func__);
-#ifdef RF_BITMAP
-	rfContext* rfi = (rfContext*)context;
-
-	printf("rf_Bitmap_Free\n");
-
-	if (((rfBitmap*)bitmap)->pixmap != 0)
-		XFreePixmap(rfi->display, ((rfBitmap*)bitmap)->pixmap);
-#endif
+	g_atomic_int_inc(&entry->refcount);
+	return entry;
 }
 
-BOOL rf_Bitmap_Paint(rdpContext* context, rdpBitmap* bitmap)
+static gboolean rf_cursor_unref_idle(gpointer cursor)
 {
-	TRACE_CALL(__func__);
-#ifdef RF_BITMAP
-	XImage* image;
-	int width, height;
-	rfContext* rfi = (rfContext*)context;
-
-	printf("rf_Bitmap_Paint\n");
-
-	width = bitmap->right - bitmap->left + 1;
-	height = bitmap->bottom - bitmap->top + 1;
-
-	XSetFunction(rfi->display, rfi->gc, GXcopy);
-
-	image = XCreateImage(rfi->display, rfi->visual, rfi->depth,
-		ZPixmap, 0, (char*)bitmap->data, bitmap->width, bitmap->height, rfi->scanline_pad, 0);
-
-	XPutImage(rfi->display, rfi->primary, rfi->gc,
-		image, 0, 0, bitmap->left, bitmap->top, width, height);
-
-	XFree(image);
-
-	//XCopyArea(rfi->display, rfi->primary, rfi->drawable, rfi->gc,
-	//			bitmap->left, bitmap->top, width, height, bitmap->left, bitmap->top);
-
-	//gdi_InvalidateRegion(rfi->hdc, bitmap->left, bitmap->top, width, height);
-#endif
+	g_object_unref(cursor);
 	return FALSE;
 }
 
-BOOL rf_Bitmap_Decompress(rdpContext* context, rdpBitmap* bitmap,
-			  const BYTE* data, UINT32 width, UINT32 height, UINT32 bpp, UINT32 length, BOOL compressed, UINT32 codec_id)
+void rf_cursor_entry_unref(rfCursorEntry* entry)
 {
-	TRACE_CALL(__func__);
-#ifdef RF_BITMAP
-	UINT16 size;
-
-	printf("rf_Bitmap_Decompress\n");
-
-	size = width * height * (bpp + 7) / 8;
-
-	if (bitmap->data == NULL)
-		bitmap->data = (UINT8*)xmalloc(size);
-	else
-		bitmap->data = (UINT8*)xrealloc(bitmap->data, size);
+	if (!g_atomic_int_dec_and_test(&entry->refcount))
+		return;
 
-	if (compressed) {
-		BOOL status;
-
-		status = bitmap_decompress(data, bitmap->data, width, height, length, bpp, bpp);
-
-		if (status != TRUE) {
-			printf("Bitmap Decompression Failed\n");
-		}
-	}else  {
-		freerdp_image_flip(data, bitmap->data, width, height, bpp);
+	/* GdkCursor must be released on the main thread */
+	if (entry->cursor) {
+		if (remmina_plugin_service->is_main_thread())
+			g_object_unref(entry->cursor);
+		else
+			IDLE_ADD(rf_cursor_unref_idle, entry->cursor);
 	}
-
-	bitmap->compressed = FALSE;
-	bitmap->length = size;
-	bitmap->bpp = bpp;
-#endif
-	return TRUE;
+	g_bytes_unref(entry->key);
+	g_free(entry);
 }
 
-BOOL rf_Bitmap_SetSurface(rdpContext* context, rdpBitmap* bitmap, BOOL primary)
+void rf_cursor_cache_init(rfContext* rfi)
 {
 	TRACE_CALL(__func__);
-#ifdef RF_BITMAP
-	rfContext* rfi = (rfContext*)context;
+	rfi->cursor_cache = g_hash_table_new_full(g_bytes_hash, g_bytes_equal, NULL, (GDestroyNotify)rf_cursor_entry_unref);
+	rfi->cursor_cache_hits = 0;
+	rfi->cursor_cache_misses = 0;
+}
 
-	if (primary)
-		rfi->drawing = rfi->primary;
-	else
-		rfi->drawing = ((rfBitmap*)bitmap)->pixmap;
-#endif
-	return TRUE;
+void rf_cursor_cache_free(rfContext* rfi)
+{
+	TRACE_CALL(__func__);
+	if (!rfi->cursor_cache)
+		return;
+	remmina_plugin_service->log_printf("[RDP] cursor cache: %u hits, %u misses\n",
+					   rfi->cursor_cache_hits, rfi->cursor_cache_misses);
+	g_hash_table_destroy(rfi->cursor_cache);
+	rfi->cursor_cache = NULL;
 }
 
 /* Pointer Class */
@@ -185,34 +105,69 @@ BOOL rf_Bitmap_SetSurface(rdpContext* context, rdpBitmap* bitmap, BOOL primary)
 BOOL rf_Pointer_New(rdpContext* context, rdpPointer* pointer)
 {
 	TRACE_CALL(__func__);
-	RemminaPluginRdpUiObject* ui;
 	rfContext* rfi = (rfContext*)context;
-
-	if ((pointer->andMaskData != 0) && (pointer->xorMaskData != 0)) {
-		ui = g_new0(RemminaPluginRdpUiObject, 1);
-		ui->type = REMMINA_RDP_UI_CURSOR;
-		ui->cursor.context = context;
-		ui->cursor.pointer = (rfPointer*)pointer;
-		ui->cursor.type = REMMINA_RDP_POINTER_NEW;
-		return remmina_rdp_event_queue_ui_sync_retint(rfi->protocol_widget, ui) ? TRUE : FALSE;
+	rfCursorEntry* entry;
+	gint32* header;
+	guchar* data;
+	gsize size;
+	GBytes* key;
+
+	if ((pointer->andMaskData == 0) || (pointer->xorMaskData == 0))
+		return FALSE;
+
+	/* Convert on this thread, the main thread only gets a ready shape */
+	size = 4 * sizeof(gint32) + (gsize)pointer->width * pointer->height * 4;
+	data = g_malloc(size);
+	header = (gint32*)data;
+	header[0] = pointer->width;
+	header[1] = pointer->height;
+	header[2] = pointer->xPos;
+	header[3] = pointer->yPos;
+
+	if (freerdp_image_copy_from_pointer_data(
+		    data + 4 * sizeof(gint32), PIXEL_FORMAT_BGRA32,
+		    pointer->width * 4, 0, 0, pointer->width, pointer->height,
+		    pointer->xorMaskData, pointer->lengthXorMask,
+		    pointer->andMaskData, pointer->lengthAndMask,
+		    pointer->xorBpp, &context->gdi->palette) < 0) {
+		g_free(data);
+		return FALSE;
 	}
-	return FALSE;
+	key = g_bytes_new_take(data, size);
+
+	entry = g_hash_table_lookup(rfi->cursor_cache, key);
+	if (entry) {
+		rfi->cursor_cache_hits++;
+		g_bytes_unref(key);
+		rf_cursor_entry_ref(entry);
+	} else {
+		rfi->cursor_cache_misses++;
+		if (g_hash_table_size(rfi->cursor_cache) >= RF_CURSOR_CACHE_SIZE)
+			g_hash_table_remove_all(rfi->cursor_cache);
+
+		entry = g_new0(rfCursorEntry, 1);
+		entry->refcount = 2;    /* The cache and the pointer */
+		entry->key = key;
+		entry->pixels = (const guchar*)g_bytes_get_data(key, NULL) + 4 * sizeof(gint32);
+		entry->width = pointer->width;
+		entry->height = pointer->height;
+		entry->xhot = pointer->xPos;
+		entry->yhot = pointer->yPos;
+		g_hash_table_insert(rfi->cursor_cache, entry->key, entry);
+	}
+
+	((rfPointer*)pointer)->entry = entry;
+	return TRUE;
 }
 
 void rf_Pointer_Free(rdpContext* context, rdpPointer* pointer)
 {
 	TRACE_CALL(__func__);
-	RemminaPluginRdpUiObject* ui;
-	rfContext* rfi = (rfContext*)context;
+	rfPointer* rfpointer = (rfPointer*)pointer;
 
-	if (G_IS_OBJECT(((rfPointer*)pointer)->cursor))
-	{
-		ui = g_new0(RemminaPluginRdpUiObject, 1);
-		ui->type = REMMINA_RDP_UI_CURSOR;
-		ui->cursor.context = context;
-		ui->cursor.pointer = (rfPointer*)pointer;
-		ui->cursor.type = REMMINA_RDP_POINTER_FREE;
-		remmina_rdp_event_queue_ui_sync_retint(rfi->protocol_widget, ui);
+	if (rfpointer->entry) {
+		rf_cursor_entry_unref(rfpointer->entry);
+		rfpointer->entry = NULL;
 	}
 }
 
@@ -221,14 +176,15 @@ BOOL rf_Pointer_Set(rdpContext* context, const rdpPointer* pointer)
 	TRACE_CALL(__func__);
 	RemminaPluginRdpUiObject* ui;
 	rfContext* rfi = (rfContext*)context;
+	rfCursorEntry* entry = ((rfPointer*)pointer)->entry;
 
 	ui = g_new0(RemminaPluginRdpUiObject, 1);
 	ui->type = REMMINA_RDP_UI_CURSOR;
-	ui->cursor.pointer = (rfPointer*)pointer;
+	ui->cursor.entry = entry ? rf_cursor_entry_ref(entry) : NULL;
 	ui->cursor.type = REMMINA_RDP_POINTER_SET;
 
-	return remmina_rdp_event_queue_ui_sync_retint(rfi->protocol_widget, ui) ? TRUE : FALSE;
-
+	remmina_rdp_event_queue_ui_async(rfi->protocol_widget, ui);
+	return TRUE;
 }
 
 BOOL rf_Pointer_SetNull(rdpContext* context)
@@ -241,7 +197,8 @@ BOOL rf_Pointer_SetNull(rdpContext* context)
 	ui->type = REMMINA_RDP_UI_CURSOR;
 	ui->cursor.type = REMMINA_RDP_POINTER_NULL;
 
-	return remmina_rdp_event_queue_ui_sync_retint(rfi->protocol_widget, ui) ? TRUE : FALSE;
+	remmina_rdp_event_queue_ui_async(rfi->protocol_widget, ui);
+	return TRUE;
 }
 
 BOOL rf_Pointer_SetDefault(rdpContext* context)
@@ -254,7 +211,8 @@ BOOL rf_Pointer_SetDefault(rdpContext* context)
 	ui->type = REMMINA_RDP_UI_CURSOR;
 	ui->cursor.type = REMMINA_RDP_POINTER_DEFAULT;
 
-	return remmina_rdp_event_queue_ui_sync_retint(rfi->protocol_widget, ui) ? TRUE : FALSE;
+	remmina_rdp_event_queue_ui_async(rfi->protocol_widget, ui);
+	return TRUE;
 }
 
 BOOL rf_Pointer_SetPosition(rdpContext* context, UINT32 x, UINT32 y)
@@ -271,132 +229,12 @@ BOOL rf_Pointer_SetPosition(rdpContext* context, UINT32 x, UINT32 y)
 	return remmina_rdp_event_queue_ui_sync_retint(rfi->protocol_widget, ui) ? TRUE : FALSE;
 }
 
-/* Glyph Class */
-
-BOOL rf_Glyph_New(rdpContext* context, const rdpGlyph* glyph)
-{
-	TRACE_CALL(__func__);
-#ifdef RF_GLYPH
-	int scanline;
-	XImage* image;
-	rfContext* rfi;
-	rfGlyph* rf_glyph;
-
-	rf_glyph = (rfGlyph*)glyph;
-	rfi = (rfContext*)context;
-
-	scanline = (glyph->cx + 7) / 8;
-
-	rf_glyph->pixmap = XCreatePixmap(rfi->display, rfi->drawing, glyph->cx, glyph->cy, 1);
-
-	image = XCreateImage(rfi->display, rfi->visual, 1,
-		ZPixmap, 0, (char*)glyph->aj, glyph->cx, glyph->cy, 8, scanline);
-
-	image->byte_order = MSBFirst;
-	image->bitmap_bit_order = MSBFirst;
-
-	XInitImage(image);
-	XPutImage(rfi->display, rf_glyph->pixmap, rfi->gc_mono, image, 0, 0, 0, 0, glyph->cx, glyph->cy);
-	XFree(image);
-#endif
-	return TRUE;
-}
-
-void rf_Glyph_Free(rdpContext* context, rdpGlyph* glyph)
-{
-	TRACE_CALL(__func__);
-#ifdef RF_GLYPH
-	rfContext* rfi = (rfContext*)context;
-
-	if (((rfGlyph*)glyph)->pixmap != 0)
-		XFreePixmap(rfi->display, ((rfGlyph*)glyph)->pixmap);
-#endif
-}
-
-static BOOL rf_Glyph_Draw(rdpContext* context, const rdpGlyph* glyph, INT32 x,
-			  INT32 y, INT32 w, INT32 h, INT32 sx, INT32 sy,
-			  BOOL fOpRedundant)
-{
-	TRACE_CALL(__func__);
-#ifdef RF_GLYPH
-	rfGlyph* rf_glyph;
-	rfContext* rfi = (rfContext*)context;
-
-	rf_glyph = (rfGlyph*)glyph;
-
-	XSetStipple(rfi->display, rfi->gc, rf_glyph->pixmap);
-	XSetTSOrigin(rfi->display, rfi->gc, x, y);
-	XFillRectangle(rfi->display, rfi->drawing, rfi->gc, x, y, glyph->cx, glyph->cy);
-	XSetStipple(rfi->display, rfi->gc, rfi->bitmap_mono);
-#endif
-	return TRUE;
-}
-
-static BOOL rf_Glyph_BeginDraw(rdpContext* context, INT32 x, INT32 y,
-			       INT32 width, INT32 height, UINT32 bgcolor,
-			       UINT32 fgcolor, BOOL fOpRedundant)
-{
-	TRACE_CALL(__func__);
-#ifdef RF_GLYPH
-	rfContext* rfi = (rfContext*)context;
-
-	bgcolor = (rfi->clrconv->invert) ?
-		  freerdp_color_convert_var_bgr(bgcolor, rfi->srcBpp, 32, rfi->clrconv) :
-		  freerdp_color_convert_var_rgb(bgcolor, rfi->srcBpp, 32, rfi->clrconv);
-
-	fgcolor = (rfi->clrconv->invert) ?
-		  freerdp_color_convert_var_bgr(fgcolor, rfi->srcBpp, 32, rfi->clrconv) :
-		  freerdp_color_convert_var_rgb(fgcolor, rfi->srcBpp, 32, rfi->clrconv);
-
-	XSetFunction(rfi->display, rfi->gc, GXcopy);
-	XSetFillStyle(rfi->display, rfi->gc, FillSolid);
-	XSetForeground(rfi->display, rfi->gc, fgcolor);
-	XFillRectangle(rfi->display, rfi->drawing, rfi->gc, x, y, width, height);
-
-	XSetForeground(rfi->display, rfi->gc, bgcolor);
-	XSetBackground(rfi->display, rfi->gc, fgcolor);
-	XSetFillStyle(rfi->display, rfi->gc, FillStippled);
-#endif
-	return TRUE;
-}
-
-static BOOL rf_Glyph_EndDraw(rdpContext* context, INT32 x, INT32 y,
-			     INT32 width, INT32 height,
-			     UINT32 bgcolor, UINT32 fgcolor)
-{
-	TRACE_CALL(__func__);
-#ifdef RF_GLYPH
-	rfContext* rfi = (rfContext*)context;
-
-	if (rfi->drawing == rfi->primary) {
-		//XCopyArea(rfi->display, rfi->primary, rfi->drawable, rfi->gc, x, y, width, height, x, y);
-		//gdi_InvalidateRegion(rfi->hdc, x, y, width, height);
-	}
-#endif
-	return TRUE;
-}
-
 /* Graphics Module */
 
 void rf_register_graphics(rdpGraphics* graphics)
 {
 	TRACE_CALL(__func__);
-	rdpBitmap* bitmap;
 	rdpPointer* pointer;
-	rdpGlyph* glyph;
-
-	bitmap = (rdpBitmap*)malloc(sizeof(rdpBitmap));
-	ZeroMemory(bitmap, sizeof(rdpBitmap));
-	bitmap->size = sizeof(rfBitmap);
-
-	bitmap->New = rf_Bitmap_New;
-	bitmap->Free = rf_Bitmap_Free;
-	bitmap->Paint = rf_Bitmap_Paint;
-	bitmap->Decompress = rf_Bitmap_Decompress;
-	bitmap->SetSurface = rf_Bitmap_SetSurface;
-
-	graphics_register_bitmap(graphics, bitmap);
-	free(bitmap);
 
 	pointer = (rdpPointer*)malloc(sizeof(rdpPointer));
 	ZeroMemory(pointer, sizeof(rdpPointer));
@@ -413,19 +251,4 @@ void rf_register_graphics(rdpGraphics* graphics)
 	graphics_register_pointer(graphics, pointer);
 
 	free(pointer);
-
-	glyph = (rdpGlyph*)malloc(sizeof(rdpGlyph));
-	ZeroMemory(glyph, sizeof(rdpGlyph));
-
-	glyph->size = sizeof(rfGlyph);
-
-	glyph->New = rf_Glyph_New;
-	glyph->Free = rf_Glyph_Free;
-	glyph->Draw = rf_Glyph_Draw;
-	glyph->BeginDraw = rf_Glyph_BeginDraw;
-	glyph->EndDraw = rf_Glyph_EndDraw;
-
-	graphics_register_glyph(graphics, glyph);
-
-	free(glyph);
 }
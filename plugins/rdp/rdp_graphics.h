@@ -39,3 +39,7 @@
 
 void rf_register_graphics(rdpGraphics* graphics);
 
+void rf_cursor_cache_init(rfContext* rfi);
+void rf_cursor_cache_free(rfContext* rfi);
+void rf_cursor_entry_unref(rfCursorEntry* entry);
+
@@ -77,11 +77,140 @@
 /* Some string settings of freerdp are preallocated buffers of N bytes */
 #define FREERDP_CLIENTHOSTNAME_LEN      32
 
+/* Auto reconnect backoff: the delay doubles at each attempt, between these bounds */
+#define RDP_RECONNECT_DELAY_MIN_MS      1000
+#define RDP_RECONNECT_DELAY_MAX_MS      30000
+
+/* Released screenshot buffers kept for the next capture */
+#define RDP_SCREENSHOT_POOL_SIZE        2
+
+struct remmina_plugin_rdp_screenshot_pool {
+	gint refcount;
+	gboolean closed;
+	GAsyncQueue* free_shots;
+};
+
 RemminaPluginService *remmina_plugin_service = NULL;
 static char remmina_rdp_plugin_default_drive_name[] = "RemminaDisk";
 
 static BOOL gfx_h264_available = FALSE;
 
+static RemminaPluginRdpScreenshotPool *remmina_rdp_screenshot_pool_new(void)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginRdpScreenshotPool *pool;
+
+	pool = g_new0(RemminaPluginRdpScreenshotPool, 1);
+	pool->refcount = 1;
+	pool->free_shots = g_async_queue_new();
+	return pool;
+}
+
+static void remmina_rdp_screenshot_pool_unref(RemminaPluginRdpScreenshotPool *pool)
+{
+	TRACE_CALL(__func__);
+	if (!g_atomic_int_dec_and_test(&pool->refcount))
+		return;
+	g_async_queue_unref(pool->free_shots);
+	g_free(pool);
+}
+
+static void remmina_rdp_screenshot_free(RemminaPluginRdpScreenshot *shot)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginRdpScreenshotPool *pool = shot->pool;
+
+	g_free(shot->buffer);
+	g_free(shot);
+	remmina_rdp_screenshot_pool_unref(pool);
+}
+
+/* Called when the connection is closed, buffers still held by requesters are
+ * freed when released */
+static void remmina_rdp_screenshot_pool_close(RemminaPluginRdpScreenshotPool *pool)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginRdpScreenshot *shot;
+
+	g_atomic_int_set(&pool->closed, TRUE);
+	while ((shot = (RemminaPluginRdpScreenshot *)g_async_queue_try_pop(pool->free_shots)) != NULL)
+		remmina_rdp_screenshot_free(shot);
+	remmina_rdp_screenshot_pool_unref(pool);
+}
+
+void remmina_rdp_screenshot_release(RemminaPluginRdpScreenshot *shot)
+{
+	TRACE_CALL(__func__);
+	if (!shot)
+		return;
+	if (!g_atomic_int_get(&shot->pool->closed) &&
+	    g_async_queue_length(shot->pool->free_shots) < RDP_SCREENSHOT_POOL_SIZE)
+		g_async_queue_push(shot->pool->free_shots, shot);
+	else
+		remmina_rdp_screenshot_free(shot);
+}
+
+/* Runs on the libfreerdp thread, between two frames */
+static void rf_capture_screenshot(rfContext *rfi, RemminaPluginRdpScreenshotFunc func, gpointer user_data)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginRdpScreenshot *shot = NULL;
+	RemminaPluginRdpUiObject *ui;
+	rdpGdi *gdi;
+	gsize size;
+
+	/* GFX surfaces may also be painted by the drdynvc thread */
+	pthread_mutex_lock(&rfi->frame_mutex);
+	gdi = ((rdpContext *)rfi)->gdi;
+	if (gdi && gdi->primary_buffer) {
+		size = (gsize)gdi->stride * gdi->height;
+		shot = (RemminaPluginRdpScreenshot *)g_async_queue_try_pop(rfi->screenshot_pool->free_shots);
+		if (!shot) {
+			shot = g_new0(RemminaPluginRdpScreenshot, 1);
+			g_atomic_int_inc(&rfi->screenshot_pool->refcount);
+			shot->pool = rfi->screenshot_pool;
+		}
+		if (shot->size != size) {
+			g_free(shot->buffer);
+			shot->buffer = g_malloc(size);
+			shot->size = size;
+		}
+		shot->width = gdi->width;
+		shot->height = gdi->height;
+		shot->stride = gdi->stride;
+		shot->bitsPerPixel = GetBitsPerPixel(gdi->hdc->format);
+		shot->bytesPerPixel = GetBytesPerPixel(gdi->hdc->format);
+		memcpy(shot->buffer, gdi->primary_buffer, size);
+	}
+	pthread_mutex_unlock(&rfi->frame_mutex);
+
+	ui = g_new0(RemminaPluginRdpUiObject, 1);
+	ui->type = REMMINA_RDP_UI_SCREENSHOT;
+	ui->screenshot.shot = shot;
+	ui->screenshot.func = func;
+	ui->screenshot.user_data = user_data;
+	remmina_rdp_event_queue_ui_async(rfi->protocol_widget, ui);
+}
+
+/* Asynchronously capture the remote desktop. The copy is done by the libfreerdp
+ * thread between two frames, so it is never torn, and func is then called on
+ * the main thread. Returns FALSE, without calling func, when not connected */
+gboolean remmina_rdp_screenshot_request(RemminaProtocolWidget *gp, RemminaPluginRdpScreenshotFunc func, gpointer user_data)
+{
+	TRACE_CALL(__func__);
+	rfContext *rfi = GET_PLUGIN_DATA(gp);
+	RemminaPluginRdpEvent rdp_event = { 0 };
+
+	if (!rfi || !rfi->connected || rfi->is_reconnecting || !rfi->event_queue)
+		return FALSE;
+
+	rdp_event.type = REMMINA_RDP_EVENT_TYPE_SCREENSHOT;
+	rdp_event.screenshot.func = func;
+	rdp_event.screenshot.user_data = user_data;
+	remmina_rdp_event_event_push(gp, &rdp_event);
+	return TRUE;
+}
+
 static BOOL rf_process_event_queue(RemminaProtocolWidget *gp)
 {
 	TRACE_CALL(__func__);
@@ -91,6 +220,7 @@ static BOOL rf_process_event_queue(RemminaProtocolWidget *gp)
 	RemminaPluginRdpEvent *event;
 	DISPLAY_CONTROL_MONITOR_LAYOUT *dcml;
 	CLIPRDR_FORMAT_DATA_RESPONSE response = { 0 };
+	glong i;
 
 	if (rfi->event_queue == NULL)
 		return True;
@@ -113,6 +243,15 @@ static BOOL rf_process_event_queue(RemminaProtocolWidget *gp)
 			input->UnicodeKeyboardEvent(input, flags, event->key_event.unicode_code);
 			break;
 
+		case REMMINA_RDP_EVENT_TYPE_TEXT:
+			/* A whole run of typed text, drained in one go by this thread */
+			for (i = 0; i < event->text_event.len; i++) {
+				input->UnicodeKeyboardEvent(input, KBD_FLAGS_DOWN, event->text_event.text[i]);
+				input->UnicodeKeyboardEvent(input, KBD_FLAGS_RELEASE, event->text_event.text[i]);
+			}
+			g_free(event->text_event.text);
+			break;
+
 		case REMMINA_RDP_EVENT_TYPE_MOUSE:
 			if (event->mouse_event.extended)
 				input->ExtendedMouseEvent(input, event->mouse_event.flags,
@@ -152,6 +291,10 @@ static BOOL rf_process_event_queue(RemminaProtocolWidget *gp)
 				g_free(dcml);
 			}
 			break;
+
+		case REMMINA_RDP_EVENT_TYPE_SCREENSHOT:
+			rf_capture_screenshot(rfi, event->screenshot.func, event->screenshot.user_data);
+			break;
 		}
 
 		g_free(event);
@@ -222,12 +365,36 @@ static gboolean remmina_rdp_tunnel_init(RemminaProtocolWidget *gp)
 	return TRUE;
 }
 
+/* Delay before reconnection attempt n (1 based), with jitter so that many
+ * clients dropped together do not hammer the server at the same time */
+static DWORD rf_reconnect_delay(int nattempt)
+{
+	TRACE_CALL(__func__);
+	guint delay = RDP_RECONNECT_DELAY_MIN_MS;
+
+	while (--nattempt > 0 && delay < RDP_RECONNECT_DELAY_MAX_MS)
+		delay *= 2;
+	if (delay > RDP_RECONNECT_DELAY_MAX_MS)
+		delay = RDP_RECONNECT_DELAY_MAX_MS;
+
+	return delay / 2 + g_random_int_range(0, delay / 2 + 1);
+}
+
+/* Sleeps up to ms milliseconds, returns FALSE when the connection is being closed */
+static gboolean rf_reconnect_wait(rfContext *rfi, DWORD ms)
+{
+	TRACE_CALL(__func__);
+	return WaitForSingleObject(rfi->reconnect_cancel, ms) != WAIT_OBJECT_0;
+}
+
 BOOL rf_auto_reconnect(rfContext *rfi)
 {
 	TRACE_CALL(__func__);
 	rdpSettings *settings = rfi->instance->settings;
 	RemminaPluginRdpUiObject *ui;
-	time_t treconn;
+	gint64 treconn;
+	gint64 elapsed;
+	DWORD delay;
 
 	rfi->is_reconnecting = TRUE;
 	rfi->reconnect_maxattempts = settings->AutoReconnectMaxRetries;
@@ -253,14 +420,19 @@ BOOL rf_auto_reconnect(rfContext *rfi)
 	ui->type = REMMINA_RDP_UI_RECONNECT_PROGRESS;
 	remmina_rdp_event_queue_ui_async(rfi->protocol_widget, ui);
 
-	/* Sleep half a second to allow:
+	/* Wait half a second to allow:
 	 *  - processing of the ui event we just pushed on the queue
 	 *  - better network conditions
 	 *  Remember: we hare on a thread, so the main gui won’t lock */
 
-	usleep(500000);
+	if (!rf_reconnect_wait(rfi, 500)) {
+		rfi->is_reconnecting = FALSE;
+		return FALSE;
+	}
 
-	/* Perform an auto-reconnect. */
+	/* Perform an auto-reconnect. freerdp_reconnect() keeps the GDI surface,
+	 * the codecs and the channels (so the clipboard) of this session, and
+	 * sends the server auto-reconnect cookie to skip a new logon */
 	while (TRUE) {
 		/* Quit retrying if max retries has been exceeded */
 		if (rfi->reconnect_nattempt++ >= rfi->reconnect_maxattempts) {
@@ -277,7 +449,7 @@ BOOL rf_auto_reconnect(rfContext *rfi)
 		ui->type = REMMINA_RDP_UI_RECONNECT_PROGRESS;
 		remmina_rdp_event_queue_ui_async(rfi->protocol_widget, ui);
 
-		treconn = time(NULL);
+		treconn = g_get_monotonic_time();
 
 		/* Reconnect the SSH tunnel, if needed */
 		if (!remmina_rdp_tunnel_init(rfi->protocol_widget)) {
@@ -293,9 +465,14 @@ BOOL rf_auto_reconnect(rfContext *rfi)
 			}
 		}
 
-		/* Wait until 5 secs have elapsed from last reconnect attempt */
-		while (time(NULL) - treconn < 5)
-			sleep(1);
+		/* Back off, counting the time spent in the failed attempt */
+		delay = rf_reconnect_delay(rfi->reconnect_nattempt);
+		elapsed = (g_get_monotonic_time() - treconn) / 1000;
+		if (!rf_reconnect_wait(rfi, elapsed < delay ? delay - elapsed : 0)) {
+			remmina_plugin_service->log_printf("[RDP][%s] reconnection cancelled.\n",
+							   rfi->settings->ServerHostname);
+			break;
+		}
 	}
 
 	rfi->is_reconnecting = FALSE;
@@ -314,6 +491,9 @@ BOOL rf_begin_paint(rdpContext *context)
 	if (!gdi || !gdi->primary || !gdi->primary->hdc || !gdi->primary->hdc->hwnd)
 		return FALSE;
 
+	/* Released by rf_end_paint(), screenshots are taken between frames */
+	pthread_mutex_lock(&((rfContext *)context)->frame_mutex);
+
 	return TRUE;
 }
 
@@ -330,6 +510,8 @@ BOOL rf_end_paint(rdpContext *context)
 	gdi = context->gdi;
 	rfi = (rfContext *)context;
 
+	pthread_mutex_unlock(&rfi->frame_mutex);
+
 	if (gdi->primary->hdc->hwnd->invalid->null)
 		return TRUE;
 
@@ -381,7 +563,9 @@ static BOOL rf_desktop_resize(rdpContext *context)
 
 	/* Tell libfreerdp to change its internal GDI bitmap width and heigt,
 	 * this will also destroy gdi->primary_buffer, making our rfi->surface invalid */
+	pthread_mutex_lock(&rfi->frame_mutex);
 	gdi_resize(((rdpContext *)rfi)->gdi, rfi->settings->DesktopWidth, rfi->settings->DesktopHeight);
+	pthread_mutex_unlock(&rfi->frame_mutex);
 
 	/* Call to remmina_rdp_event_update_scale(gp) on the main UI thread,
 	 * this will recreate rfi->surface from gdi->primary_buffer */
@@ -978,6 +1162,7 @@ static gboolean remmina_rdp_main(RemminaProtocolWidget *gp)
 	char rdpsnd_param2[16];
 	const gchar *cs;
 	RemminaFile *remminafile;
+	RemminaFileSnapshot *snapshot;
 	rfContext *rfi = GET_PLUGIN_DATA(gp);
 	rdpChannels *channels;
 	gchar *gateway_host;
@@ -988,23 +1173,28 @@ static gboolean remmina_rdp_main(RemminaProtocolWidget *gp)
 	channels = rfi->instance->context->channels;
 
 	remminafile = remmina_plugin_service->protocol_plugin_get_file(gp);
+	/* This runs on the connection thread: read all the settings from a
+	 * single snapshot instead of a main thread round trip per setting */
+	snapshot = remmina_plugin_service->file_snapshot_new(remminafile);
 
 #if defined(PROXY_TYPE_IGNORE)
-	if (!remmina_plugin_service->file_get_int(remminafile, "enableproxy", FALSE) ? TRUE : FALSE) {
+	if (!remmina_plugin_service->file_snapshot_get_int(snapshot, "enableproxy", FALSE) ? TRUE : FALSE) {
 		remmina_plugin_service->log_print("[RDP] Ignoring proxy environment variables\n");
 		rfi->settings->ProxyType = PROXY_TYPE_IGNORE;
 	}
 #endif
 
-	if (!remmina_rdp_tunnel_init(gp))
+	if (!remmina_rdp_tunnel_init(gp)) {
+		remmina_plugin_service->file_snapshot_unref(snapshot);
 		return FALSE;
+	}
 
-	rfi->settings->AutoReconnectionEnabled = (remmina_plugin_service->file_get_int(remminafile, "disableautoreconnect", FALSE) ? FALSE : TRUE);
+	rfi->settings->AutoReconnectionEnabled = (remmina_plugin_service->file_snapshot_get_int(snapshot, "disableautoreconnect", FALSE) ? FALSE : TRUE);
 	/* Disable RDP auto reconnection when SSH tunnel is enabled */
-	if (remmina_plugin_service->file_get_int(remminafile, "ssh_enabled", FALSE))
+	if (remmina_plugin_service->file_snapshot_get_int(snapshot, "ssh_enabled", FALSE))
 		rfi->settings->AutoReconnectionEnabled = FALSE;
 
-	rfi->settings->ColorDepth = remmina_plugin_service->file_get_int(remminafile, "colordepth", 66);
+	rfi->settings->ColorDepth = remmina_plugin_service->file_snapshot_get_int(snapshot, "colordepth", 66);
 
 	rfi->settings->SoftwareGdi = TRUE;
 
@@ -1058,13 +1248,13 @@ static gboolean remmina_rdp_main(RemminaProtocolWidget *gp)
 	remmina_plugin_service->protocol_plugin_set_width(gp, rfi->settings->DesktopWidth);
 	remmina_plugin_service->protocol_plugin_set_height(gp, rfi->settings->DesktopHeight);
 
-	if (remmina_plugin_service->file_get_string(remminafile, "username"))
-		rfi->settings->Username = strdup(remmina_plugin_service->file_get_string(remminafile, "username"));
+	if (remmina_plugin_service->file_snapshot_get_string(snapshot, "username"))
+		rfi->settings->Username = strdup(remmina_plugin_service->file_snapshot_get_string(snapshot, "username"));
 
-	if (remmina_plugin_service->file_get_string(remminafile, "domain"))
-		rfi->settings->Domain = strdup(remmina_plugin_service->file_get_string(remminafile, "domain"));
+	if (remmina_plugin_service->file_snapshot_get_string(snapshot, "domain"))
+		rfi->settings->Domain = strdup(remmina_plugin_service->file_snapshot_get_string(snapshot, "domain"));
 
-	s = remmina_plugin_service->file_get_string(remminafile, "password");
+	s = remmina_plugin_service->file_snapshot_get_string(snapshot, "password");
 
 	if (s) {
 		rfi->settings->Password = strdup(s);
@@ -1074,11 +1264,11 @@ static gboolean remmina_rdp_main(RemminaProtocolWidget *gp)
 	 * Proxy support
 	 * Proxy settings are hidden at the moment as an advanced feauture
 	 */
-	gchar *proxy_type = g_strdup(remmina_plugin_service->file_get_string(remminafile, "proxy_type"));
-	gchar *proxy_username = g_strdup(remmina_plugin_service->file_get_string(remminafile, "proxy_username"));
-	gchar *proxy_password = g_strdup(remmina_plugin_service->file_get_string(remminafile, "proxy_password"));
-	gchar *proxy_hostname = g_strdup(remmina_plugin_service->file_get_string(remminafile, "proxy_hostname"));
-	gint proxy_port = remmina_plugin_service->file_get_int(remminafile, "proxy_port", 80);
+	gchar *proxy_type = g_strdup(remmina_plugin_service->file_snapshot_get_string(snapshot, "proxy_type"));
+	gchar *proxy_username = g_strdup(remmina_plugin_service->file_snapshot_get_string(snapshot, "proxy_username"));
+	gchar *proxy_password = g_strdup(remmina_plugin_service->file_snapshot_get_string(snapshot, "proxy_password"));
+	gchar *proxy_hostname = g_strdup(remmina_plugin_service->file_snapshot_get_string(snapshot, "proxy_hostname"));
+	gint proxy_port = remmina_plugin_service->file_snapshot_get_int(snapshot, "proxy_port", 80);
 	g_debug ("proxy_type: %s", proxy_type);
 	g_debug ("proxy_username: %s", proxy_username);
 	g_debug ("proxy_password: %s", proxy_password);
@@ -1109,9 +1299,9 @@ static gboolean remmina_rdp_main(RemminaProtocolWidget *gp)
 
 	/* Remote Desktop Gateway server address */
 	rfi->settings->GatewayEnabled = FALSE;
-	s = remmina_plugin_service->file_get_string(remminafile, "gateway_server");
+	s = remmina_plugin_service->file_snapshot_get_string(snapshot, "gateway_server");
 	if (s) {
-		cs = remmina_plugin_service->file_get_string(remminafile, "gwtransp");
+		cs = remmina_plugin_service->file_snapshot_get_string(snapshot, "gwtransp");
 		if (g_strcmp0(cs, "http") == 0) {
 			rfi->settings->GatewayRpcTransport = False;
 			rfi->settings->GatewayHttpTransport = True;
@@ -1129,17 +1319,17 @@ static gboolean remmina_rdp_main(RemminaProtocolWidget *gp)
 		rfi->settings->GatewayUseSameCredentials = TRUE;
 	}
 	/* Remote Desktop Gateway domain */
-	if (remmina_plugin_service->file_get_string(remminafile, "gateway_domain")) {
-		rfi->settings->GatewayDomain = strdup(remmina_plugin_service->file_get_string(remminafile, "gateway_domain"));
+	if (remmina_plugin_service->file_snapshot_get_string(snapshot, "gateway_domain")) {
+		rfi->settings->GatewayDomain = strdup(remmina_plugin_service->file_snapshot_get_string(snapshot, "gateway_domain"));
 		rfi->settings->GatewayUseSameCredentials = FALSE;
 	}
 	/* Remote Desktop Gateway username */
-	if (remmina_plugin_service->file_get_string(remminafile, "gateway_username")) {
-		rfi->settings->GatewayUsername = strdup(remmina_plugin_service->file_get_string(remminafile, "gateway_username"));
+	if (remmina_plugin_service->file_snapshot_get_string(snapshot, "gateway_username")) {
+		rfi->settings->GatewayUsername = strdup(remmina_plugin_service->file_snapshot_get_string(snapshot, "gateway_username"));
 		rfi->settings->GatewayUseSameCredentials = FALSE;
 	}
 	/* Remote Desktop Gateway password */
-	s = remmina_plugin_service->file_get_string(remminafile, "gateway_password");
+	s = remmina_plugin_service->file_snapshot_get_string(snapshot, "gateway_password");
 	if (s) {
 		rfi->settings->GatewayPassword = strdup(s);
 		rfi->settings->GatewayUseSameCredentials = FALSE;
@@ -1157,47 +1347,47 @@ static gboolean remmina_rdp_main(RemminaProtocolWidget *gp)
 	/* Remote Desktop Gateway usage */
 	if (rfi->settings->GatewayEnabled)
 		freerdp_set_gateway_usage_method(rfi->settings,
-						 remmina_plugin_service->file_get_int(remminafile, "gateway_usage", FALSE) ? TSC_PROXY_MODE_DETECT : TSC_PROXY_MODE_DIRECT);
+						 remmina_plugin_service->file_snapshot_get_int(snapshot, "gateway_usage", FALSE) ? TSC_PROXY_MODE_DETECT : TSC_PROXY_MODE_DIRECT);
 
 	freerdp_settings_set_string(rfi->settings, (size_t)FreeRDP_GatewayAccessToken,
-				 remmina_plugin_service->file_get_string(remminafile, "gatewayaccesstoken"));
+				 remmina_plugin_service->file_snapshot_get_string(snapshot, "gatewayaccesstoken"));
 
-	rfi->settings->AuthenticationLevel = remmina_plugin_service->file_get_int(
-		remminafile, "authentication level", rfi->settings->AuthenticationLevel);
+	rfi->settings->AuthenticationLevel = remmina_plugin_service->file_snapshot_get_int(
+		snapshot, "authentication level", rfi->settings->AuthenticationLevel);
 
 	/* Certificate ignore */
-	rfi->settings->IgnoreCertificate = remmina_plugin_service->file_get_int(remminafile, "cert_ignore", 0);
+	rfi->settings->IgnoreCertificate = remmina_plugin_service->file_snapshot_get_int(snapshot, "cert_ignore", 0);
 
-	rfi->settings->AllowUnanouncedOrdersFromServer = remmina_plugin_service->file_get_int(remminafile, "relax-order-checks", 0);
+	rfi->settings->AllowUnanouncedOrdersFromServer = remmina_plugin_service->file_snapshot_get_int(snapshot, "relax-order-checks", 0);
 
-	rfi->settings->GlyphSupportLevel = (remmina_plugin_service->file_get_int(remminafile, "glyph-cache", 0) ? GLYPH_SUPPORT_FULL : GLYPH_SUPPORT_NONE);
+	rfi->settings->GlyphSupportLevel = (remmina_plugin_service->file_snapshot_get_int(snapshot, "glyph-cache", 0) ? GLYPH_SUPPORT_FULL : GLYPH_SUPPORT_NONE);
 
 	/* ClientHostname is internally preallocated to 32 bytes by libfreerdp */
-	if ((cs = remmina_plugin_service->file_get_string(remminafile, "clientname")))
+	if ((cs = remmina_plugin_service->file_snapshot_get_string(snapshot, "clientname")))
 		strncpy(rfi->settings->ClientHostname, cs, FREERDP_CLIENTHOSTNAME_LEN - 1);
 	else
 		strncpy(rfi->settings->ClientHostname, g_get_host_name(), FREERDP_CLIENTHOSTNAME_LEN - 1);
 	rfi->settings->ClientHostname[FREERDP_CLIENTHOSTNAME_LEN - 1] = 0;
 
-	if (remmina_plugin_service->file_get_string(remminafile, "loadbalanceinfo")) {
-		rfi->settings->LoadBalanceInfo = (BYTE *)strdup(remmina_plugin_service->file_get_string(remminafile, "loadbalanceinfo"));
+	if (remmina_plugin_service->file_snapshot_get_string(snapshot, "loadbalanceinfo")) {
+		rfi->settings->LoadBalanceInfo = (BYTE *)strdup(remmina_plugin_service->file_snapshot_get_string(snapshot, "loadbalanceinfo"));
 		rfi->settings->LoadBalanceInfoLength = (UINT32)strlen((char *)rfi->settings->LoadBalanceInfo);
 	}
 
-	if (remmina_plugin_service->file_get_string(remminafile, "exec"))
-		rfi->settings->AlternateShell = strdup(remmina_plugin_service->file_get_string(remminafile, "exec"));
+	if (remmina_plugin_service->file_snapshot_get_string(snapshot, "exec"))
+		rfi->settings->AlternateShell = strdup(remmina_plugin_service->file_snapshot_get_string(snapshot, "exec"));
 
-	if (remmina_plugin_service->file_get_string(remminafile, "execpath"))
-		rfi->settings->ShellWorkingDirectory = strdup(remmina_plugin_service->file_get_string(remminafile, "execpath"));
+	if (remmina_plugin_service->file_snapshot_get_string(snapshot, "execpath"))
+		rfi->settings->ShellWorkingDirectory = strdup(remmina_plugin_service->file_snapshot_get_string(snapshot, "execpath"));
 
-	sm = g_strdup_printf("rdp_quality_%i", remmina_plugin_service->file_get_int(remminafile, "quality", DEFAULT_QUALITY_0));
+	sm = g_strdup_printf("rdp_quality_%i", remmina_plugin_service->file_snapshot_get_int(snapshot, "quality", DEFAULT_QUALITY_0));
 	value = remmina_plugin_service->pref_get_value(sm);
 	g_free(sm);
 
 	if (value && value[0]) {
 		rfi->settings->PerformanceFlags = strtoul(value, NULL, 16);
 	} else {
-		switch (remmina_plugin_service->file_get_int(remminafile, "quality", DEFAULT_QUALITY_0)) {
+		switch (remmina_plugin_service->file_snapshot_get_int(snapshot, "quality", DEFAULT_QUALITY_0)) {
 		case 9:
 			rfi->settings->PerformanceFlags = DEFAULT_QUALITY_9;
 			break;
@@ -1226,10 +1416,10 @@ static gboolean remmina_rdp_main(RemminaProtocolWidget *gp)
 
 	rfi->settings->KeyboardLayout = remmina_rdp_settings_get_keyboard_layout();
 
-	if (remmina_plugin_service->file_get_int(remminafile, "console", FALSE))
+	if (remmina_plugin_service->file_snapshot_get_int(snapshot, "console", FALSE))
 		rfi->settings->ConsoleSession = True;
 
-	cs = remmina_plugin_service->file_get_string(remminafile, "security");
+	cs = remmina_plugin_service->file_snapshot_get_string(snapshot, "security");
 	if (g_strcmp0(cs, "rdp") == 0) {
 		rfi->settings->RdpSecurity = True;
 		rfi->settings->TlsSecurity = False;
@@ -1252,7 +1442,7 @@ static gboolean remmina_rdp_main(RemminaProtocolWidget *gp)
 	rfi->settings->NegotiateSecurityLayer = True;
 
 	rfi->settings->CompressionEnabled = True;
-	if (remmina_plugin_service->file_get_int(remminafile, "disable_fastpath", FALSE)) {
+	if (remmina_plugin_service->file_snapshot_get_int(snapshot, "disable_fastpath", FALSE)) {
 		rfi->settings->FastPathInput = False;
 		rfi->settings->FastPathOutput = False;
 	} else {
@@ -1276,7 +1466,7 @@ static gboolean remmina_rdp_main(RemminaProtocolWidget *gp)
 
 	/* Sound settings */
 
-	cs = remmina_plugin_service->file_get_string(remminafile, "sound");
+	cs = remmina_plugin_service->file_snapshot_get_string(snapshot, "sound");
 
 	if (g_strcmp0(cs, "remote") == 0) {
 		rfi->settings->RemoteConsoleAudio = TRUE;
@@ -1311,7 +1501,7 @@ static gboolean remmina_rdp_main(RemminaProtocolWidget *gp)
 		rfi->settings->RemoteConsoleAudio = FALSE;
 	}
 
-	if (remmina_plugin_service->file_get_int(remminafile, "microphone", FALSE) ? TRUE : FALSE) {
+	if (remmina_plugin_service->file_snapshot_get_int(snapshot, "microphone", FALSE) ? TRUE : FALSE) {
 		char *p[1];
 		int count;
 
@@ -1321,9 +1511,9 @@ static gboolean remmina_rdp_main(RemminaProtocolWidget *gp)
 		freerdp_client_add_dynamic_channel(rfi->settings, count, p);
 	}
 
-	rfi->settings->RedirectClipboard = (remmina_plugin_service->file_get_int(remminafile, "disableclipboard", FALSE) ? FALSE : TRUE);
+	rfi->settings->RedirectClipboard = (remmina_plugin_service->file_snapshot_get_int(snapshot, "disableclipboard", FALSE) ? FALSE : TRUE);
 
-	cs = remmina_plugin_service->file_get_string(remminafile, "sharefolder");
+	cs = remmina_plugin_service->file_snapshot_get_string(snapshot, "sharefolder");
 
 	if (cs && cs[0] == '/') {
 		RDPDR_DRIVE *drive;
@@ -1350,7 +1540,7 @@ static gboolean remmina_rdp_main(RemminaProtocolWidget *gp)
 		rfi->settings->DeviceRedirection = TRUE;
 	}
 
-	if (remmina_plugin_service->file_get_int(remminafile, "shareprinter", FALSE)) {
+	if (remmina_plugin_service->file_snapshot_get_int(snapshot, "shareprinter", FALSE)) {
 #ifdef HAVE_CUPS
 		g_debug("Sharing printers");
 		if (cupsEnumDests(CUPS_DEST_FLAGS_NONE, 1000, NULL, 0, 0, remmina_rdp_set_printers, rfi))
@@ -1362,7 +1552,7 @@ static gboolean remmina_rdp_main(RemminaProtocolWidget *gp)
 #endif /* HAVE_CUPS */
 	}
 
-	if (remmina_plugin_service->file_get_int(remminafile, "sharesmartcard", FALSE)) {
+	if (remmina_plugin_service->file_snapshot_get_int(snapshot, "sharesmartcard", FALSE)) {
 		RDPDR_SMARTCARD *smartcard;
 		smartcard = (RDPDR_SMARTCARD *)calloc(1, sizeof(RDPDR_SMARTCARD));
 
@@ -1371,7 +1561,7 @@ static gboolean remmina_rdp_main(RemminaProtocolWidget *gp)
 		rfi->settings->DeviceRedirection = TRUE;
 		remmina_rdp_load_static_channel_addin(channels, rfi->settings, "rdpdr", rfi->settings);
 
-		const gchar *sn = remmina_plugin_service->file_get_string(remminafile, "smartcardname");
+		const gchar *sn = remmina_plugin_service->file_snapshot_get_string(snapshot, "smartcardname");
 		if (sn != NULL && sn[0] != '\0')
 			smartcard->Name = _strdup(sn);
 
@@ -1380,13 +1570,13 @@ static gboolean remmina_rdp_main(RemminaProtocolWidget *gp)
 		freerdp_device_collection_add(rfi->settings, (RDPDR_DEVICE *)smartcard);
 	}
 
-	if (remmina_plugin_service->file_get_int(remminafile, "passwordispin", FALSE))
+	if (remmina_plugin_service->file_snapshot_get_int(snapshot, "passwordispin", FALSE))
 		/* Option works only combined with Username and Domain, because freerdp
 		 * doesn’t know anything about information on smartcard */
 		rfi->settings->PasswordIsSmartcardPin = TRUE;
 
 	/* /serial[:<name>[,<path>[,<driver>[,permissive]]]] */
-	if (remmina_plugin_service->file_get_int(remminafile, "shareserial", FALSE)) {
+	if (remmina_plugin_service->file_snapshot_get_int(snapshot, "shareserial", FALSE)) {
 		RDPDR_SERIAL *serial;
 		serial = (RDPDR_SERIAL *)calloc(1, sizeof(RDPDR_SERIAL));
 
@@ -1395,19 +1585,19 @@ static gboolean remmina_rdp_main(RemminaProtocolWidget *gp)
 		rfi->settings->DeviceRedirection = TRUE;
 		remmina_rdp_load_static_channel_addin(channels, rfi->settings, "rdpdr", rfi->settings);
 
-		const gchar *sn = remmina_plugin_service->file_get_string(remminafile, "serialname");
+		const gchar *sn = remmina_plugin_service->file_snapshot_get_string(snapshot, "serialname");
 		if (sn != NULL && sn[0] != '\0')
 			serial->Name = _strdup(sn);
 
-		const gchar *sd = remmina_plugin_service->file_get_string(remminafile, "serialdriver");
+		const gchar *sd = remmina_plugin_service->file_snapshot_get_string(snapshot, "serialdriver");
 		if (sd != NULL && sd[0] != '\0')
 			serial->Driver = _strdup(sd);
 
-		const gchar *sp = remmina_plugin_service->file_get_string(remminafile, "serialpath");
+		const gchar *sp = remmina_plugin_service->file_snapshot_get_string(snapshot, "serialpath");
 		if (sp != NULL && sp[0] != '\0')
 			serial->Path = _strdup(sp);
 
-		if (remmina_plugin_service->file_get_int(remminafile, "serialpermissive", FALSE))
+		if (remmina_plugin_service->file_snapshot_get_int(snapshot, "serialpermissive", FALSE))
 			serial->Permissive = _strdup("permissive");
 
 		rfi->settings->RedirectSerialPorts = TRUE;
@@ -1415,7 +1605,7 @@ static gboolean remmina_rdp_main(RemminaProtocolWidget *gp)
 		freerdp_device_collection_add(rfi->settings, (RDPDR_DEVICE *)serial);
 	}
 
-	if (remmina_plugin_service->file_get_int(remminafile, "shareparallel", FALSE)) {
+	if (remmina_plugin_service->file_snapshot_get_int(snapshot, "shareparallel", FALSE)) {
 		RDPDR_PARALLEL *parallel;
 		parallel = (RDPDR_PARALLEL *)calloc(1, sizeof(RDPDR_PARALLEL));
 
@@ -1426,16 +1616,19 @@ static gboolean remmina_rdp_main(RemminaProtocolWidget *gp)
 
 		rfi->settings->RedirectParallelPorts = TRUE;
 
-		const gchar *pn = remmina_plugin_service->file_get_string(remminafile, "parallelname");
+		const gchar *pn = remmina_plugin_service->file_snapshot_get_string(snapshot, "parallelname");
 		if (pn != NULL && pn[0] != '\0')
 			parallel->Name = _strdup(pn);
-		const gchar *dp = remmina_plugin_service->file_get_string(remminafile, "parallelpath");
+		const gchar *dp = remmina_plugin_service->file_snapshot_get_string(snapshot, "parallelpath");
 		if (dp != NULL && dp[0] != '\0')
 			parallel->Path = _strdup(dp);
 
 		freerdp_device_collection_add(rfi->settings, (RDPDR_DEVICE *)parallel);
 	}
 
+	/* The settings are now copied into rfi->settings */
+	remmina_plugin_service->file_snapshot_unref(snapshot);
+
 	if (!freerdp_connect(rfi->instance)) {
 		if (!rfi->user_cancelled) {
 			UINT32 e;
@@ -1582,6 +1775,7 @@ static void remmina_rdp_init(RemminaProtocolWidget *gp)
 	TRACE_CALL(__func__);
 	freerdp *instance;
 	rfContext *rfi;
+	pthread_mutexattr_t mattr;
 
 	instance = freerdp_new();
 	instance->PreConnect = remmina_rdp_pre_connect;
@@ -1603,6 +1797,15 @@ static void remmina_rdp_init(RemminaProtocolWidget *gp)
 	rfi->connected = False;
 	rfi->is_reconnecting = False;
 
+	/* Recursive: a GFX output update may be painted while a frame is open */
+	pthread_mutexattr_init(&mattr);
+	pthread_mutexattr_settype(&mattr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&rfi->frame_mutex, &mattr);
+	pthread_mutexattr_destroy(&mattr);
+	rfi->screenshot_pool = remmina_rdp_screenshot_pool_new();
+	rfi->reconnect_cancel = CreateEvent(NULL, TRUE, FALSE, NULL);
+	rf_cursor_cache_init(rfi);
+
 	freerdp_register_addin_provider(freerdp_channels_load_static_addin_entry, 0);
 
 	remmina_rdp_event_init(gp);
@@ -1642,6 +1845,10 @@ static gboolean remmina_rdp_close_connection(RemminaProtocolWidget *gp)
 	if (freerdp_get_last_error(rfi->instance->context) == 0x10005)
 		remmina_plugin_service->protocol_plugin_set_error(gp, "Another user connected to the server (%s), forcing the disconnection of the current connection.", rfi->settings->ServerHostname);
 	instance = rfi->instance;
+	/* Interrupt a pending auto reconnection */
+	if (rfi->reconnect_cancel)
+		SetEvent(rfi->reconnect_cancel);
+
 	if (rfi->thread) {
 		rfi->thread_cancelled = TRUE;   // Avoid all rf_queue function to run
 		pthread_cancel(rfi->thread);
@@ -1678,6 +1885,17 @@ static gboolean remmina_rdp_close_connection(RemminaProtocolWidget *gp)
 	/* Destroy event queue. Pending async events will be discarded. Should we flush it ? */
 	remmina_rdp_event_uninit(gp);
 
+	/* After the pointers of the libfreerdp cache and of the UI queue */
+	rf_cursor_cache_free(rfi);
+
+	remmina_rdp_screenshot_pool_close(rfi->screenshot_pool);
+	rfi->screenshot_pool = NULL;
+	pthread_mutex_destroy(&rfi->frame_mutex);
+	if (rfi->reconnect_cancel) {
+		CloseHandle(rfi->reconnect_cancel);
+		rfi->reconnect_cancel = NULL;
+	}
+
 	if (instance) {
 		freerdp_context_free(instance); /* context is rfContext* rfi */
 		freerdp_free(instance);         /* This implicitly frees instance->context and rfi is no longer valid */
@@ -1749,43 +1967,57 @@ static void remmina_rdp_keystroke(RemminaProtocolWidget *gp, const guint keystro
 	return;
 }
 
-static gboolean remmina_rdp_get_screenshot(RemminaProtocolWidget *gp, RemminaPluginScreenshotData *rpsd)
+/* Type text on the server with unicode keyboard events, no keymap involved.
+ * Servers without unicode input get scancodes through remmina_rdp_keystroke() */
+static gboolean remmina_rdp_send_text(RemminaProtocolWidget *gp, const gchar *text)
 {
+	TRACE_CALL(__func__);
 	rfContext *rfi = GET_PLUGIN_DATA(gp);
-	rdpGdi *gdi;
-	size_t szmem;
+	RemminaPluginRdpEvent rdp_event = { 0 };
 
-	UINT32 bytesPerPixel;
-	UINT32 bitsPerPixel;
-
-	if (!rfi)
+	if (!rfi || !rfi->connected || !rfi->event_queue)
+		return TRUE;
+	if (!rfi->settings->UnicodeInput)
 		return FALSE;
 
-	gdi = ((rdpContext *)rfi)->gdi;
+	rdp_event.type = REMMINA_RDP_EVENT_TYPE_TEXT;
+	rdp_event.text_event.text = g_utf8_to_utf16(text, -1, NULL, &rdp_event.text_event.len, NULL);
+	if (rdp_event.text_event.text)
+		remmina_rdp_event_event_push(gp, &rdp_event);
+	return TRUE;
+}
 
-	bytesPerPixel = GetBytesPerPixel(gdi->hdc->format);
-	bitsPerPixel = GetBitsPerPixel(gdi->hdc->format);
+/* Main thread side of remmina_rdp_get_screenshot(): hand the copy taken by the
+ * libfreerdp thread to Remmina without copying it again */
+static void remmina_rdp_screenshot_done(RemminaProtocolWidget *gp, RemminaPluginRdpScreenshot *shot, gpointer user_data)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginScreenshotData rpsd = { 0 };
 
-	/** @todo we should lock freerdp subthread to update rfi->primary_buffer, rfi->gdi and w/h,
-	 * from here to memcpy, but… how ? */
+	if (!shot) {
+		remmina_plugin_service->log_printf("[RDP] unable to capture the remote desktop\n");
+		/* A NULL rpsd tells the caller the screenshot failed */
+		remmina_plugin_service->protocol_plugin_screenshot_ready(gp, NULL);
+		return;
+	}
 
-	szmem = gdi->width * gdi->height * bytesPerPixel;
+	rpsd.buffer = shot->buffer;
+	rpsd.width = shot->width;
+	rpsd.height = shot->height;
+	rpsd.bitsPerPixel = shot->bitsPerPixel;
+	rpsd.bytesPerPixel = shot->bytesPerPixel;
+	remmina_plugin_service->protocol_plugin_screenshot_ready(gp, &rpsd);
 
-	remmina_plugin_service->log_printf("[RDP] allocating %zu bytes for a full screenshot\n", szmem);
-	rpsd->buffer = malloc(szmem);
-	if (!rpsd->buffer) {
-		remmina_plugin_service->log_printf("[RDP] unable to allocate %zu bytes for a full screenshot\n", szmem);
-		return FALSE;
-	}
-	rpsd->width = gdi->width;
-	rpsd->height = gdi->height;
-	rpsd->bitsPerPixel = bitsPerPixel;
-	rpsd->bytesPerPixel = bytesPerPixel;
+	remmina_rdp_screenshot_release(shot);
+}
 
-	memcpy(rpsd->buffer, gdi->primary_buffer, szmem);
+static gboolean remmina_rdp_get_screenshot(RemminaProtocolWidget *gp, RemminaPluginScreenshotData *rpsd)
+{
+	TRACE_CALL(__func__);
 
-	/* Returning TRUE instruct also the caller to deallocate rpsd->buffer */
-	return TRUE;
+	/* The framebuffer is copied by the libfreerdp thread between two frames,
+	 * rpsd->buffer is left NULL as the screenshot is delivered later */
+	return remmina_rdp_screenshot_request(gp, remmina_rdp_screenshot_done, NULL);
 }
 
 /* Array of key/value pairs for color depths */
@@ -1951,7 +2183,8 @@ static RemminaProtocolPlugin remmina_rdp =
 	remmina_rdp_query_feature,                      // Query for available features
 	remmina_rdp_call_feature,                       // Call a feature
 	remmina_rdp_keystroke,                          // Send a keystroke
-	remmina_rdp_get_screenshot                      // Screenshot
+	remmina_rdp_get_screenshot,                     // Screenshot
+	remmina_rdp_send_text                           // Send a run of text
 };
 
 /* File plugin definition and features */
@@ -85,33 +85,53 @@ struct rf_clipboard {
 typedef struct rf_clipboard rfClipboard;
 
 
+/* A pointer shape, shared by all the pointers with the same content */
+struct rf_cursor_entry {
+	gint refcount;
+	GBytes* key;            /* Size, hotspot and ARGB pixels */
+	const guchar* pixels;   /* Points inside key */
+	gint width;
+	gint height;
+	gint xhot;
+	gint yhot;
+	GdkCursor* cursor;      /* Created on the main thread on first use */
+};
+typedef struct rf_cursor_entry rfCursorEntry;
+
 struct rf_pointer {
 	rdpPointer pointer;
-	GdkCursor* cursor;
+	rfCursorEntry* entry;
 };
 typedef struct rf_pointer rfPointer;
 
-struct rf_bitmap {
-	rdpBitmap bitmap;
-	Pixmap pixmap;
-	cairo_surface_t* surface;
-};
-typedef struct rf_bitmap rfBitmap;
+typedef struct remmina_plugin_rdp_screenshot_pool RemminaPluginRdpScreenshotPool;
 
-struct rf_glyph {
-	rdpGlyph glyph;
-	Pixmap pixmap;
-};
-typedef struct rf_glyph rfGlyph;
+/* A copy of the remote desktop framebuffer, see remmina_rdp_screenshot_request() */
+typedef struct remmina_plugin_rdp_screenshot {
+	RemminaPluginRdpScreenshotPool* pool;
+	guchar* buffer;
+	gsize size;
+	gint width;
+	gint height;
+	gint stride;
+	gint bitsPerPixel;
+	gint bytesPerPixel;
+} RemminaPluginRdpScreenshot;
+
+/* Called on the main thread, shot is NULL when the capture failed. The callee
+ * gives back shot with remmina_rdp_screenshot_release() */
+typedef void (*RemminaPluginRdpScreenshotFunc)(RemminaProtocolWidget* gp, RemminaPluginRdpScreenshot* shot, gpointer user_data);
 
 typedef enum {
 	REMMINA_RDP_EVENT_TYPE_SCANCODE,
 	REMMINA_RDP_EVENT_TYPE_SCANCODE_UNICODE,
+	REMMINA_RDP_EVENT_TYPE_TEXT,
 	REMMINA_RDP_EVENT_TYPE_MOUSE,
 	REMMINA_RDP_EVENT_TYPE_CLIPBOARD_SEND_CLIENT_FORMAT_LIST,
 	REMMINA_RDP_EVENT_TYPE_CLIPBOARD_SEND_CLIENT_FORMAT_DATA_RESPONSE,
 	REMMINA_RDP_EVENT_TYPE_CLIPBOARD_SEND_CLIENT_FORMAT_DATA_REQUEST,
-	REMMINA_RDP_EVENT_TYPE_SEND_MONITOR_LAYOUT
+	REMMINA_RDP_EVENT_TYPE_SEND_MONITOR_LAYOUT,
+	REMMINA_RDP_EVENT_TYPE_SCREENSHOT
 } RemminaPluginRdpEventType;
 
 struct remmina_plugin_rdp_event {
@@ -123,6 +143,10 @@ struct remmina_plugin_rdp_event {
 			UINT8 key_code;
 			UINT32 unicode_code;
 		} key_event;
+		struct {
+			gunichar2 *text;	/* UTF-16, freed with the event */
+			glong len;
+		} text_event;
 		struct {
 			UINT16 flags;
 			UINT16 x;
@@ -146,6 +170,10 @@ struct remmina_plugin_rdp_event {
 			gint desktopScaleFactor;
 			gint deviceScaleFactor;
 		} monitor_layout;
+		struct {
+			RemminaPluginRdpScreenshotFunc func;
+			gpointer user_data;
+		} screenshot;
 	};
 };
 typedef struct remmina_plugin_rdp_event RemminaPluginRdpEvent;
@@ -158,7 +186,8 @@ typedef enum {
 	REMMINA_RDP_UI_RFX,
 	REMMINA_RDP_UI_NOCODEC,
 	REMMINA_RDP_UI_CLIPBOARD,
-	REMMINA_RDP_UI_EVENT
+	REMMINA_RDP_UI_EVENT,
+	REMMINA_RDP_UI_SCREENSHOT
 } RemminaPluginRdpUiType;
 
 typedef enum {
@@ -169,8 +198,6 @@ typedef enum {
 } RemminaPluginRdpUiClipboardType;
 
 typedef enum {
-	REMMINA_RDP_POINTER_NEW,
-	REMMINA_RDP_POINTER_FREE,
 	REMMINA_RDP_POINTER_SET,
 	REMMINA_RDP_POINTER_NULL,
 	REMMINA_RDP_POINTER_DEFAULT,
@@ -198,8 +225,7 @@ struct remmina_plugin_rdp_ui_object {
 			gint ninvalid;
 		} reg;
 		struct {
-			rdpContext* context;
-			rfPointer* pointer;
+			rfCursorEntry* entry;
 			RemminaPluginRdpUiPointerType type;
 		} cursor;
 		struct {
@@ -228,6 +254,11 @@ struct remmina_plugin_rdp_ui_object {
 			gint x;
 			gint y;
 		} pos;
+		struct {
+			RemminaPluginRdpScreenshot* shot;
+			RemminaPluginRdpScreenshotFunc func;
+			gpointer user_data;
+		} screenshot;
 	};
 	/* We can also return values here, usually integers*/
 	int retval;
@@ -235,11 +266,6 @@ struct remmina_plugin_rdp_ui_object {
 	void *retptr;
 };
 
-typedef struct remmina_plugin_rdp_keymap_entry {
-	unsigned orig_keycode;
-	unsigned translated_keycode;
-} RemminaPluginRdpKeymapEntry;
-
 struct rf_context {
 	rdpContext _p;
 
@@ -268,6 +294,8 @@ struct rf_context {
 	gboolean is_reconnecting;
 	int reconnect_maxattempts;
 	int reconnect_nattempt;
+	/* Set when the connection is closed, stops auto reconnection */
+	HANDLE reconnect_cancel;
 
 	gboolean sw_gdi;
 	GtkWidget* drawing_area;
@@ -284,6 +312,10 @@ struct rf_context {
 	GdkVisual* visual;
 	cairo_surface_t* surface;
 	cairo_format_t cairo_format;
+	/* Held while libfreerdp paints into gdi->primary_buffer */
+	pthread_mutex_t frame_mutex;
+	/* Released screenshot buffers, ready to be reused */
+	RemminaPluginRdpScreenshotPool* screenshot_pool;
 	gint bpp;
 	gint scanline_pad;
 	gint* colormap;
@@ -291,18 +323,25 @@ struct rf_context {
 	guint object_id_seq;
 	GHashTable* object_table;
 
+	/* rfCursorEntry by content, used by the libfreerdp thread only */
+	GHashTable* cursor_cache;
+	guint cursor_cache_hits;
+	guint cursor_cache_misses;
+
 	GAsyncQueue* ui_queue;
 	pthread_mutex_t ui_queue_mutex;
 	guint ui_handler;
 
-	GArray* pressed_keys;
+	guint32 pressed_scancodes[512 / 32];	/* Bit (extended << 8 | key_code) set while the key is down */
+	GHashTable* pressed_unicode;		/* Set of unicode_code values currently down */
 	GAsyncQueue* event_queue;
 	gint event_pipe[2];
 	HANDLE event_handle;
 
 	rfClipboard clipboard;
 
-	GArray* keymap;	/* Array of RemminaPluginRdpKeymapEntry */
+	gboolean has_keymap;	/* rdp_map_keycode is set */
+	DWORD keymap[256];	/* X11 keycode -> RDP scancode, with rdp_map_keycode applied */
 
 	enum { REMMINA_POSTCONNECT_ERROR_OK = 0, REMMINA_POSTCONNECT_ERROR_GDI_INIT = 1, REMMINA_POSTCONNECT_ERROR_NO_H264 } postconnect_error;
 };
@@ -317,3 +356,6 @@ void rf_object_free(RemminaProtocolWidget* gp, RemminaPluginRdpUiObject* obj);
 
 void remmina_rdp_event_event_push(RemminaProtocolWidget* gp, const RemminaPluginRdpEvent* e);
 
+gboolean remmina_rdp_screenshot_request(RemminaProtocolWidget* gp, RemminaPluginRdpScreenshotFunc func, gpointer user_data);
+void remmina_rdp_screenshot_release(RemminaPluginRdpScreenshot* shot);
+
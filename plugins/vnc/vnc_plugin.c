@@ -47,6 +47,22 @@
 #define REMMINA_PLUGIN_VNC_FEATURE_UNFOCUS                 7
 #define REMMINA_PLUGIN_VNC_FEATURE_TOOL_SENDCTRLALTDEL     8
 
+/* "quality" value selecting the adaptive mode */
+#define REMMINA_PLUGIN_VNC_QUALITY_ADAPTIVE 3
+
+/* Adaptive quality tuning: updates smaller than MIN_PIXELS are dominated by
+ * latency and are not sampled. The level goes down when receiving a megapixel
+ * costs more than COST_DOWN microseconds on average and up when it costs less
+ * than COST_UP, at most once every HOLD microseconds. */
+#define REMMINA_PLUGIN_VNC_ADAPTIVE_MIN_PIXELS (128 * 128)
+#define REMMINA_PLUGIN_VNC_ADAPTIVE_SAMPLES    4
+#define REMMINA_PLUGIN_VNC_ADAPTIVE_COST_DOWN  400000.0
+#define REMMINA_PLUGIN_VNC_ADAPTIVE_COST_UP    100000.0
+#define REMMINA_PLUGIN_VNC_ADAPTIVE_HOLD       (5 * G_USEC_PER_SEC)
+
+/* Characters typed by a text event before the server gets a chance to be read */
+#define REMMINA_PLUGIN_VNC_TYPING_WINDOW 64
+
 #define GET_PLUGIN_DATA(gp) (RemminaPluginVncData *)g_object_get_data(G_OBJECT(gp), "plugin-data")
 
 static RemminaPluginService *remmina_plugin_service = NULL;
@@ -139,6 +155,10 @@ static void remmina_plugin_vnc_event_push(RemminaProtocolWidget *gp, gint event_
 	case REMMINA_PLUGIN_VNC_EVENT_CHAT_SEND:
 		event->event_data.text.text = g_strdup((char *)p1);
 		break;
+	case REMMINA_PLUGIN_VNC_EVENT_TEXT:
+		event->event_data.typing.text = g_strdup((char *)p1);
+		event->event_data.typing.next = event->event_data.typing.text;
+		break;
 	default:
 		break;
 	}
@@ -160,6 +180,9 @@ static void remmina_plugin_vnc_event_free(RemminaPluginVncEvent *event)
 	case REMMINA_PLUGIN_VNC_EVENT_CHAT_SEND:
 		g_free(event->event_data.text.text);
 		break;
+	case REMMINA_PLUGIN_VNC_EVENT_TEXT:
+		g_free(event->event_data.typing.text);
+		break;
 	default:
 		break;
 	}
@@ -305,6 +328,24 @@ static RemminaPluginVncEvent *remmina_plugin_vnc_event_queue_pop_head(RemminaPlu
 	return event;
 }
 
+/* Type up to REMMINA_PLUGIN_VNC_TYPING_WINDOW characters of a text event.
+ * Returns FALSE when the event still has characters to type. */
+static gboolean remmina_plugin_vnc_type_text(rfbClient *cl, RemminaPluginVncEvent *event)
+{
+	TRACE_CALL(__func__);
+	const gchar *p = event->event_data.typing.next;
+	guint keyval;
+	gint i;
+
+	for (i = 0; i < REMMINA_PLUGIN_VNC_TYPING_WINDOW && *p; i++, p = g_utf8_next_char(p)) {
+		keyval = gdk_unicode_to_keyval(g_utf8_get_char(p));
+		SendKeyEvent(cl, keyval, TRUE);
+		SendKeyEvent(cl, keyval, FALSE);
+	}
+	event->event_data.typing.next = p;
+	return *p == '\0';
+}
+
 static void remmina_plugin_vnc_process_vnc_event(RemminaProtocolWidget *gp)
 {
 	TRACE_CALL(__func__);
@@ -312,9 +353,22 @@ static void remmina_plugin_vnc_process_vnc_event(RemminaProtocolWidget *gp)
 	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
 	rfbClient *cl;
 	gchar buf[100];
+	gboolean more = FALSE;
 
 	cl = (rfbClient *)gpdata->client;
 	while ((event = remmina_plugin_vnc_event_queue_pop_head(gpdata)) != NULL) {
+		if (cl && event->event_type == REMMINA_PLUGIN_VNC_EVENT_TEXT &&
+		    !remmina_plugin_vnc_type_text(cl, event)) {
+			/* Give the main loop a chance to read the server before
+			 * the next window, so neither side fills its socket */
+			CANCEL_DEFER;
+			pthread_mutex_lock(&gpdata->vnc_event_queue_mutex);
+			g_queue_push_head(gpdata->vnc_event_queue, event);
+			pthread_mutex_unlock(&gpdata->vnc_event_queue_mutex);
+			CANCEL_ASYNC;
+			more = TRUE;
+			break;
+		}
 		if (cl) {
 			switch (event->event_type) {
 			case REMMINA_PLUGIN_VNC_EVENT_KEY:
@@ -340,6 +394,9 @@ static void remmina_plugin_vnc_process_vnc_event(RemminaProtocolWidget *gp)
 				TextChatClose(cl);
 				TextChatFinish(cl);
 				break;
+			case REMMINA_PLUGIN_VNC_EVENT_TEXT:
+				/* Fully typed by remmina_plugin_vnc_type_text() */
+				break;
 			default:
 				rfbClientLog("Ignoring VNC event: 0x%x\n", event->event_type);
 				break;
@@ -350,6 +407,10 @@ static void remmina_plugin_vnc_process_vnc_event(RemminaProtocolWidget *gp)
 	if (read(gpdata->vnc_event_pipe[0], buf, sizeof(buf))) {
 		/* Ignore */
 	}
+	/* Wake up again for the rest of the text being typed */
+	if (more && write(gpdata->vnc_event_pipe[1], "\0", 1)) {
+		/* Ignore */
+	}
 }
 
 typedef struct _RemminaPluginVncCuttextParam {
@@ -358,16 +419,91 @@ typedef struct _RemminaPluginVncCuttextParam {
 	gint			textlen;
 } RemminaPluginVncCuttextParam;
 
+/* Levels of the adaptive mode, from the lightest to the best looking */
+static const struct {
+	const gchar *	encodings;
+	gint		compress_level;
+	gint		quality_level;
+} remmina_plugin_vnc_adaptive_levels[] =
+{
+	{ "tight zrle ultra copyrect hextile zlib corre rre raw", 9, 1 },
+	{ "tight zrle ultra copyrect hextile zlib corre rre raw", 6, 3 },
+	{ "tight zrle ultra copyrect hextile zlib corre rre raw", 3, 5 },
+	{ "tight zrle ultra copyrect hextile zlib corre rre raw", 2, 7 },
+	{ "tight copyrect zlib hextile raw",                     1, 9 }
+};
+
+static void remmina_plugin_vnc_set_adaptive_level(rfbClient *cl, gint level)
+{
+	TRACE_CALL(__func__);
+	cl->appData.useBGR233 = 0;
+	cl->appData.encodingsString = remmina_plugin_vnc_adaptive_levels[level].encodings;
+	cl->appData.compressLevel = remmina_plugin_vnc_adaptive_levels[level].compress_level;
+	cl->appData.qualityLevel = remmina_plugin_vnc_adaptive_levels[level].quality_level;
+}
+
+/* Called by the VNC thread after each server message, elapsed being the time
+ * spent receiving and decoding it */
+static void remmina_plugin_vnc_adapt_quality(RemminaPluginVncData *gpdata, rfbClient *cl, gint64 elapsed)
+{
+	TRACE_CALL(__func__);
+	gdouble cost;
+	gint64 now;
+	gint level;
+
+	if (gpdata->adaptive_pixels < REMMINA_PLUGIN_VNC_ADAPTIVE_MIN_PIXELS)
+		return;
+
+	cost = (gdouble)elapsed * 1000000.0 / (gdouble)gpdata->adaptive_pixels;
+	if (gpdata->adaptive_samples++ == 0)
+		gpdata->adaptive_cost = cost;
+	else
+		gpdata->adaptive_cost = 0.8 * gpdata->adaptive_cost + 0.2 * cost;
+
+	now = g_get_monotonic_time();
+	if (gpdata->adaptive_samples < REMMINA_PLUGIN_VNC_ADAPTIVE_SAMPLES ||
+	    now - gpdata->adaptive_changed < REMMINA_PLUGIN_VNC_ADAPTIVE_HOLD)
+		return;
+
+	level = gpdata->adaptive_level;
+	if (gpdata->adaptive_cost > REMMINA_PLUGIN_VNC_ADAPTIVE_COST_DOWN && level > 0)
+		level--;
+	else if (gpdata->adaptive_cost < REMMINA_PLUGIN_VNC_ADAPTIVE_COST_UP &&
+		 level < (gint)G_N_ELEMENTS(remmina_plugin_vnc_adaptive_levels) - 1)
+		level++;
+	else
+		return;
+
+	rfbClientLog("Adaptive quality: %.0f us/Mpixel, switching to level %d\n", gpdata->adaptive_cost, level);
+	gpdata->adaptive_level = level;
+	gpdata->adaptive_changed = now;
+	gpdata->adaptive_samples = 0;
+	remmina_plugin_vnc_set_adaptive_level(cl, level);
+	SetFormatAndEncodings(cl);
+}
+
 static void remmina_plugin_vnc_update_quality(rfbClient *cl, gint quality)
 {
 	TRACE_CALL(__func__);
+	RemminaProtocolWidget *gp = rfbClientGetClientData(cl, NULL);
+	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
+
 	/**
 	 * "0", "Poor (fastest)
 	 * "1", "Medium"
 	 * "2", "Good"
+	 * "3", "Adaptive"
 	 * "9", "Best
 	 */
+	gpdata->adaptive_quality = (quality == REMMINA_PLUGIN_VNC_QUALITY_ADAPTIVE);
 	switch (quality) {
+	case REMMINA_PLUGIN_VNC_QUALITY_ADAPTIVE:
+		/* Start in the middle and let the measurements decide */
+		gpdata->adaptive_level = G_N_ELEMENTS(remmina_plugin_vnc_adaptive_levels) / 2;
+		gpdata->adaptive_samples = 0;
+		gpdata->adaptive_changed = g_get_monotonic_time();
+		remmina_plugin_vnc_set_adaptive_level(cl, gpdata->adaptive_level);
+		break;
 	case 9:
 		cl->appData.useBGR233 = 0;
 		cl->appData.encodingsString = "tight copyrect zlib hextile raw";
@@ -648,6 +784,8 @@ static void remmina_plugin_vnc_rfb_updatefb(rfbClient *cl, int x, int y, int w,
 	gint rowstride;
 	gint width;
 
+	gpdata->adaptive_pixels += (gint64)w * h;
+
 	LOCK_BUFFER(TRUE);
 
 	if (w >= 1 || h >= 1) {
@@ -1036,6 +1174,7 @@ static gboolean remmina_plugin_vnc_main_loop(RemminaProtocolWidget *gp)
 	rfbClient *cl;
 	fd_set fds;
 	struct timeval timeout;
+	gint64 start;
 
 	if (!gpdata->connected) {
 		gpdata->running = FALSE;
@@ -1072,12 +1211,16 @@ static gboolean remmina_plugin_vnc_main_loop(RemminaProtocolWidget *gp)
 		if (i < 0)
 			return TRUE;
 handle_buffered:
+		gpdata->adaptive_pixels = 0;
+		start = g_get_monotonic_time();
 		if (!HandleRFBServerMessage(cl)) {
 			gpdata->running = FALSE;
 			if (gpdata->connected && !remmina_plugin_service->protocol_plugin_is_closed(gp))
 				IDLE_ADD((GSourceFunc)remmina_plugin_service->protocol_plugin_close_connection, gp);
 			return FALSE;
 		}
+		if (gpdata->adaptive_quality)
+			remmina_plugin_vnc_adapt_quality(gpdata, cl, g_get_monotonic_time() - start);
 	}
 
 	return TRUE;
@@ -1703,6 +1846,22 @@ static void remmina_plugin_vnc_keystroke(RemminaProtocolWidget *gp, const guint
 	return;
 }
 
+/* Type a run of text, the keysyms are sent from the VNC thread */
+static gboolean remmina_plugin_vnc_send_text(RemminaProtocolWidget *gp, const gchar *text)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
+	RemminaFile *remminafile;
+
+	if (!gpdata->connected || !gpdata->client)
+		return TRUE;
+	remminafile = remmina_plugin_service->protocol_plugin_get_file(gp);
+	if (remmina_plugin_service->file_get_int(remminafile, "viewonly", FALSE))
+		return TRUE;
+	remmina_plugin_vnc_event_push(gp, REMMINA_PLUGIN_VNC_EVENT_TEXT, (gpointer)text, NULL, NULL);
+	return TRUE;
+}
+
 static gboolean remmina_plugin_vnc_on_draw(GtkWidget *widget, cairo_t *context, RemminaProtocolWidget *gp)
 {
 	TRACE_CALL(__func__);
@@ -1792,6 +1951,7 @@ static gpointer quality_list[] =
 	"1", N_("Medium"),
 	"2", N_("Good"),
 	"9", N_("Best (slowest)"),
+	"3", N_("Adaptive"),
 	NULL
 };
 
@@ -1892,7 +2052,9 @@ static RemminaProtocolPlugin remmina_plugin_vnc =
 	remmina_plugin_vnc_close_connection,            // Plugin close connection
 	remmina_plugin_vnc_query_feature,               // Query for available features
 	remmina_plugin_vnc_call_feature,                // Call a feature
-	remmina_plugin_vnc_keystroke                    // Send a keystroke
+	remmina_plugin_vnc_keystroke,                   // Send a keystroke
+	NULL,                                           // No screenshot support available
+	remmina_plugin_vnc_send_text                    // Send a run of text
 };
 
 /* Protocol plugin definition and features */
@@ -1915,7 +2077,8 @@ static RemminaProtocolPlugin remmina_plugin_vnci =
 	remmina_plugin_vnc_query_feature,               // Query for available features
 	remmina_plugin_vnc_call_feature,                // Call a feature
 	remmina_plugin_vnc_keystroke,                   // Send a keystroke
-	NULL                                            // No screenshot support available
+	NULL,                                           // No screenshot support available
+	remmina_plugin_vnc_send_text                    // Send a run of text
 };
 
 G_MODULE_EXPORT gboolean
@@ -80,6 +80,14 @@ typedef struct _RemminaPluginVncData {
 
 	GPtrArray *		pressed_keys;
 
+	/* Adaptive quality, measured and applied by the VNC thread */
+	gboolean		adaptive_quality;
+	gint			adaptive_level;
+	gint			adaptive_samples;
+	gint64			adaptive_pixels;        /* Pixels updated by the message being handled */
+	gdouble			adaptive_cost;          /* Moving average, microseconds per megapixel */
+	gint64			adaptive_changed;       /* Monotonic time of the last level change */
+
 	pthread_mutex_t		vnc_event_queue_mutex;
 	GQueue *		vnc_event_queue;
 	gint			vnc_event_pipe[2];
@@ -94,7 +102,8 @@ enum {
 	REMMINA_PLUGIN_VNC_EVENT_CUTTEXT,
 	REMMINA_PLUGIN_VNC_EVENT_CHAT_OPEN,
 	REMMINA_PLUGIN_VNC_EVENT_CHAT_SEND,
-	REMMINA_PLUGIN_VNC_EVENT_CHAT_CLOSE
+	REMMINA_PLUGIN_VNC_EVENT_CHAT_CLOSE,
+	REMMINA_PLUGIN_VNC_EVENT_TEXT
 };
 
 typedef struct _RemminaPluginVncEvent {
@@ -112,6 +121,10 @@ typedef struct _RemminaPluginVncEvent {
 		struct {
 			gchar *text;
 		} text;
+		struct {
+			gchar *		text;
+			const gchar *	next;   /* First character not typed yet */
+		} typing;
 	} event_data;
 } RemminaPluginVncEvent;
 
@@ -68,6 +68,8 @@ typedef struct _RemminaPluginWWWData {
 	gchar *				url;
 	gboolean			authenticated;
 	gboolean			formauthenticated;
+	gboolean			snapshot_pending;
+	gboolean			snapshot_requested;
 } RemminaPluginWWWData;
 
 static RemminaPluginService *remmina_plugin_service = NULL;
@@ -686,46 +688,30 @@ static gboolean remmina_plugin_www_open_connection(RemminaProtocolWidget *gp)
 	return TRUE;
 }
 
-static void remmina_plugin_www_save_snapshot(GObject *object, GAsyncResult *result, RemminaProtocolWidget *gp)
+/* A snapshot handed to the encoding thread */
+typedef struct _RemminaPluginWWWSnapshot {
+	cairo_surface_t *	surface;
+	gchar *			pngname;
+	gint			compression;
+} RemminaPluginWWWSnapshot;
+
+static void remmina_plugin_www_snapshot_free(RemminaPluginWWWSnapshot *snapshot)
 {
 	TRACE_CALL(__func__);
+	cairo_surface_destroy(snapshot->surface);
+	g_free(snapshot->pngname);
+	g_free(snapshot);
+}
 
-	WebKitWebView *webview = WEBKIT_WEB_VIEW(object);
-
+static gchar *remmina_plugin_www_snapshot_name(RemminaProtocolWidget *gp)
+{
+	TRACE_CALL(__func__);
 	RemminaFile *remminafile;
-
-	GError *err = NULL;
-	cairo_surface_t *surface;
-	//unsigned char* buffer;
-	int width;
-	int height;
-	GdkPixbuf *screenshot;
 	GString *pngstr;
-	gchar *pngname;
-	//cairo_forma_t* cairo_format;
 	GDateTime *date = g_date_time_new_now_utc();
 
 	remminafile = remmina_plugin_service->protocol_plugin_get_file(gp);
 
-	surface = webkit_web_view_get_snapshot_finish(WEBKIT_WEB_VIEW(webview), result, &err);
-	if (err)
-		g_warning("An error happened generating the snapshot: %s\n", err->message);
-	//buffer = cairo_image_surface_get_data (surface);
-	width = cairo_image_surface_get_width(surface);
-	height = cairo_image_surface_get_height(surface);
-	//cairo_format = cairo_image_surface_get_format (surface);
-
-	screenshot = gdk_pixbuf_get_from_surface(surface, 0, 0, width, height);
-	if (screenshot == NULL)
-		g_debug("WWW: gdk_pixbuf_get_from_surface failed");
-
-	// Transfer the PixBuf in the main clipboard selection
-	gchar *value = remmina_plugin_service->pref_get_value("deny_screenshot_clipboard");
-	if (value && value == FALSE) {
-		GtkClipboard *c = gtk_clipboard_get(GDK_SELECTION_CLIPBOARD);
-		gtk_clipboard_set_image(c, screenshot);
-	}
-
 	pngstr = g_string_new(g_strdup_printf("%s/%s.png",
 					      remmina_plugin_service->pref_get_value("screenshot_path"),
 					      remmina_plugin_service->pref_get_value("screenshot_name")));
@@ -745,27 +731,147 @@ static void remmina_plugin_www_save_snapshot(GObject *object, GAsyncResult *resu
 	www_utils_string_replace_all(pngstr, "%S",
 				     g_strdup_printf("%f", g_date_time_get_seconds(date)));
 	g_date_time_unref(date);
-	pngname = g_string_free(pngstr, FALSE);
-	g_debug("Saving screenshot as %s", pngname);
+	return g_string_free(pngstr, FALSE);
+}
 
-	cairo_surface_write_to_png(surface, pngname);
-	if (g_file_test(pngname, G_FILE_TEST_EXISTS))
-		www_utils_send_notification("www-plugin-screenshot-is-ready-id", _("Screenshot taken"), pngname);
+/* Runs in a worker thread: pixel conversion and PNG encoding of a full page
+ * can take seconds, they must not block the main loop */
+static void remmina_plugin_www_encode_snapshot(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginWWWSnapshot *snapshot = (RemminaPluginWWWSnapshot *)task_data;
+	GError *err = NULL;
+	GdkPixbuf *screenshot;
+	gchar *compression;
 
-	cairo_surface_destroy(surface);
+	screenshot = gdk_pixbuf_get_from_surface(snapshot->surface, 0, 0,
+						 cairo_image_surface_get_width(snapshot->surface),
+						 cairo_image_surface_get_height(snapshot->surface));
+	if (screenshot == NULL) {
+		g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED, "gdk_pixbuf_get_from_surface failed");
+		return;
+	}
+
+	compression = g_strdup_printf("%d", snapshot->compression);
+	if (!gdk_pixbuf_save(screenshot, snapshot->pngname, "png", &err, "compression", compression, NULL)) {
+		g_free(compression);
+		g_object_unref(screenshot);
+		g_task_return_error(task, err);
+		return;
+	}
+	g_free(compression);
+	g_task_return_pointer(task, screenshot, g_object_unref);
+}
+
+static gboolean remmina_plugin_www_get_snapshot(RemminaProtocolWidget *gp, RemminaPluginScreenshotData *rpsd);
+
+/* Back on the main thread once the snapshot is written */
+static void remmina_plugin_www_snapshot_saved(GObject *object, GAsyncResult *result, gpointer user_data)
+{
+	TRACE_CALL(__func__);
+	RemminaProtocolWidget *gp = REMMINA_PROTOCOL_WIDGET(object);
+	RemminaPluginWWWData *gpdata;
+	RemminaPluginWWWSnapshot *snapshot;
+	GError *err = NULL;
+	GdkPixbuf *screenshot;
+
+	gpdata = (RemminaPluginWWWData *)g_object_get_data(G_OBJECT(gp), "plugin-data");
+	snapshot = g_task_get_task_data(G_TASK(result));
+
+	screenshot = g_task_propagate_pointer(G_TASK(result), &err);
+	if (screenshot == NULL) {
+		g_warning("WWW: cannot save the snapshot as %s: %s", snapshot->pngname, err->message);
+		g_error_free(err);
+	} else {
+		// Transfer the PixBuf in the main clipboard selection
+		gchar *value = remmina_plugin_service->pref_get_value("deny_screenshot_clipboard");
+		if (value && value == FALSE) {
+			GtkClipboard *c = gtk_clipboard_get(GDK_SELECTION_CLIPBOARD);
+			gtk_clipboard_set_image(c, screenshot);
+		}
+		www_utils_send_notification("www-plugin-screenshot-is-ready-id", _("Screenshot taken"), snapshot->pngname);
+		g_object_unref(screenshot);
+	}
+
+	/* The connection may have been closed while encoding */
+	if (!gpdata)
+		return;
+	gpdata->snapshot_pending = FALSE;
+	/* Requests received meanwhile are served by a single new snapshot */
+	if (gpdata->snapshot_requested) {
+		gpdata->snapshot_requested = FALSE;
+		if (gpdata->webview)
+			remmina_plugin_www_get_snapshot(gp, NULL);
+	}
+}
+
+static void remmina_plugin_www_save_snapshot(GObject *object, GAsyncResult *result, RemminaProtocolWidget *gp)
+{
+	TRACE_CALL(__func__);
+
+	WebKitWebView *webview = WEBKIT_WEB_VIEW(object);
+
+	RemminaPluginWWWData *gpdata;
+	RemminaPluginWWWSnapshot *snapshot;
+	RemminaFile *remminafile;
+	GError *err = NULL;
+	cairo_surface_t *surface;
+	GTask *task;
+
+	gpdata = (RemminaPluginWWWData *)g_object_get_data(G_OBJECT(gp), "plugin-data");
+	remminafile = remmina_plugin_service->protocol_plugin_get_file(gp);
+
+	surface = webkit_web_view_get_snapshot_finish(WEBKIT_WEB_VIEW(webview), result, &err);
+	if (err) {
+		g_warning("An error happened generating the snapshot: %s\n", err->message);
+		g_error_free(err);
+	}
+	if (!gpdata) {
+		/* The connection has been closed meanwhile */
+		if (surface)
+			cairo_surface_destroy(surface);
+		g_object_unref(gp);
+		return;
+	}
+	if (surface == NULL) {
+		gpdata->snapshot_pending = FALSE;
+		g_object_unref(gp);
+		return;
+	}
+
+	snapshot = g_new0(RemminaPluginWWWSnapshot, 1);
+	snapshot->surface = surface;
+	snapshot->pngname = remmina_plugin_www_snapshot_name(gp);
+	snapshot->compression = CLAMP(remmina_plugin_service->file_get_int(remminafile, "snapshot-compression", 1), 0, 9);
+	g_debug("Saving screenshot as %s", snapshot->pngname);
+
+	task = g_task_new(gp, NULL, remmina_plugin_www_snapshot_saved, NULL);
+	g_task_set_task_data(task, snapshot, (GDestroyNotify)remmina_plugin_www_snapshot_free);
+	g_task_run_in_thread(task, remmina_plugin_www_encode_snapshot);
+	g_object_unref(task);
+	g_object_unref(gp);
 }
 static gboolean remmina_plugin_www_get_snapshot(RemminaProtocolWidget *gp, RemminaPluginScreenshotData *rpsd)
 {
 	TRACE_CALL(__func__);
 	RemminaPluginWWWData *gpdata;
 	gpdata = (RemminaPluginWWWData *)g_object_get_data(G_OBJECT(gp), "plugin-data");
+	if (!gpdata || !gpdata->webview)
+		return FALSE;
+
+	/* Coalesce the requests arriving while a snapshot is in progress */
+	if (gpdata->snapshot_pending) {
+		gpdata->snapshot_requested = TRUE;
+		return FALSE;
+	}
+	gpdata->snapshot_pending = TRUE;
 
 	webkit_web_view_get_snapshot(gpdata->webview,
 				     WEBKIT_SNAPSHOT_REGION_FULL_DOCUMENT,
 				     WEBKIT_SNAPSHOT_OPTIONS_NONE,
 				     NULL,
 				     (GAsyncReadyCallback)remmina_plugin_www_save_snapshot,
-				     gp);
+				     g_object_ref(gp));
 	return FALSE;
 }
 
@@ -786,6 +892,15 @@ static const RemminaProtocolSetting remmina_plugin_www_basic_settings[] =
 	{ REMMINA_PROTOCOL_SETTING_TYPE_END,	  NULL,	      NULL,		FALSE, NULL, NULL }
 };
 
+/* PNG compression levels for the snapshots */
+static gpointer snapshot_compression_list[] =
+{
+	"1", N_("Fastest"),
+	"6", N_("Default"),
+	"9", N_("Smallest"),
+	NULL
+};
+
 /* Array of RemminaProtocolSetting for advanced settings.
  * Each item is composed by:
  * a) RemminaProtocolSettingType for setting type
@@ -798,6 +913,7 @@ static const RemminaProtocolSetting remmina_plugin_www_basic_settings[] =
 static const RemminaProtocolSetting remmina_plugin_www_advanced_settings[] =
 {
 	{ REMMINA_PROTOCOL_SETTING_TYPE_TEXT,  "user-agent",		    N_("User Agent"),		       FALSE, NULL, NULL },
+	{ REMMINA_PROTOCOL_SETTING_TYPE_SELECT, "snapshot-compression",    N_("Screenshot compression"),      FALSE, snapshot_compression_list, NULL },
 	{ REMMINA_PROTOCOL_SETTING_TYPE_CHECK, "enable-java",		    N_("Enable Java support"),	       TRUE,  NULL, NULL },
 	{ REMMINA_PROTOCOL_SETTING_TYPE_CHECK, "enable-smooth-scrolling",   N_("Enable smooth scrolling"),     TRUE,  NULL, NULL },
 	{ REMMINA_PROTOCOL_SETTING_TYPE_CHECK, "enable-spatial-navigation", N_("Enable Spatial Navigation"),   TRUE,  NULL, NULL },
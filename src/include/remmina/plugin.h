@@ -78,7 +78,11 @@ typedef struct _RemminaProtocolPlugin {
 	gboolean (* query_feature)(RemminaProtocolWidget *gp, const RemminaProtocolFeature *feature);
 	void (* call_feature)(RemminaProtocolWidget *gp, const RemminaProtocolFeature *feature);
 	void (* send_keystrokes)(RemminaProtocolWidget *gp, const guint keystrokes[], const gint keylen);
+	/* Returning TRUE with rpsd->buffer left NULL means the screenshot will be
+	 * delivered later with protocol_plugin_screenshot_ready() */
 	gboolean (* get_plugin_screenshot)(RemminaProtocolWidget *gp, RemminaPluginScreenshotData *rpsd);
+	/* Returns FALSE when the text must be typed with send_keystrokes() instead */
+	gboolean (* send_text)(RemminaProtocolWidget *gp, const gchar *text);
 } RemminaProtocolPlugin;
 
 typedef struct _RemminaEntryPlugin {
@@ -223,6 +227,13 @@ typedef struct _RemminaPluginService {
 	gint (* get_profile_remote_width)(RemminaProtocolWidget *gp);
 	gint (* get_profile_remote_height)(RemminaProtocolWidget *gp);
 
+	RemminaFileSnapshot* (*file_snapshot_new)(RemminaFile * remminafile);
+	RemminaFileSnapshot* (*file_snapshot_ref)(RemminaFileSnapshot * snapshot);
+	void (* file_snapshot_unref)(RemminaFileSnapshot *snapshot);
+	const gchar* (*file_snapshot_get_string)(RemminaFileSnapshot * snapshot, const gchar * setting);
+	gint (* file_snapshot_get_int)(RemminaFileSnapshot *snapshot, const gchar *setting, gint default_value);
+
+	void (* protocol_plugin_screenshot_ready)(RemminaProtocolWidget *gp, RemminaPluginScreenshotData *rpsd);
 
 } RemminaPluginService;
 
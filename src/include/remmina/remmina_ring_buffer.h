@@ -0,0 +1,136 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ * Copyright (C) 2016-2019 Antenore Gatta, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <sys/uio.h>
+#include "remmina/remmina_trace_calls.h"
+
+G_BEGIN_DECLS
+
+/* Fixed size ring buffer between a socket and an SSH channel. Free space
+ * and pending data are described as iovecs, for readv() and writev(). */
+typedef struct _RemminaRingBuffer {
+	gchar * data;
+	gsize	size;
+	gsize	head;   /* Offset of the first pending byte */
+	gsize	len;    /* Number of pending bytes */
+} RemminaRingBuffer;
+
+static inline RemminaRingBuffer *
+remmina_ring_buffer_new(gsize size)
+{
+	TRACE_CALL(__func__);
+	RemminaRingBuffer *buffer;
+
+	buffer = g_new(RemminaRingBuffer, 1);
+	buffer->data = (gchar *)g_malloc(size);
+	buffer->size = size;
+	buffer->head = 0;
+	buffer->len = 0;
+	return buffer;
+}
+
+static inline void
+remmina_ring_buffer_free(RemminaRingBuffer *buffer)
+{
+	TRACE_CALL(__func__);
+	if (buffer) {
+		g_free(buffer->data);
+		g_free(buffer);
+	}
+}
+
+/* Describe the free space of the buffer in at most 2 iovecs, returns the number of iovecs */
+static inline gint
+remmina_ring_buffer_space(RemminaRingBuffer *buffer, struct iovec *iov)
+{
+	gsize tail;
+
+	if (buffer->len == buffer->size)
+		return 0;
+	if (buffer->len == 0)
+		buffer->head = 0;
+
+	tail = (buffer->head + buffer->len) % buffer->size;
+	if (tail < buffer->head) {
+		iov[0].iov_base = buffer->data + tail;
+		iov[0].iov_len = buffer->head - tail;
+		return 1;
+	}
+	iov[0].iov_base = buffer->data + tail;
+	iov[0].iov_len = buffer->size - tail;
+	if (buffer->head == 0)
+		return 1;
+	iov[1].iov_base = buffer->data;
+	iov[1].iov_len = buffer->head;
+	return 2;
+}
+
+/* Describe the pending data of the buffer in at most 2 iovecs, returns the number of iovecs */
+static inline gint
+remmina_ring_buffer_pending(RemminaRingBuffer *buffer, struct iovec *iov)
+{
+	if (buffer->len == 0)
+		return 0;
+
+	iov[0].iov_base = buffer->data + buffer->head;
+	if (buffer->head + buffer->len <= buffer->size) {
+		iov[0].iov_len = buffer->len;
+		return 1;
+	}
+	iov[0].iov_len = buffer->size - buffer->head;
+	iov[1].iov_base = buffer->data;
+	iov[1].iov_len = buffer->len - iov[0].iov_len;
+	return 2;
+}
+
+/* Account for len bytes written in the free space */
+static inline void
+remmina_ring_buffer_produce(RemminaRingBuffer *buffer, gsize len)
+{
+	buffer->len += len;
+}
+
+/* Release len bytes of pending data */
+static inline void
+remmina_ring_buffer_consume(RemminaRingBuffer *buffer, gsize len)
+{
+	buffer->len -= len;
+	buffer->head = buffer->len ? (buffer->head + len) % buffer->size : 0;
+}
+
+G_END_DECLS
@@ -37,18 +37,44 @@
 
 #ifdef  WITH_TRACE_CALLS
 
-#include <gtk/gtk.h>
+#include <glib.h>
 
+G_BEGIN_DECLS
+
+/* Number of power of two buckets of the per-function duration histograms,
+ * bucket n counts the calls which lasted less than 2^n microseconds */
+#define REMMINA_TRACE_HISTOGRAM_BUCKETS 24
+
+/* One per TRACE_CALL() site, registered on its first call */
+typedef struct _RemminaTraceSite {
+	const gchar *			name;
+	gsize				id;
+	guint64				calls;
+	guint64				total_time;     /* Microseconds */
+	guint64				histogram[REMMINA_TRACE_HISTOGRAM_BUCKETS];
+	struct _RemminaTraceSite *	next;
+} RemminaTraceSite;
+
+typedef struct _RemminaTraceFrame {
+	RemminaTraceSite *	site;
+	gint64			start;
+} RemminaTraceFrame;
+
+RemminaTraceFrame remmina_trace_calls_enter(RemminaTraceSite *site, const gchar *name);
+void remmina_trace_calls_leave(RemminaTraceFrame *frame);
+void remmina_trace_calls_init(void);
+gboolean remmina_trace_calls_dump(const gchar *filename);
+
+G_END_DECLS
+
+/* Records the function entry in the per-thread ring buffer, and its
+ * duration when the calling function returns */
 #define TRACE_CALL(text) \
-	{ \
-		GDateTime *datetime = g_date_time_new_now_local(); \
-		gchar *sfmtdate = g_date_time_format(datetime, "%x %X"); \
-		g_print("%s Trace calls: %s\n", sfmtdate, text); \
-		g_free(sfmtdate); \
-		g_date_time_unref(datetime); \
-	}
+	static RemminaTraceSite G_PASTE(remmina_trace_site_, __LINE__); \
+	RemminaTraceFrame G_PASTE(remmina_trace_frame_, __LINE__) \
+		__attribute__((cleanup(remmina_trace_calls_leave), unused)) = \
+			remmina_trace_calls_enter(&G_PASTE(remmina_trace_site_, __LINE__), text)
 
 #else
 #define TRACE_CALL(text)
 #endif  /* _WITH_TRACE_CALLS_ */
-
@@ -39,6 +39,7 @@
 G_BEGIN_DECLS
 
 typedef struct _RemminaFile RemminaFile;
+typedef struct _RemminaFileSnapshot RemminaFileSnapshot;
 
 typedef enum {
 	REMMINA_PROTOCOL_FEATURE_TYPE_END,
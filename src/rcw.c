@@ -1862,105 +1862,14 @@ static void rcw_toolbar_duplicate(GtkWidget *widget, RemminaConnectionWindow *cn
 	remmina_exec_command(REMMINA_COMMAND_CONNECT, cnnobj->remmina_file->filename);
 
 }
-static void rcw_toolbar_screenshot(GtkWidget *widget, RemminaConnectionWindow *cnnwin)
+/* Write the screenshot surface to the configured file and notify the user */
+static void rcw_save_screenshot(RemminaConnectionObject *cnnobj, cairo_surface_t *surface)
 {
 	TRACE_CALL(__func__);
-
-	GdkPixbuf *screenshot;
-	GdkWindow *active_window;
-	cairo_t *cr;
-	gint width, height;
 	GString *pngstr;
 	gchar *pngname;
-	GtkWidget *dialog;
-	RemminaProtocolWidget *gp;
-	RemminaPluginScreenshotData rpsd;
-	RemminaConnectionObject *cnnobj;
-	cairo_surface_t *srcsurface;
-	cairo_format_t cairo_format;
-	cairo_surface_t *surface;
-	int stride;
-
-	if (cnnwin->priv->toolbar_is_reconfiguring)
-		return;
-	if (!(cnnobj = rcw_get_visible_cnnobj(cnnwin))) return;
-
 	GDateTime *date = g_date_time_new_now_utc();
 
-	// We will take a screenshot of the currently displayed RemminaProtocolWidget.
-	gp = REMMINA_PROTOCOL_WIDGET(cnnobj->proto);
-
-	GtkClipboard *c = gtk_clipboard_get(GDK_SELECTION_CLIPBOARD);
-	// Ask the plugin if it can give us a screenshot
-	if (remmina_protocol_widget_plugin_screenshot(gp, &rpsd)) {
-		// Good, we have a screenshot from the plugin !
-
-		remmina_log_printf("Screenshot from plugin: w=%d h=%d bpp=%d bytespp=%d\n",
-				   rpsd.width, rpsd.height, rpsd.bitsPerPixel, rpsd.bytesPerPixel);
-
-		width = rpsd.width;
-		height = rpsd.height;
-
-		if (rpsd.bitsPerPixel == 32)
-			cairo_format = CAIRO_FORMAT_ARGB32;
-		else if (rpsd.bitsPerPixel == 24)
-			cairo_format = CAIRO_FORMAT_RGB24;
-		else
-			cairo_format = CAIRO_FORMAT_RGB16_565;
-
-		stride = cairo_format_stride_for_width(cairo_format, width);
-
-		srcsurface = cairo_image_surface_create_for_data(rpsd.buffer, cairo_format, width, height, stride);
-		// Transfer the PixBuf in the main clipboard selection
-		if (!remmina_pref.deny_screenshot_clipboard)
-			gtk_clipboard_set_image(c, gdk_pixbuf_get_from_surface(
-							srcsurface, 0, 0, width, height));
-		surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
-		cr = cairo_create(surface);
-		cairo_set_source_surface(cr, srcsurface, 0, 0);
-		cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
-		cairo_paint(cr);
-		cairo_surface_destroy(srcsurface);
-
-		free(rpsd.buffer);
-	} else {
-		// The plugin is not releasing us a screenshot, just try to catch one via GTK
-
-		/* Warn the user if image is distorted */
-		if (cnnobj->plugin_can_scale &&
-		    get_current_allowed_scale_mode(cnnobj, NULL, NULL) == REMMINA_PROTOCOL_WIDGET_SCALE_MODE_SCALED) {
-			dialog = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_WARNING, GTK_BUTTONS_OK,
-							_("Warning: screenshot is scaled or distorted. Disable scaling to have better screenshot."));
-			g_signal_connect(G_OBJECT(dialog), "response", G_CALLBACK(gtk_widget_destroy), NULL);
-			gtk_widget_show(dialog);
-		}
-
-		// Get the screenshot.
-		active_window = gtk_widget_get_window(GTK_WIDGET(gp));
-		// width = gdk_window_get_width(gtk_widget_get_window(GTK_WIDGET(cnnobj->cnnwin)));
-		width = gdk_window_get_width(active_window);
-		// height = gdk_window_get_height(gtk_widget_get_window(GTK_WIDGET(cnnobj->cnnwin)));
-		height = gdk_window_get_height(active_window);
-
-		screenshot = gdk_pixbuf_get_from_window(active_window, 0, 0, width, height);
-		if (screenshot == NULL)
-			g_print("gdk_pixbuf_get_from_window failed\n");
-
-		// Transfer the PixBuf in the main clipboard selection
-		if (!remmina_pref.deny_screenshot_clipboard)
-			gtk_clipboard_set_image(c, screenshot);
-		// Prepare the destination cairo surface.
-		surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
-		cr = cairo_create(surface);
-
-		// Copy the source pixbuf to the surface and paint it.
-		gdk_cairo_set_source_pixbuf(cr, screenshot, 0, 0);
-		cairo_paint(cr);
-
-		// Deallocate screenshot pixbuf
-		g_object_unref(screenshot);
-	}
-
 	//home/antenore/Pictures/remmina_%p_%h_%Y  %m %d-%H%M%S.png pngname
 	//home/antenore/Pictures/remmina_st_  _2018 9 24-151958.240374.png
 
@@ -1991,6 +1900,140 @@ static void rcw_toolbar_screenshot(GtkWidget *widget, RemminaConnectionWindow *c
 	/* send a desktop notification */
 	if (g_file_test(pngname, G_FILE_TEST_EXISTS))
 		remmina_public_send_notification("remmina-screenshot-is-ready-id", _("Screenshot taken"), pngname);
+	g_free(pngname);
+}
+
+/* Save a screenshot given by the plugin, the buffer stays owned by the caller */
+static void rcw_save_plugin_screenshot(RemminaConnectionObject *cnnobj, RemminaPluginScreenshotData *rpsd)
+{
+	TRACE_CALL(__func__);
+	GtkClipboard *c = gtk_clipboard_get(GDK_SELECTION_CLIPBOARD);
+	cairo_surface_t *srcsurface;
+	cairo_format_t cairo_format;
+	cairo_surface_t *surface;
+	cairo_t *cr;
+	gint width, height;
+	int stride;
+
+	remmina_log_printf("Screenshot from plugin: w=%d h=%d bpp=%d bytespp=%d\n",
+			   rpsd->width, rpsd->height, rpsd->bitsPerPixel, rpsd->bytesPerPixel);
+
+	width = rpsd->width;
+	height = rpsd->height;
+
+	if (rpsd->bitsPerPixel == 32)
+		cairo_format = CAIRO_FORMAT_ARGB32;
+	else if (rpsd->bitsPerPixel == 24)
+		cairo_format = CAIRO_FORMAT_RGB24;
+	else
+		cairo_format = CAIRO_FORMAT_RGB16_565;
+
+	stride = cairo_format_stride_for_width(cairo_format, width);
+
+	srcsurface = cairo_image_surface_create_for_data(rpsd->buffer, cairo_format, width, height, stride);
+	// Transfer the PixBuf in the main clipboard selection
+	if (!remmina_pref.deny_screenshot_clipboard)
+		gtk_clipboard_set_image(c, gdk_pixbuf_get_from_surface(
+						srcsurface, 0, 0, width, height));
+	surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+	cr = cairo_create(surface);
+	cairo_set_source_surface(cr, srcsurface, 0, 0);
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	cairo_paint(cr);
+	cairo_surface_destroy(srcsurface);
+
+	rcw_save_screenshot(cnnobj, surface);
+
+	cairo_destroy(cr);
+	cairo_surface_destroy(surface);
+}
+
+/* A screenshot requested with rcw_toolbar_screenshot() is delivered later by
+ * the plugin, rpsd is NULL when the capture failed */
+void rco_on_screenshot_ready(RemminaProtocolWidget *gp, RemminaPluginScreenshotData *rpsd, gpointer data)
+{
+	TRACE_CALL(__func__);
+	RemminaConnectionObject *cnnobj = gp->cnnobj;
+
+	if (!cnnobj)
+		return;
+	if (!rpsd || !rpsd->buffer) {
+		remmina_log_printf("The plugin failed to take the screenshot\n");
+		return;
+	}
+	rcw_save_plugin_screenshot(cnnobj, rpsd);
+}
+
+static void rcw_toolbar_screenshot(GtkWidget *widget, RemminaConnectionWindow *cnnwin)
+{
+	TRACE_CALL(__func__);
+
+	GdkPixbuf *screenshot;
+	GdkWindow *active_window;
+	cairo_t *cr;
+	gint width, height;
+	GtkWidget *dialog;
+	RemminaProtocolWidget *gp;
+	RemminaPluginScreenshotData rpsd = { 0 };
+	RemminaConnectionObject *cnnobj;
+	cairo_surface_t *surface;
+
+	if (cnnwin->priv->toolbar_is_reconfiguring)
+		return;
+	if (!(cnnobj = rcw_get_visible_cnnobj(cnnwin))) return;
+
+	// We will take a screenshot of the currently displayed RemminaProtocolWidget.
+	gp = REMMINA_PROTOCOL_WIDGET(cnnobj->proto);
+
+	GtkClipboard *c = gtk_clipboard_get(GDK_SELECTION_CLIPBOARD);
+	// Ask the plugin if it can give us a screenshot
+	if (remmina_protocol_widget_plugin_screenshot(gp, &rpsd)) {
+		// Without a buffer the screenshot comes later, see rco_on_screenshot_ready()
+		if (rpsd.buffer) {
+			// Good, we have a screenshot from the plugin !
+			rcw_save_plugin_screenshot(cnnobj, &rpsd);
+			free(rpsd.buffer);
+		}
+		return;
+	}
+
+	// The plugin is not releasing us a screenshot, just try to catch one via GTK
+
+	/* Warn the user if image is distorted */
+	if (cnnobj->plugin_can_scale &&
+	    get_current_allowed_scale_mode(cnnobj, NULL, NULL) == REMMINA_PROTOCOL_WIDGET_SCALE_MODE_SCALED) {
+		dialog = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_WARNING, GTK_BUTTONS_OK,
+						_("Warning: screenshot is scaled or distorted. Disable scaling to have better screenshot."));
+		g_signal_connect(G_OBJECT(dialog), "response", G_CALLBACK(gtk_widget_destroy), NULL);
+		gtk_widget_show(dialog);
+	}
+
+	// Get the screenshot.
+	active_window = gtk_widget_get_window(GTK_WIDGET(gp));
+	// width = gdk_window_get_width(gtk_widget_get_window(GTK_WIDGET(cnnobj->cnnwin)));
+	width = gdk_window_get_width(active_window);
+	// height = gdk_window_get_height(gtk_widget_get_window(GTK_WIDGET(cnnobj->cnnwin)));
+	height = gdk_window_get_height(active_window);
+
+	screenshot = gdk_pixbuf_get_from_window(active_window, 0, 0, width, height);
+	if (screenshot == NULL)
+		g_print("gdk_pixbuf_get_from_window failed\n");
+
+	// Transfer the PixBuf in the main clipboard selection
+	if (!remmina_pref.deny_screenshot_clipboard)
+		gtk_clipboard_set_image(c, screenshot);
+	// Prepare the destination cairo surface.
+	surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+	cr = cairo_create(surface);
+
+	// Copy the source pixbuf to the surface and paint it.
+	gdk_cairo_set_source_pixbuf(cr, screenshot, 0, 0);
+	cairo_paint(cr);
+
+	// Deallocate screenshot pixbuf
+	g_object_unref(screenshot);
+
+	rcw_save_screenshot(cnnobj, surface);
 
 	//Clean up and return.
 	cairo_destroy(cr);
@@ -3919,6 +3962,7 @@ GtkWidget *rcw_open_from_file_full(RemminaFile *remminafile, GCallback disconnec
 	g_signal_connect(G_OBJECT(cnnobj->proto), "desktop-resize", G_CALLBACK(rco_on_desktop_resize), NULL);
 	g_signal_connect(G_OBJECT(cnnobj->proto), "update-align", G_CALLBACK(rco_on_update_align), NULL);
 	g_signal_connect(G_OBJECT(cnnobj->proto), "unlock-dynres", G_CALLBACK(rco_on_unlock_dynres), NULL);
+	g_signal_connect(G_OBJECT(cnnobj->proto), "screenshot-ready", G_CALLBACK(rco_on_screenshot_ready), NULL);
 
 	if (!remmina_pref.save_view_mode)
 		remmina_file_set_int(cnnobj->remmina_file, "viewmode", remmina_pref.default_mode);
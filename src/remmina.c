@@ -51,6 +51,7 @@
 #include "remmina_plugin_manager.h"
 #include "remmina_pref.h"
 #include "remmina_public.h"
+#include "remmina_stats.h"
 #include "remmina_sftp_plugin.h"
 #include "remmina_ssh_plugin.h"
 #include "remmina_widget_pool.h"
@@ -318,6 +319,9 @@ int main(int argc, char *argv[])
 	remmina_pref_init();
 	remmina_file_manager_init();
 	remmina_plugin_manager_init();
+#ifdef WITH_TRACE_CALLS
+	remmina_trace_calls_init();
+#endif
 
 
 	app_id = g_application_id_is_valid(REMMINA_APP_ID) ? REMMINA_APP_ID : NULL;
@@ -335,5 +339,9 @@ int main(int argc, char *argv[])
 	status = g_application_run(G_APPLICATION(app), argc, argv);
 	g_object_unref(app);
 
+	/* Write the preference changes still waiting for the write-behind timer */
+	remmina_pref_flush();
+	remmina_stats_profiles_flush();
+
 	return status;
 }
@@ -38,6 +38,7 @@
 
 #include <gtk/gtk.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <string.h>
 
 #include "remmina_public.h"
@@ -50,8 +51,29 @@ G_DEFINE_TYPE( RemminaAppletMenu, remmina_applet_menu, GTK_TYPE_MENU)
 
 struct _RemminaAppletMenuPriv {
 	gboolean hide_count;
+	gboolean lazy;
 };
 
+/* What the menu shows of a profile. Entries are cached by file name and
+ * read again only when the file changed, menus keep references to the
+ * entries of the groups they have not built yet. */
+typedef struct _RemminaAppletMenuEntry {
+	gint refcount;
+	gchar *filename;
+	gchar *name;
+	gchar *group;
+	gchar *protocol;
+	gchar *server;
+	gboolean ssh_enabled;
+	gint64 mtime;
+	gint64 size;
+	guint generation;
+} RemminaAppletMenuEntry;
+
+static GHashTable *remmina_applet_menu_index = NULL;
+static gchar *remmina_applet_menu_index_datadir = NULL;
+static guint remmina_applet_menu_index_generation = 0;
+
 enum {
 	LAUNCH_ITEM_SIGNAL, EDIT_ITEM_SIGNAL, LAST_SIGNAL
 };
@@ -80,6 +102,7 @@ static void remmina_applet_menu_init(RemminaAppletMenu *menu)
 {
 	TRACE_CALL(__func__);
 	menu->priv = g_new0(RemminaAppletMenuPriv, 1);
+	menu->priv->lazy = TRUE;
 
 	g_signal_connect(G_OBJECT(menu), "destroy", G_CALLBACK(remmina_applet_menu_destroy), NULL);
 }
@@ -119,77 +142,98 @@ remmina_applet_menu_add_group(GtkWidget *menu, const gchar *group, gint position
 	return submenu;
 }
 
-static void remmina_applet_menu_increase_group_count(GtkWidget *widget)
+static void remmina_applet_menu_set_group_count(GtkWidget *widget, gint cnt)
 {
 	TRACE_CALL(__func__);
-	gint cnt;
 	gchar *s;
 
-	cnt = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(widget), "count")) + 1;
 	g_object_set_data(G_OBJECT(widget), "count", GINT_TO_POINTER(cnt));
 	s = g_strdup_printf("%s (%i)", (const gchar*)g_object_get_data(G_OBJECT(widget), "group"), cnt);
 	gtk_menu_item_set_label(GTK_MENU_ITEM(widget), s);
 	g_free(s);
 }
 
+static void remmina_applet_menu_increase_group_count(GtkWidget *widget)
+{
+	TRACE_CALL(__func__);
+	remmina_applet_menu_set_group_count(widget,
+		GPOINTER_TO_INT(g_object_get_data(G_OBJECT(widget), "count")) + 1);
+}
+
 void remmina_applet_menu_register_item(RemminaAppletMenu *menu, RemminaAppletMenuItem *menuitem)
 {
 	TRACE_CALL(__func__);
 	g_signal_connect(G_OBJECT(menuitem), "activate", G_CALLBACK(remmina_applet_menu_on_item_activate), menu);
 }
 
-void remmina_applet_menu_add_item(RemminaAppletMenu *menu, RemminaAppletMenuItem *menuitem)
+/* Find the submenu of group in submenu, or create it at its sorted position */
+static GtkWidget*
+remmina_applet_menu_find_group(GtkWidget *submenu, const gchar *group, GtkWidget **groupmenuitem)
+{
+	TRACE_CALL(__func__);
+	GtkMenuItem *submenuitem;
+	GList *childs, *child;
+	gchar *mstr;
+	gint position;
+	GtkWidget *groupsubmenu = NULL;
+
+	*groupmenuitem = NULL;
+	childs = gtk_container_get_children(GTK_CONTAINER(submenu));
+	position = -1;
+	for (child = g_list_first(childs); child; child = g_list_next(child)) {
+		if (!GTK_IS_MENU_ITEM(child->data))
+			continue;
+		position++;
+		submenuitem = GTK_MENU_ITEM(child->data);
+		if (gtk_menu_item_get_submenu(submenuitem)) {
+			mstr = (gchar*)g_object_get_data(G_OBJECT(submenuitem), "group");
+			if (g_strcmp0(group, mstr) == 0) {
+				/* Found existing group menu */
+				groupsubmenu = gtk_menu_item_get_submenu(submenuitem);
+				*groupmenuitem = GTK_WIDGET(submenuitem);
+				break;
+			}else  {
+				/* Redo comparison ignoring case and respecting international
+				 * collation, to set menu sort order */
+				if (strcoll(group, mstr) < 0) {
+					groupsubmenu = remmina_applet_menu_add_group(submenu, group, position, NULL,
+						groupmenuitem);
+					break;
+				}
+			}
+		}else  {
+			groupsubmenu = remmina_applet_menu_add_group(submenu, group, position, NULL, groupmenuitem);
+			break;
+		}
+
+	}
+
+	if (!child) {
+		groupsubmenu = remmina_applet_menu_add_group(submenu, group, -1, NULL, groupmenuitem);
+	}
+	g_list_free(childs);
+
+	return groupsubmenu;
+}
+
+/* Add menuitem to submenu, in the subgroups listed by the path group */
+static void remmina_applet_menu_add_item_at(RemminaAppletMenu *menu, GtkWidget *submenu, const gchar *group,
+					    RemminaAppletMenuItem *menuitem)
 {
 	TRACE_CALL(__func__);
-	GtkWidget *submenu;
 	GtkWidget *groupmenuitem;
 	GtkMenuItem *submenuitem;
-	gchar *s, *p1, *p2, *mstr;
+	gchar *s, *p1, *p2;
 	GList *childs, *child;
 	gint position;
 
-	submenu = GTK_WIDGET(menu);
-	s = g_strdup(menuitem->group);
+	s = g_strdup(group);
 	p1 = s;
 	p2 = p1 ? strchr(p1, '/') : NULL;
 	if (p2)
 		*p2++ = '\0';
 	while (p1 && p1[0]) {
-		groupmenuitem = NULL;
-		childs = gtk_container_get_children(GTK_CONTAINER(submenu));
-		position = -1;
-		for (child = g_list_first(childs); child; child = g_list_next(child)) {
-			if (!GTK_IS_MENU_ITEM(child->data))
-				continue;
-			position++;
-			submenuitem = GTK_MENU_ITEM(child->data);
-			if (gtk_menu_item_get_submenu(submenuitem)) {
-				mstr = (gchar*)g_object_get_data(G_OBJECT(submenuitem), "group");
-				if (g_strcmp0(p1, mstr) == 0) {
-					/* Found existing group menu */
-					submenu = gtk_menu_item_get_submenu(submenuitem);
-					groupmenuitem = GTK_WIDGET(submenuitem);
-					break;
-				}else  {
-					/* Redo comparison ignoring case and respecting international
-					 * collation, to set menu sort order */
-					if (strcoll(p1, mstr) < 0) {
-						submenu = remmina_applet_menu_add_group(submenu, p1, position, menuitem,
-							&groupmenuitem);
-						break;
-					}
-				}
-			}else  {
-				submenu = remmina_applet_menu_add_group(submenu, p1, position, menuitem, &groupmenuitem);
-				break;
-			}
-
-		}
-
-		if (!child) {
-			submenu = remmina_applet_menu_add_group(submenu, p1, -1, menuitem, &groupmenuitem);
-		}
-		g_list_free(childs);
+		submenu = remmina_applet_menu_find_group(submenu, p1, &groupmenuitem);
 		if (groupmenuitem && !menu->priv->hide_count) {
 			remmina_applet_menu_increase_group_count(groupmenuitem);
 		}
@@ -223,6 +267,30 @@ void remmina_applet_menu_add_item(RemminaAppletMenu *menu, RemminaAppletMenuItem
 	remmina_applet_menu_register_item(menu, menuitem);
 }
 
+void remmina_applet_menu_add_item(RemminaAppletMenu *menu, RemminaAppletMenuItem *menuitem)
+{
+	TRACE_CALL(__func__);
+	remmina_applet_menu_add_item_at(menu, GTK_WIDGET(menu), menuitem->group, menuitem);
+}
+
+/* Remove a top level group with all its items */
+void remmina_applet_menu_remove_group(RemminaAppletMenu *menu, const gchar *group)
+{
+	TRACE_CALL(__func__);
+	GList *childs, *child;
+
+	childs = gtk_container_get_children(GTK_CONTAINER(menu));
+	for (child = g_list_first(childs); child; child = g_list_next(child)) {
+		if (!GTK_IS_MENU_ITEM(child->data) || !gtk_menu_item_get_submenu(GTK_MENU_ITEM(child->data)))
+			continue;
+		if (g_strcmp0(group, (const gchar*)g_object_get_data(G_OBJECT(child->data), "group")) == 0) {
+			gtk_widget_destroy(GTK_WIDGET(child->data));
+			break;
+		}
+	}
+	g_list_free(childs);
+}
+
 GtkWidget*
 remmina_applet_menu_new(void)
 {
@@ -240,32 +308,198 @@ void remmina_applet_menu_set_hide_count(RemminaAppletMenu *menu, gboolean hide_c
 	menu->priv->hide_count = hide_count;
 }
 
-void remmina_applet_menu_populate(RemminaAppletMenu *menu)
+void remmina_applet_menu_set_lazy(RemminaAppletMenu *menu, gboolean lazy)
 {
 	TRACE_CALL(__func__);
-	GtkWidget *menuitem;
+	menu->priv->lazy = lazy;
+}
+
+static RemminaAppletMenuEntry *remmina_applet_menu_entry_ref(RemminaAppletMenuEntry *entry)
+{
+	TRACE_CALL(__func__);
+	entry->refcount++;
+	return entry;
+}
+
+static void remmina_applet_menu_entry_unref(RemminaAppletMenuEntry *entry)
+{
+	TRACE_CALL(__func__);
+	if (--entry->refcount > 0)
+		return;
+	g_free(entry->filename);
+	g_free(entry->name);
+	g_free(entry->group);
+	g_free(entry->protocol);
+	g_free(entry->server);
+	g_free(entry);
+}
+
+static RemminaAppletMenuEntry *remmina_applet_menu_entry_load(const gchar *filename, GStatBuf *st)
+{
+	TRACE_CALL(__func__);
+	RemminaAppletMenuEntry *entry;
+	GKeyFile *gkeyfile;
+
+	gkeyfile = g_key_file_new();
+	if (!g_key_file_load_from_file(gkeyfile, filename, G_KEY_FILE_NONE, NULL)) {
+		g_key_file_free(gkeyfile);
+		return NULL;
+	}
+
+	entry = g_new0(RemminaAppletMenuEntry, 1);
+	entry->refcount = 1;
+	entry->filename = g_strdup(filename);
+	entry->name = g_key_file_get_string(gkeyfile, "remmina", "name", NULL);
+	entry->group = g_key_file_get_string(gkeyfile, "remmina", "group", NULL);
+	entry->protocol = g_key_file_get_string(gkeyfile, "remmina", "protocol", NULL);
+	entry->server = g_key_file_get_string(gkeyfile, "remmina", "server", NULL);
+	entry->ssh_enabled = g_key_file_get_boolean(gkeyfile, "remmina", "ssh_enabled", NULL);
+	entry->mtime = st->st_mtime;
+	entry->size = st->st_size;
+	g_key_file_free(gkeyfile);
+
+	if (entry->name == NULL) {
+		g_print("WARNING: missing name= line in file %s. Skipping.\n", filename);
+		remmina_applet_menu_entry_unref(entry);
+		return NULL;
+	}
+
+	return entry;
+}
+
+/* Bring the profile index up to date with the data dir. Only the files
+ * whose size or modification time changed are parsed again. */
+static void remmina_applet_menu_index_update(void)
+{
+	TRACE_CALL(__func__);
+	RemminaAppletMenuEntry *entry;
 	gchar filename[MAX_PATH_LEN];
+	GHashTableIter iter;
+	GStatBuf st;
 	GDir *dir;
 	gchar *remmina_data_dir;
 	const gchar *name;
 
 	remmina_data_dir = remmina_file_get_datadir();
+	if (!remmina_applet_menu_index || g_strcmp0(remmina_data_dir, remmina_applet_menu_index_datadir) != 0) {
+		if (remmina_applet_menu_index)
+			g_hash_table_destroy(remmina_applet_menu_index);
+		remmina_applet_menu_index = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+			(GDestroyNotify)remmina_applet_menu_entry_unref);
+		g_free(remmina_applet_menu_index_datadir);
+		remmina_applet_menu_index_datadir = g_strdup(remmina_data_dir);
+	}
+	remmina_applet_menu_index_generation++;
+
 	dir = g_dir_open(remmina_data_dir, 0, NULL);
 	if (dir != NULL) {
-		/* Iterate all remote desktop profiles */
 		while ((name = g_dir_read_name(dir)) != NULL) {
 			if (!g_str_has_suffix(name, ".remmina"))
 				continue;
 			g_snprintf(filename, sizeof(filename), "%s/%s", remmina_data_dir, name);
+			if (g_stat(filename, &st) != 0)
+				continue;
 
-			menuitem = remmina_applet_menu_item_new(REMMINA_APPLET_MENU_ITEM_FILE, filename);
-			if (menuitem != NULL) {
-				remmina_applet_menu_add_item(menu, REMMINA_APPLET_MENU_ITEM(menuitem));
-				gtk_widget_show(menuitem);
+			entry = g_hash_table_lookup(remmina_applet_menu_index, filename);
+			if (!entry || entry->mtime != st.st_mtime || entry->size != st.st_size) {
+				entry = remmina_applet_menu_entry_load(filename, &st);
+				if (!entry) {
+					g_hash_table_remove(remmina_applet_menu_index, filename);
+					continue;
+				}
+				g_hash_table_replace(remmina_applet_menu_index, entry->filename, entry);
 			}
+			entry->generation = remmina_applet_menu_index_generation;
 		}
 		g_dir_close(dir);
 	}
 	g_free(remmina_data_dir);
+
+	/* Forget the deleted profiles */
+	g_hash_table_iter_init(&iter, remmina_applet_menu_index);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer*)&entry)) {
+		if (entry->generation != remmina_applet_menu_index_generation)
+			g_hash_table_iter_remove(&iter);
+	}
+}
+
+static void remmina_applet_menu_add_entry(RemminaAppletMenu *menu, GtkWidget *submenu, const gchar *group,
+					  RemminaAppletMenuEntry *entry)
+{
+	TRACE_CALL(__func__);
+	GtkWidget *menuitem;
+
+	menuitem = remmina_applet_menu_item_new_file(entry->filename, entry->name, entry->group,
+		entry->protocol, entry->server, entry->ssh_enabled);
+	remmina_applet_menu_add_item_at(menu, submenu, group, REMMINA_APPLET_MENU_ITEM(menuitem));
+	gtk_widget_show(menuitem);
+}
+
+/* A top level group is about to be shown: create its items and subgroups */
+static void remmina_applet_menu_on_group_select(GtkMenuItem *groupmenuitem, RemminaAppletMenu *menu)
+{
+	TRACE_CALL(__func__);
+	RemminaAppletMenuEntry *entry;
+	GPtrArray *entries;
+	const gchar *subgroup;
+	guint i;
+
+	entries = g_object_steal_data(G_OBJECT(groupmenuitem), "entries");
+	if (!entries)
+		return;
+
+	for (i = 0; i < entries->len; i++) {
+		entry = g_ptr_array_index(entries, i);
+		subgroup = strchr(entry->group, '/');
+		remmina_applet_menu_add_entry(menu, gtk_menu_item_get_submenu(groupmenuitem),
+			subgroup ? subgroup + 1 : NULL, entry);
+	}
+	g_ptr_array_unref(entries);
 }
 
+void remmina_applet_menu_populate(RemminaAppletMenu *menu)
+{
+	TRACE_CALL(__func__);
+	RemminaAppletMenuEntry *entry;
+	GHashTableIter iter;
+	GHashTable *groups;
+	GPtrArray *entries;
+	GtkWidget *groupmenuitem;
+	gchar *group;
+
+	remmina_applet_menu_index_update();
+
+	/* Entries of each top level group, whose items are only created when
+	 * the group is opened */
+	groups = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_ptr_array_unref);
+
+	g_hash_table_iter_init(&iter, remmina_applet_menu_index);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer*)&entry)) {
+		group = entry->group ? g_strndup(entry->group, strcspn(entry->group, "/")) : NULL;
+		if (!menu->priv->lazy || !group || group[0] == '\0') {
+			remmina_applet_menu_add_entry(menu, GTK_WIDGET(menu), entry->group, entry);
+			g_free(group);
+			continue;
+		}
+		entries = g_hash_table_lookup(groups, group);
+		if (!entries) {
+			entries = g_ptr_array_new_with_free_func((GDestroyNotify)remmina_applet_menu_entry_unref);
+			g_hash_table_insert(groups, group, entries);
+		} else {
+			g_free(group);
+		}
+		g_ptr_array_add(entries, remmina_applet_menu_entry_ref(entry));
+	}
+
+	g_hash_table_iter_init(&iter, groups);
+	while (g_hash_table_iter_next(&iter, (gpointer*)&group, (gpointer*)&entries)) {
+		remmina_applet_menu_find_group(GTK_WIDGET(menu), group, &groupmenuitem);
+		if (!menu->priv->hide_count)
+			remmina_applet_menu_set_group_count(groupmenuitem,
+				GPOINTER_TO_INT(g_object_get_data(G_OBJECT(groupmenuitem), "count")) + entries->len);
+		g_object_set_data_full(G_OBJECT(groupmenuitem), "entries", g_ptr_array_ref(entries),
+			(GDestroyNotify)g_ptr_array_unref);
+		g_signal_connect(G_OBJECT(groupmenuitem), "select", G_CALLBACK(remmina_applet_menu_on_group_select), menu);
+	}
+	g_hash_table_destroy(groups);
+}
@@ -70,8 +70,11 @@ G_GNUC_CONST;
 
 void remmina_applet_menu_register_item(RemminaAppletMenu* menu, RemminaAppletMenuItem* menuitem);
 void remmina_applet_menu_add_item(RemminaAppletMenu* menu, RemminaAppletMenuItem* menuitem);
+void remmina_applet_menu_remove_group(RemminaAppletMenu* menu, const gchar* group);
 GtkWidget* remmina_applet_menu_new(void);
 void remmina_applet_menu_set_hide_count(RemminaAppletMenu* menu, gboolean hide_count);
+/* Create the items of a group only when it is opened, the default */
+void remmina_applet_menu_set_lazy(RemminaAppletMenu* menu, gboolean lazy);
 void remmina_applet_menu_populate(RemminaAppletMenu* menu);
 
 G_END_DECLS
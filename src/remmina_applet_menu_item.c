@@ -73,13 +73,28 @@ static void remmina_applet_menu_item_init(RemminaAppletMenuItem* item)
 	g_signal_connect(G_OBJECT(item), "destroy", G_CALLBACK(remmina_applet_menu_item_destroy), NULL);
 }
 
+static void remmina_applet_menu_item_add_label(RemminaAppletMenuItem* item)
+{
+	TRACE_CALL(__func__);
+	GtkWidget* widget;
+
+	widget = gtk_label_new(item->name);
+	gtk_widget_show(widget);
+	gtk_widget_set_valign(widget, GTK_ALIGN_START);
+	gtk_widget_set_halign(widget, GTK_ALIGN_START);
+	gtk_container_add(GTK_CONTAINER(item), widget);
+
+	if (item->server) {
+		gtk_widget_set_tooltip_text(GTK_WIDGET(item), item->server);
+	}
+}
+
 GtkWidget* remmina_applet_menu_item_new(RemminaAppletMenuItemType item_type, ...)
 {
 	TRACE_CALL(__func__);
 	va_list ap;
 	RemminaAppletMenuItem* item;
 	GKeyFile* gkeyfile;
-	GtkWidget* widget;
 
 	va_start(ap, item_type);
 
@@ -130,15 +145,30 @@ GtkWidget* remmina_applet_menu_item_new(RemminaAppletMenuItemType item_type, ...
 	va_end(ap);
 
 	/* Create the label */
-	widget = gtk_label_new(item->name);
-	gtk_widget_show(widget);
-	gtk_widget_set_valign(widget, GTK_ALIGN_START);
-	gtk_widget_set_halign(widget, GTK_ALIGN_START);
-	gtk_container_add(GTK_CONTAINER(item), widget);
+	remmina_applet_menu_item_add_label(item);
 
-	if (item->server) {
-		gtk_widget_set_tooltip_text(GTK_WIDGET(item), item->server);
-	}
+	return GTK_WIDGET(item);
+}
+
+/* Create a REMMINA_APPLET_MENU_ITEM_FILE item from settings already read,
+ * without loading the file */
+GtkWidget* remmina_applet_menu_item_new_file(const gchar* filename, const gchar* name, const gchar* group,
+					     const gchar* protocol, const gchar* server, gboolean ssh_enabled)
+{
+	TRACE_CALL(__func__);
+	RemminaAppletMenuItem* item;
+
+	item = REMMINA_APPLET_MENU_ITEM(g_object_new(REMMINA_TYPE_APPLET_MENU_ITEM, NULL));
+
+	item->item_type = REMMINA_APPLET_MENU_ITEM_FILE;
+	item->filename = g_strdup(filename);
+	item->name = g_strdup(name);
+	item->group = g_strdup(group);
+	item->protocol = g_strdup(protocol);
+	item->server = g_strdup(server);
+	item->ssh_enabled = ssh_enabled;
+
+	remmina_applet_menu_item_add_label(item);
 
 	return GTK_WIDGET(item);
 }
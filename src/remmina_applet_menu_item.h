@@ -68,6 +68,8 @@ GType remmina_applet_menu_item_get_type(void)
 G_GNUC_CONST;
 
 GtkWidget* remmina_applet_menu_item_new(RemminaAppletMenuItemType item_type, ...);
+GtkWidget* remmina_applet_menu_item_new_file(const gchar* filename, const gchar* name, const gchar* group,
+					     const gchar* protocol, const gchar* server, gboolean ssh_enabled);
 gint remmina_applet_menu_item_compare(gconstpointer a, gconstpointer b, gpointer user_data);
 
 G_END_DECLS
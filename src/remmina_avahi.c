@@ -43,18 +43,26 @@
 
 #include <avahi-client/client.h>
 #include <avahi-client/lookup.h>
-#include <avahi-common/simple-watch.h>
 #include <avahi-common/malloc.h>
 #include <avahi-common/error.h>
+#include <avahi-glib/glib-watch.h>
 
 struct _RemminaAvahiPriv {
-	AvahiSimplePoll* simple_poll;
+	/* Avahi watches and timeouts are sources of the default main context */
+	AvahiGLibPoll* glib_poll;
 	AvahiClient* client;
 	AvahiServiceBrowser* sb;
-	guint iterate_handler;
-	gboolean has_event;
+	RemminaAvahiChangedFunc changed_func;
+	gpointer changed_data;
 };
 
+static void remmina_avahi_changed(RemminaAvahi* ga)
+{
+	TRACE_CALL(__func__);
+	if (ga->priv->changed_func)
+		ga->priv->changed_func(ga, ga->priv->changed_data);
+}
+
 static void
 remmina_avahi_resolve_callback(
 	AvahiServiceResolver* r,
@@ -78,8 +86,6 @@ remmina_avahi_resolve_callback(
 
 	assert(r);
 
-	ga->priv->has_event = TRUE;
-
 	switch (event) {
 	case AVAHI_RESOLVER_FAILURE:
 		g_print("(remmina-applet avahi-resolver) Failed to resolve service '%s' of type '%s' in domain '%s': %s\n",
@@ -97,6 +103,7 @@ remmina_avahi_resolve_callback(
 		/* key and value will be freed with g_free when the has table is freed */
 
 		g_print("(remmina-applet avahi-resolver) Added service '%s'\n", value);
+		remmina_avahi_changed(ga);
 
 		break;
 	}
@@ -122,8 +129,6 @@ remmina_avahi_browse_callback(
 
 	assert(b);
 
-	ga->priv->has_event = TRUE;
-
 	switch (event) {
 	case AVAHI_BROWSER_FAILURE:
 		g_print("(remmina-applet avahi-browser) %s\n",
@@ -150,7 +155,8 @@ remmina_avahi_browse_callback(
 	case AVAHI_BROWSER_REMOVE:
 		g_print("(remmina-applet avahi-browser) Removed service '%s' of type '%s' in domain '%s'\n", name, type, domain);
 		key = g_strdup_printf("%s,%s,%s", name, type, domain);
-		g_hash_table_remove(ga->discovered_services, key);
+		if (g_hash_table_remove(ga->discovered_services, key))
+			remmina_avahi_changed(ga);
 		g_free(key);
 		break;
 
@@ -163,29 +169,11 @@ remmina_avahi_browse_callback(
 static void remmina_avahi_client_callback(AvahiClient* c, AvahiClientState state, AVAHI_GCC_UNUSED void * userdata)
 {
 	TRACE_CALL(__func__);
-	RemminaAvahi* ga = (RemminaAvahi*)userdata;
-
-	ga->priv->has_event = TRUE;
-
 	if (state == AVAHI_CLIENT_FAILURE) {
 		g_print("(remmina-applet avahi) Server connection failure: %s\n", avahi_strerror(avahi_client_errno(c)));
 	}
 }
 
-static gboolean remmina_avahi_iterate(RemminaAvahi* ga)
-{
-	TRACE_CALL(__func__);
-	while (TRUE) {
-		/* Call the iteration until no further events */
-		ga->priv->has_event = FALSE;
-		avahi_simple_poll_iterate(ga->priv->simple_poll, 0);
-		if (!ga->priv->has_event)
-			break;
-	}
-
-	return TRUE;
-}
-
 RemminaAvahi* remmina_avahi_new(void)
 {
 	TRACE_CALL(__func__);
@@ -195,11 +183,11 @@ RemminaAvahi* remmina_avahi_new(void)
 	ga->discovered_services = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
 	ga->started = FALSE;
 	ga->priv = g_new(RemminaAvahiPriv, 1);
-	ga->priv->simple_poll = NULL;
+	ga->priv->glib_poll = NULL;
 	ga->priv->client = NULL;
 	ga->priv->sb = NULL;
-	ga->priv->iterate_handler = 0;
-	ga->priv->has_event = FALSE;
+	ga->priv->changed_func = NULL;
+	ga->priv->changed_data = NULL;
 
 	return ga;
 }
@@ -214,13 +202,13 @@ void remmina_avahi_start(RemminaAvahi* ga)
 
 	ga->started = TRUE;
 
-	ga->priv->simple_poll = avahi_simple_poll_new();
-	if (!ga->priv->simple_poll) {
-		g_print("Failed to create simple poll object.\n");
+	ga->priv->glib_poll = avahi_glib_poll_new(NULL, G_PRIORITY_DEFAULT);
+	if (!ga->priv->glib_poll) {
+		g_print("Failed to create glib poll object.\n");
 		return;
 	}
 
-	ga->priv->client = avahi_client_new(avahi_simple_poll_get(ga->priv->simple_poll), 0, remmina_avahi_client_callback, ga,
+	ga->priv->client = avahi_client_new(avahi_glib_poll_get(ga->priv->glib_poll), 0, remmina_avahi_client_callback, ga,
 		&error);
 	if (!ga->priv->client) {
 		g_print("Failed to create client: %s\n", avahi_strerror(error));
@@ -234,17 +222,14 @@ void remmina_avahi_start(RemminaAvahi* ga)
 		g_print("Failed to create service browser: %s\n", avahi_strerror(avahi_client_errno(ga->priv->client)));
 		return;
 	}
-
-	ga->priv->iterate_handler = g_timeout_add(5000, (GSourceFunc)remmina_avahi_iterate, ga);
 }
 
 void remmina_avahi_stop(RemminaAvahi* ga)
 {
 	TRACE_CALL(__func__);
-	g_hash_table_remove_all(ga->discovered_services);
-	if (ga->priv->iterate_handler) {
-		g_source_remove(ga->priv->iterate_handler);
-		ga->priv->iterate_handler = 0;
+	if (g_hash_table_size(ga->discovered_services) > 0) {
+		g_hash_table_remove_all(ga->discovered_services);
+		remmina_avahi_changed(ga);
 	}
 	if (ga->priv->sb) {
 		avahi_service_browser_free(ga->priv->sb);
@@ -254,19 +239,27 @@ void remmina_avahi_stop(RemminaAvahi* ga)
 		avahi_client_free(ga->priv->client);
 		ga->priv->client = NULL;
 	}
-	if (ga->priv->simple_poll) {
-		avahi_simple_poll_free(ga->priv->simple_poll);
-		ga->priv->simple_poll = NULL;
+	if (ga->priv->glib_poll) {
+		avahi_glib_poll_free(ga->priv->glib_poll);
+		ga->priv->glib_poll = NULL;
 	}
 	ga->started = FALSE;
 }
 
+void remmina_avahi_set_changed_func(RemminaAvahi* ga, RemminaAvahiChangedFunc func, gpointer data)
+{
+	TRACE_CALL(__func__);
+	ga->priv->changed_func = func;
+	ga->priv->changed_data = data;
+}
+
 void remmina_avahi_free(RemminaAvahi* ga)
 {
 	TRACE_CALL(__func__);
 	if (ga == NULL)
 		return;
 
+	ga->priv->changed_func = NULL;
 	remmina_avahi_stop(ga);
 
 	g_free(ga->priv);
@@ -292,6 +285,11 @@ void remmina_avahi_stop(RemminaAvahi* ga)
 	TRACE_CALL(__func__);
 }
 
+void remmina_avahi_set_changed_func(RemminaAvahi* ga, RemminaAvahiChangedFunc func, gpointer data)
+{
+	TRACE_CALL(__func__);
+}
+
 void remmina_avahi_free(RemminaAvahi* ga)
 {
 	TRACE_CALL(__func__);
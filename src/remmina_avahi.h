@@ -46,9 +46,13 @@ typedef struct _RemminaAvahi {
 	RemminaAvahiPriv *priv;
 } RemminaAvahi;
 
+/* Called from the main loop when discovered_services changed */
+typedef void (*RemminaAvahiChangedFunc)(RemminaAvahi* ga, gpointer data);
+
 RemminaAvahi* remmina_avahi_new(void);
 void remmina_avahi_start(RemminaAvahi* ga);
 void remmina_avahi_stop(RemminaAvahi* ga);
+void remmina_avahi_set_changed_func(RemminaAvahi* ga, RemminaAvahiChangedFunc func, gpointer data);
 void remmina_avahi_free(RemminaAvahi* ga);
 
 G_END_DECLS
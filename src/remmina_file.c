@@ -61,6 +61,7 @@
 #include "remmina_main.h"
 #include "remmina_masterthread_exec.h"
 #include "remmina_utils.h"
+#include "remmina_stats.h"
 #include "remmina/remmina_trace_calls.h"
 
 #define MIN_WINDOW_WIDTH 10
@@ -68,7 +69,7 @@
 
 static struct timespec times[2];
 
-static RemminaFile *
+RemminaFile *
 remmina_file_new_empty(void)
 {
 	TRACE_CALL(__func__);
@@ -120,6 +121,7 @@ void remmina_file_generate_filename(RemminaFile *remminafile)
 	gchar *invalid_chars = "\\%|/$?<>:*. \"";
 	GString *filenamestr;
 	gchar *filename;
+	gchar *datadir;
 	const gchar *s;
 
 
@@ -163,12 +165,14 @@ void remmina_file_generate_filename(RemminaFile *remminafile)
 	filename = g_strdelimit(g_ascii_strdown(g_strstrip(g_string_free(filenamestr, FALSE)), -1),
 				invalid_chars, '-');
 
-	dir = g_dir_open(remmina_file_get_datadir(), 0, NULL);
+	datadir = remmina_file_get_datadir();
+	dir = g_dir_open(datadir, 0, NULL);
 	if (dir != NULL)
-		remminafile->filename = g_strdup_printf("%s/%s.remmina", remmina_file_get_datadir(), filename);
+		remminafile->filename = g_strdup_printf("%s/%s.remmina", datadir, filename);
 	else
 		remminafile->filename = NULL;
 	g_dir_close(dir);
+	g_free(datadir);
 }
 
 void remmina_file_set_filename(RemminaFile *remminafile, const gchar *filename)
@@ -412,6 +416,86 @@ gint remmina_file_get_int(RemminaFile *remminafile, const gchar *setting, gint d
 	return value == NULL ? default_value : (value[0] == 't' ? TRUE : atoi(value));
 }
 
+/* Settings are copied once and never modified afterwards, so a snapshot
+ * can be shared and read by protocol threads without any locking */
+struct _RemminaFileSnapshot {
+	gint		refcount;
+	GHashTable *	settings;
+};
+
+RemminaFileSnapshot *
+remmina_file_snapshot_new(RemminaFile *remminafile)
+{
+	TRACE_CALL(__func__);
+	RemminaFileSnapshot *snapshot;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	if (!remmina_masterthread_exec_is_main_thread()) {
+		/* Copy the settings from the main thread, with a single round trip */
+		RemminaMTExecData *d;
+		d = (RemminaMTExecData *)g_malloc(sizeof(RemminaMTExecData));
+		d->func = FUNC_FILE_SNAPSHOT_NEW;
+		d->p.file_snapshot_new.remminafile = remminafile;
+		remmina_masterthread_exec_and_wait(d);
+		snapshot = d->p.file_snapshot_new.retval;
+		g_free(d);
+		return snapshot;
+	}
+
+	snapshot = g_new(RemminaFileSnapshot, 1);
+	snapshot->refcount = 1;
+	snapshot->settings = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+	g_hash_table_iter_init(&iter, remminafile->settings);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		/* The deprecated "resolution" setting is never returned, see remmina_file_get_string() */
+		if (strcmp((const gchar *)key, "resolution") == 0)
+			continue;
+		g_hash_table_insert(snapshot->settings, g_strdup((const gchar *)key), g_strdup((const gchar *)value));
+	}
+	return snapshot;
+}
+
+RemminaFileSnapshot *
+remmina_file_snapshot_ref(RemminaFileSnapshot *snapshot)
+{
+	TRACE_CALL(__func__);
+	g_atomic_int_inc(&snapshot->refcount);
+	return snapshot;
+}
+
+void remmina_file_snapshot_unref(RemminaFileSnapshot *snapshot)
+{
+	TRACE_CALL(__func__);
+	if (snapshot == NULL)
+		return;
+	if (g_atomic_int_dec_and_test(&snapshot->refcount)) {
+		g_hash_table_destroy(snapshot->settings);
+		g_free(snapshot);
+	}
+}
+
+/* Same as remmina_file_get_string(), the returned string belongs to the snapshot */
+const gchar *
+remmina_file_snapshot_get_string(RemminaFileSnapshot *snapshot, const gchar *setting)
+{
+	TRACE_CALL(__func__);
+	gchar *value;
+
+	value = (gchar *)g_hash_table_lookup(snapshot->settings, setting);
+	return value && value[0] ? value : NULL;
+}
+
+gint remmina_file_snapshot_get_int(RemminaFileSnapshot *snapshot, const gchar *setting, gint default_value)
+{
+	TRACE_CALL(__func__);
+	gchar *value;
+
+	value = g_hash_table_lookup(snapshot->settings, setting);
+	return value == NULL ? default_value : (value[0] == 't' ? TRUE : atoi(value));
+}
+
 static GKeyFile *
 remmina_file_get_keyfile(RemminaFile *remminafile)
 {
@@ -521,6 +605,7 @@ void remmina_file_save(RemminaFile *remminafile)
 	content = g_key_file_to_data(gkeyfile, &length, NULL);
 	if (g_file_set_contents(remminafile->filename, content, length, &err)) {
 		g_debug("Profile saved");
+		remmina_stats_profile_update(remminafile);
 	} else {
 		g_warning("Remmina connection profile cannot be saved, with error %d (%s)", err->code, err->message);
 	}
@@ -607,6 +692,7 @@ void remmina_file_delete(const gchar *filename)
 		remmina_file_free(remminafile);
 	}
 	g_unlink(filename);
+	remmina_stats_profile_remove(filename);
 }
 
 void remmina_file_unsave_password(RemminaFile *remminafile)
@@ -57,6 +57,8 @@ enum {
 
 /* Create a empty .remmina file */
 RemminaFile *remmina_file_new(void);
+/* Create a RemminaFile without any setting, not even the default ones */
+RemminaFile *remmina_file_new_empty(void);
 RemminaFile *remmina_file_copy(const gchar *filename);
 void remmina_file_generate_filename(RemminaFile *remminafile);
 void remmina_file_set_filename(RemminaFile *remminafile, const gchar *filename);
@@ -70,6 +72,12 @@ const gchar *remmina_file_get_string(RemminaFile *remminafile, const gchar *sett
 gchar *remmina_file_get_secret(RemminaFile *remminafile, const gchar *setting);
 void remmina_file_set_int(RemminaFile *remminafile, const gchar *setting, gint value);
 gint remmina_file_get_int(RemminaFile *remminafile, const gchar *setting, gint default_value);
+/* Frozen copy of the settings, which can be read from any thread */
+RemminaFileSnapshot *remmina_file_snapshot_new(RemminaFile *remminafile);
+RemminaFileSnapshot *remmina_file_snapshot_ref(RemminaFileSnapshot *snapshot);
+void remmina_file_snapshot_unref(RemminaFileSnapshot *snapshot);
+const gchar *remmina_file_snapshot_get_string(RemminaFileSnapshot *snapshot, const gchar *setting);
+gint remmina_file_snapshot_get_int(RemminaFileSnapshot *snapshot, const gchar *setting, gint default_value);
 void remmina_file_store_secret_plugin_password(RemminaFile *remminafile, const gchar *key, const gchar *value);
 /* Create or overwrite the .remmina file */
 void remmina_file_save(RemminaFile *remminafile);
@@ -49,41 +49,127 @@
 static gchar *remminadir;
 static gchar *cachedir;
 
-/* return first found data dir as per XDG specs.
- * The returned string must be freed by the caller with g_free */
-gchar *remmina_file_get_datadir(void)
+/* Data directory resolved by remmina_file_get_datadir() and the
+ * datadir_path preference it has been resolved from */
+static gchar *remmina_file_datadir = NULL;
+static gchar *remmina_file_datadir_pref = NULL;
+static GHookList *remmina_file_datadir_hooks = NULL;
+G_LOCK_DEFINE_STATIC(remmina_file_datadir);
+
+/* return first found data dir as per XDG specs */
+static gchar *remmina_file_manager_resolve_datadir(const gchar *datadir_path)
 {
 	TRACE_CALL(__func__);
 	const gchar *dir = ".remmina";
+	gchar *datadir;
 	int i;
 	/* From preferences, datadir_path */
-	remminadir = remmina_pref_get_value("datadir_path");
-	if (remminadir != NULL && strlen(remminadir) > 0)
-		if (g_file_test(remminadir, G_FILE_TEST_IS_DIR))
-			return remminadir;
-	g_free(remminadir), remminadir = NULL;
+	if (datadir_path != NULL && strlen(datadir_path) > 0)
+		if (g_file_test(datadir_path, G_FILE_TEST_IS_DIR))
+			return g_strdup(datadir_path);
 	/* Legacy ~/.remmina */
-	remminadir = g_build_path("/", g_get_home_dir(), dir, NULL);
-	if (g_file_test(remminadir, G_FILE_TEST_IS_DIR))
-		return remminadir;
-	g_free(remminadir), remminadir = NULL;
+	datadir = g_build_path("/", g_get_home_dir(), dir, NULL);
+	if (g_file_test(datadir, G_FILE_TEST_IS_DIR))
+		return datadir;
+	g_free(datadir);
 	/* ~/.local/share/remmina */
-	remminadir = g_build_path("/", g_get_user_data_dir(), "remmina", NULL);
-	if (g_file_test(remminadir, G_FILE_TEST_IS_DIR))
-		return remminadir;
-	g_free(remminadir), remminadir = NULL;
+	datadir = g_build_path("/", g_get_user_data_dir(), "remmina", NULL);
+	if (g_file_test(datadir, G_FILE_TEST_IS_DIR))
+		return datadir;
+	g_free(datadir);
 	/* /usr/local/share/remmina */
 	const gchar *const *dirs = g_get_system_data_dirs();
-	g_free(remminadir), remminadir = NULL;
 	for (i = 0; dirs[i] != NULL; ++i) {
-		remminadir = g_build_path("/", dirs[i], "remmina", NULL);
-		if (g_file_test(remminadir, G_FILE_TEST_IS_DIR))
-			return remminadir;
-		g_free(remminadir), remminadir = NULL;
+		datadir = g_build_path("/", dirs[i], "remmina", NULL);
+		if (g_file_test(datadir, G_FILE_TEST_IS_DIR))
+			return datadir;
+		g_free(datadir);
 	}
 	/* The last case we use  the home ~/.local/share/remmina */
-	remminadir = g_build_path("/", g_get_user_data_dir(), "remmina", NULL);
-	return remminadir;
+	return g_build_path("/", g_get_user_data_dir(), "remmina", NULL);
+}
+
+static gboolean remmina_file_manager_datadir_changed(gpointer data)
+{
+	TRACE_CALL(__func__);
+	gchar *datadir = (gchar *)data;
+	GHook *hook;
+
+	if (remmina_file_datadir_hooks) {
+		hook = g_hook_first_valid(remmina_file_datadir_hooks, FALSE);
+		while (hook) {
+			((RemminaDataDirNotify)hook->func)(datadir, hook->data);
+			hook = g_hook_next_valid(remmina_file_datadir_hooks, hook, FALSE);
+		}
+	}
+	g_free(datadir);
+	return FALSE;
+}
+
+/* return the data dir, resolved again only when the datadir_path preference
+ * changed or after remmina_file_manager_invalidate_datadir().
+ * The returned string must be freed by the caller with g_free */
+gchar *remmina_file_get_datadir(void)
+{
+	TRACE_CALL(__func__);
+	const gchar *datadir_path;
+	gchar *datadir;
+	gboolean changed = FALSE;
+
+	G_LOCK(remmina_file_datadir);
+	datadir_path = remmina_pref.datadir_path ? remmina_pref.datadir_path : "";
+	if (remmina_file_datadir == NULL || g_strcmp0(datadir_path, remmina_file_datadir_pref) != 0) {
+		datadir = remmina_file_manager_resolve_datadir(datadir_path);
+		if (remmina_file_datadir != NULL && g_strcmp0(datadir, remmina_file_datadir) != 0)
+			changed = TRUE;
+		g_free(remmina_file_datadir);
+		g_free(remmina_file_datadir_pref);
+		remmina_file_datadir = datadir;
+		remmina_file_datadir_pref = g_strdup(datadir_path);
+	}
+	datadir = g_strdup(remmina_file_datadir);
+	G_UNLOCK(remmina_file_datadir);
+
+	/* Listeners are always notified from the main loop */
+	if (changed)
+		IDLE_ADD(remmina_file_manager_datadir_changed, g_strdup(datadir));
+
+	return datadir;
+}
+
+/* Forget the resolved data dir, i.e. when a directory has been created or removed */
+void remmina_file_manager_invalidate_datadir(void)
+{
+	TRACE_CALL(__func__);
+	G_LOCK(remmina_file_datadir);
+	g_free(remmina_file_datadir_pref);
+	remmina_file_datadir_pref = NULL;
+	G_UNLOCK(remmina_file_datadir);
+}
+
+/* Call func from the main loop each time the resolved data dir changes.
+ * Returns an id for remmina_file_manager_remove_datadir_notify() */
+gulong remmina_file_manager_add_datadir_notify(RemminaDataDirNotify func, gpointer user_data)
+{
+	TRACE_CALL(__func__);
+	GHook *hook;
+
+	if (!remmina_file_datadir_hooks) {
+		remmina_file_datadir_hooks = g_new(GHookList, 1);
+		g_hook_list_init(remmina_file_datadir_hooks, sizeof(GHook));
+	}
+	hook = g_hook_alloc(remmina_file_datadir_hooks);
+	hook->func = func;
+	hook->data = user_data;
+	g_hook_append(remmina_file_datadir_hooks, hook);
+	return hook->hook_id;
+}
+
+void remmina_file_manager_remove_datadir_notify(gulong id)
+{
+	TRACE_CALL(__func__);
+	if (remmina_file_datadir_hooks)
+		g_hook_destroy(remmina_file_datadir_hooks, id);
 }
 
 /** @todo remmina_pref_file_do_copy and remmina_file_manager_do_copy to remmina_files_copy */
@@ -146,6 +232,8 @@ void remmina_file_manager_init(void)
 	/* At last we make sure we use XDG_USER_DATA */
 	if (remminadir != NULL)
 		g_free(remminadir), remminadir = NULL;
+	/* Directories may have been created */
+	remmina_file_manager_invalidate_datadir();
 }
 
 gint remmina_file_manager_iterate(GFunc func, gpointer user_data)
@@ -282,17 +370,21 @@ GNode *remmina_file_manager_get_group_tree(void)
 	RemminaFile *remminafile;
 	const gchar *group;
 	GNode *root;
+	gchar *remmina_data_dir;
 
 	root = g_node_new(NULL);
 
-	dir = g_dir_open(remmina_file_get_datadir(), 0, NULL);
+	remmina_data_dir = remmina_file_get_datadir();
+	dir = g_dir_open(remmina_data_dir, 0, NULL);
 
-	if (dir == NULL)
+	if (dir == NULL) {
+		g_free(remmina_data_dir);
 		return root;
+	}
 	while ((name = g_dir_read_name(dir)) != NULL) {
 		if (!g_str_has_suffix(name, ".remmina"))
 			continue;
-		g_snprintf(filename, MAX_PATH_LEN, "%s/%s", remmina_file_get_datadir(), name);
+		g_snprintf(filename, MAX_PATH_LEN, "%s/%s", remmina_data_dir, name);
 		remminafile = remmina_file_load(filename);
 		if (remminafile) {
 			group = remmina_file_get_string(remminafile, "group");
@@ -301,6 +393,7 @@ GNode *remmina_file_manager_get_group_tree(void)
 		}
 	}
 	g_dir_close(dir);
+	g_free(remmina_data_dir);
 	return root;
 }
 
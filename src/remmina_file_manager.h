@@ -45,8 +45,13 @@ typedef struct _RemminaGroupData {
 	gchar * datetime;
 } RemminaGroupData;
 
+typedef void (*RemminaDataDirNotify)(const gchar *datadir, gpointer user_data);
+
 /* Initialize */
 gchar *remmina_file_get_datadir(void);
+void remmina_file_manager_invalidate_datadir(void);
+gulong remmina_file_manager_add_datadir_notify(RemminaDataDirNotify func, gpointer user_data);
+void remmina_file_manager_remove_datadir_notify(gulong id);
 void remmina_file_manager_init(void);
 /* Iterate all .remmina connections in the home directory */
 gint remmina_file_manager_iterate(GFunc func, gpointer user_data);
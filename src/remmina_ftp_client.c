@@ -137,8 +137,6 @@ struct _RemminaFTPClientPriv {
 	GtkWidget *vpaned;
 
 	GtkTreeModel *file_list_model;
-	GtkTreeModel *file_list_filter;
-	GtkTreeModel *file_list_sort;
 	GtkWidget *file_list_view;
 	gboolean file_list_show_hidden;
 
@@ -183,6 +181,7 @@ static void remmina_ftp_client_destroy(RemminaFTPClient *client, gpointer data)
 {
 	TRACE_CALL(__func__);
 	RemminaFTPClientPriv *priv = (RemminaFTPClientPriv*)client->priv;
+	g_object_unref(priv->file_list_model);
 	g_free(priv->current_directory);
 	g_free(priv->working_directory);
 	g_free(priv);
@@ -410,7 +409,7 @@ static void remmina_ftp_client_download(RemminaFTPClient *client, GtkTreeIter *p
 	gchar *name;
 	gfloat size;
 
-	gtk_tree_model_get(priv->file_list_sort, piter, REMMINA_FTP_FILE_COLUMN_TYPE, &type, REMMINA_FTP_FILE_COLUMN_NAME,
+	gtk_tree_model_get(priv->file_list_model, piter, REMMINA_FTP_FILE_COLUMN_TYPE, &type, REMMINA_FTP_FILE_COLUMN_NAME,
 		&name, REMMINA_FTP_FILE_COLUMN_SIZE, &size, -1);
 
 	gtk_list_store_append(store, &iter);
@@ -495,7 +494,7 @@ static void remmina_ftp_client_action_download(GObject *object, RemminaFTPClient
 
 	list_iter = g_list_first(list);
 	while (list_iter) {
-		gtk_tree_model_get_iter(priv->file_list_sort, &iter, (GtkTreePath*)list_iter->data);
+		gtk_tree_model_get_iter(priv->file_list_model, &iter, (GtkTreePath*)list_iter->data);
 		remmina_ftp_client_download(client, &iter, localdir);
 		list_iter = g_list_next(list_iter);
 	}
@@ -535,9 +534,9 @@ static void remmina_ftp_client_action_delete(GObject *object, RemminaFTPClient *
 
 		list_iter = g_list_first(list);
 	while (list_iter) {
-		gtk_tree_model_get_iter(priv->file_list_sort, &iter, (GtkTreePath*)list_iter->data);
+		gtk_tree_model_get_iter(priv->file_list_model, &iter, (GtkTreePath*)list_iter->data);
 
-		gtk_tree_model_get(priv->file_list_sort, &iter, REMMINA_FTP_FILE_COLUMN_TYPE, &type,
+		gtk_tree_model_get(priv->file_list_model, &iter, REMMINA_FTP_FILE_COLUMN_TYPE, &type,
 			REMMINA_FTP_FILE_COLUMN_NAME, &name, -1);
 
 		path = remmina_public_combine_path(priv->current_directory, name);
@@ -687,8 +686,8 @@ static gboolean remmina_ftp_client_file_list_on_button_press(GtkWidget *widget,
 		list = gtk_tree_selection_get_selected_rows(
 			gtk_tree_view_get_selection(GTK_TREE_VIEW(priv->file_list_view)), NULL);
 		if (list) {
-			gtk_tree_model_get_iter(priv->file_list_sort, &iter, (GtkTreePath*)list->data);
-			gtk_tree_model_get(priv->file_list_sort, &iter, REMMINA_FTP_FILE_COLUMN_TYPE, &type,
+			gtk_tree_model_get_iter(priv->file_list_model, &iter, (GtkTreePath*)list->data);
+			gtk_tree_model_get(priv->file_list_model, &iter, REMMINA_FTP_FILE_COLUMN_TYPE, &type,
 				REMMINA_FTP_FILE_COLUMN_NAME, &name, -1);
 			switch (type) {
 			case REMMINA_FTP_FILE_TYPE_DIR:
@@ -802,25 +801,14 @@ static GtkWidget* remmina_ftp_client_create_toolbar(RemminaFTPClient *client)
 void remmina_ftp_client_set_show_hidden(RemminaFTPClient *client, gboolean show_hidden)
 {
 	TRACE_CALL(__func__);
-	client->priv->file_list_show_hidden = show_hidden;
-	gtk_tree_model_filter_refilter(GTK_TREE_MODEL_FILTER(client->priv->file_list_filter));
-}
-
-static gboolean remmina_ftp_client_filter_visible_func(GtkTreeModel *model, GtkTreeIter *iter, RemminaFTPClient *client)
-{
-	TRACE_CALL(__func__);
-	gchar *name;
-	gboolean result = TRUE;
-
-	if (client->priv->file_list_show_hidden)
-		return TRUE;
+	RemminaFTPClientPriv *priv = (RemminaFTPClientPriv*)client->priv;
 
-	gtk_tree_model_get(model, iter, REMMINA_FTP_FILE_COLUMN_NAME, &name, -1);
-	if (name && name[0] == '.') {
-		result = FALSE;
-	}
-	g_free(name);
-	return result;
+	priv->file_list_show_hidden = show_hidden;
+	/* Detach the model while rows come and go, the view would otherwise
+	 * process each inserted and deleted row on its own */
+	gtk_tree_view_set_model(GTK_TREE_VIEW(priv->file_list_view), NULL);
+	remmina_ftp_file_list_set_show_hidden(REMMINA_FTP_FILE_LIST(priv->file_list_model), show_hidden);
+	gtk_tree_view_set_model(GTK_TREE_VIEW(priv->file_list_view), priv->file_list_model);
 }
 
 /* Set the overwrite_all status */
@@ -837,6 +825,16 @@ gboolean remmina_ftp_client_get_overwrite_status(RemminaFTPClient *client)
 	return client->priv->overwrite_all;
 }
 
+static void remmina_ftp_client_file_list_append_column(RemminaFTPClientPriv *priv, GtkTreeViewColumn *column)
+{
+	TRACE_CALL(__func__);
+	/* Required by the fixed height mode of the file list */
+	gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+	if (!gtk_tree_view_column_get_expand(column))
+		gtk_tree_view_column_set_fixed_width(column, 100);
+	gtk_tree_view_append_column(GTK_TREE_VIEW(priv->file_list_view), column);
+}
+
 static void remmina_ftp_client_init(RemminaFTPClient *client)
 {
 	TRACE_CALL(__func__);
@@ -895,6 +893,9 @@ static void remmina_ftp_client_init(RemminaFTPClient *client)
 	gtk_container_add(GTK_CONTAINER(scrolledwindow), widget);
 
 	gtk_tree_selection_set_mode(gtk_tree_view_get_selection(GTK_TREE_VIEW(widget)), GTK_SELECTION_MULTIPLE);
+	/* All rows have the same height, so the view only has to measure
+	 * the rows which are actually visible, even with huge directories */
+	gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(widget), TRUE);
 
 	priv->file_list_view = widget;
 
@@ -910,7 +911,7 @@ static void remmina_ftp_client_init(RemminaFTPClient *client)
 	renderer = gtk_cell_renderer_text_new();
 	gtk_tree_view_column_pack_start(column, renderer, FALSE);
 	gtk_tree_view_column_add_attribute(column, renderer, "text", REMMINA_FTP_FILE_COLUMN_NAME);
-	gtk_tree_view_append_column(GTK_TREE_VIEW(priv->file_list_view), column);
+	remmina_ftp_client_file_list_append_column(priv, column);
 
 	renderer = gtk_cell_renderer_text_new();
 	column = gtk_tree_view_column_new_with_attributes(_("Size"), renderer, NULL);
@@ -918,19 +919,19 @@ static void remmina_ftp_client_init(RemminaFTPClient *client)
 	gtk_tree_view_column_set_resizable(column, TRUE);
 	gtk_tree_view_column_set_cell_data_func(column, renderer, remmina_ftp_client_cell_data_size, NULL, NULL);
 	gtk_tree_view_column_set_sort_column_id(column, REMMINA_FTP_FILE_COLUMN_SIZE);
-	gtk_tree_view_append_column(GTK_TREE_VIEW(priv->file_list_view), column);
+	remmina_ftp_client_file_list_append_column(priv, column);
 
 	renderer = gtk_cell_renderer_text_new();
 	column = gtk_tree_view_column_new_with_attributes(_("User"), renderer, "text", REMMINA_FTP_FILE_COLUMN_USER, NULL);
 	gtk_tree_view_column_set_resizable(column, TRUE);
 	gtk_tree_view_column_set_sort_column_id(column, REMMINA_FTP_FILE_COLUMN_USER);
-	gtk_tree_view_append_column(GTK_TREE_VIEW(priv->file_list_view), column);
+	remmina_ftp_client_file_list_append_column(priv, column);
 
 	renderer = gtk_cell_renderer_text_new();
 	column = gtk_tree_view_column_new_with_attributes(_("Group"), renderer, "text", REMMINA_FTP_FILE_COLUMN_GROUP, NULL);
 	gtk_tree_view_column_set_resizable(column, TRUE);
 	gtk_tree_view_column_set_sort_column_id(column, REMMINA_FTP_FILE_COLUMN_GROUP);
-	gtk_tree_view_append_column(GTK_TREE_VIEW(priv->file_list_view), column);
+	remmina_ftp_client_file_list_append_column(priv, column);
 
 	renderer = gtk_cell_renderer_text_new();
 	column = gtk_tree_view_column_new_with_attributes(_("Permission"), renderer, "text", REMMINA_FTP_FILE_COLUMN_PERMISSION,
@@ -938,21 +939,13 @@ static void remmina_ftp_client_init(RemminaFTPClient *client)
 	gtk_tree_view_column_set_resizable(column, TRUE);
 	gtk_tree_view_column_set_cell_data_func(column, renderer, remmina_ftp_client_cell_data_permission, NULL, NULL);
 	gtk_tree_view_column_set_sort_column_id(column, REMMINA_FTP_FILE_COLUMN_PERMISSION);
-	gtk_tree_view_append_column(GTK_TREE_VIEW(priv->file_list_view), column);
+	remmina_ftp_client_file_list_append_column(priv, column);
 
 	/* Remote File List - Model */
-	priv->file_list_model = GTK_TREE_MODEL(
-		gtk_list_store_new(REMMINA_FTP_FILE_N_COLUMNS, G_TYPE_INT, G_TYPE_STRING, G_TYPE_FLOAT, G_TYPE_STRING,
-			G_TYPE_STRING, G_TYPE_INT, G_TYPE_STRING));
-
-	priv->file_list_filter = gtk_tree_model_filter_new(priv->file_list_model, NULL);
-	gtk_tree_model_filter_set_visible_func(GTK_TREE_MODEL_FILTER(priv->file_list_filter),
-		(GtkTreeModelFilterVisibleFunc)remmina_ftp_client_filter_visible_func, client, NULL);
-
-	priv->file_list_sort = gtk_tree_model_sort_new_with_model(priv->file_list_filter);
-	gtk_tree_sortable_set_sort_column_id(GTK_TREE_SORTABLE(priv->file_list_sort), REMMINA_FTP_FILE_COLUMN_NAME_SORT,
+	priv->file_list_model = remmina_ftp_file_list_new();
+	gtk_tree_sortable_set_sort_column_id(GTK_TREE_SORTABLE(priv->file_list_model), REMMINA_FTP_FILE_COLUMN_NAME_SORT,
 		GTK_SORT_ASCENDING);
-	gtk_tree_view_set_model(GTK_TREE_VIEW(priv->file_list_view), priv->file_list_sort);
+	gtk_tree_view_set_model(GTK_TREE_VIEW(priv->file_list_view), priv->file_list_model);
 
 	/* Task List */
 	scrolledwindow = gtk_scrolled_window_new(NULL, NULL);
@@ -1079,35 +1072,26 @@ void remmina_ftp_client_clear_file_list(RemminaFTPClient *client)
 	TRACE_CALL(__func__);
 	RemminaFTPClientPriv *priv = (RemminaFTPClientPriv*)client->priv;
 
-	gtk_list_store_clear(GTK_LIST_STORE(priv->file_list_model));
+	gtk_tree_view_set_model(GTK_TREE_VIEW(priv->file_list_view), NULL);
+	remmina_ftp_file_list_clear(REMMINA_FTP_FILE_LIST(priv->file_list_model));
+	gtk_tree_view_set_model(GTK_TREE_VIEW(priv->file_list_view), priv->file_list_model);
 	remmina_ftp_client_set_file_action_sensitive(client, FALSE);
 }
 
-void remmina_ftp_client_add_file(RemminaFTPClient *client, ...)
+void remmina_ftp_client_add_files(RemminaFTPClient *client, RemminaFTPFileBatch *batch)
 {
 	TRACE_CALL(__func__);
 	RemminaFTPClientPriv *priv = (RemminaFTPClientPriv*)client->priv;
-	GtkListStore *store = GTK_LIST_STORE(priv->file_list_model);
-	GtkTreeIter iter;
-	va_list args;
-	gint type;
-	gchar *name;
-	gchar *ptr;
 
-	va_start(args, client);
-	gtk_list_store_append(store, &iter);
-	gtk_list_store_set_valist(store, &iter, args);
-	va_end(args);
+	remmina_ftp_file_list_append(REMMINA_FTP_FILE_LIST(priv->file_list_model), batch);
+}
 
-	gtk_tree_model_get(GTK_TREE_MODEL(store), &iter,
-		REMMINA_FTP_FILE_COLUMN_TYPE, &type,
-		REMMINA_FTP_FILE_COLUMN_NAME, &name,
-		-1);
+void remmina_ftp_client_sort_file_list(RemminaFTPClient *client)
+{
+	TRACE_CALL(__func__);
+	RemminaFTPClientPriv *priv = (RemminaFTPClientPriv*)client->priv;
 
-	ptr = g_strdup_printf("%i%s", type, name);
-	gtk_list_store_set(store, &iter, REMMINA_FTP_FILE_COLUMN_NAME_SORT, ptr, -1);
-	g_free(ptr);
-	g_free(name);
+	remmina_ftp_file_list_sort(REMMINA_FTP_FILE_LIST(priv->file_list_model));
 }
 
 void remmina_ftp_client_set_dir(RemminaFTPClient *client, const gchar *dir)
@@ -36,6 +36,8 @@
 
 #pragma once
 
+#include "remmina_ftp_file_list.h"
+
 G_BEGIN_DECLS
 
 #define REMMINA_TYPE_FTP_CLIENT               (remmina_ftp_client_get_type())
@@ -129,8 +131,10 @@ void remmina_ftp_client_load_state(RemminaFTPClient *client, RemminaFile *remmin
 
 void remmina_ftp_client_set_show_hidden(RemminaFTPClient *client, gboolean show_hidden);
 void remmina_ftp_client_clear_file_list(RemminaFTPClient *client);
-/* column, value, …, -1 */
-void remmina_ftp_client_add_file(RemminaFTPClient *client, ...);
+/* Append a whole batch of files at once. New rows are appended unsorted,
+ * call remmina_ftp_client_sort_file_list() once the listing is complete */
+void remmina_ftp_client_add_files(RemminaFTPClient *client, RemminaFTPFileBatch *batch);
+void remmina_ftp_client_sort_file_list(RemminaFTPClient *client);
 /* Set the current directory. Should be called by opendir signal handler */
 void remmina_ftp_client_set_dir(RemminaFTPClient *client, const gchar *dir);
 /* Get the current directory as newly allocated string */
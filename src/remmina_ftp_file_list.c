@@ -0,0 +1,580 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2016-2019 Antenore Gatta, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+
+#include <gtk/gtk.h>
+#include <string.h>
+#include "config.h"
+#include "remmina_file.h"
+#include "remmina_ftp_client.h"
+#include "remmina_ftp_file_list.h"
+#include "remmina/remmina_trace_calls.h"
+
+struct _RemminaFTPFileList {
+	GObject parent;
+
+	gint stamp;
+
+	/* All entries of the directory, in arrival order */
+	GArray *entries;
+	GStringChunk *strings;
+	/* Indexes into entries of the visible rows, in display order */
+	GArray *rows;
+
+	gboolean show_hidden;
+	gboolean sorted;
+	gint sort_column_id;
+	GtkSortType sort_order;
+};
+
+static void remmina_ftp_file_list_tree_model_init(GtkTreeModelIface *iface);
+static void remmina_ftp_file_list_tree_sortable_init(GtkTreeSortableIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(RemminaFTPFileList, remmina_ftp_file_list, G_TYPE_OBJECT,
+			G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL, remmina_ftp_file_list_tree_model_init)
+			G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_SORTABLE, remmina_ftp_file_list_tree_sortable_init))
+
+#define ENTRY_AT_ROW(list, row) \
+	(&g_array_index((list)->entries, RemminaFTPFileEntry, g_array_index((list)->rows, guint, (row))))
+
+#define ENTRY_IS_VISIBLE(list, entry) \
+	((list)->show_hidden || (entry)->name[0] != '.')
+
+/* ------------------------------ Batches -------------------------------- */
+
+RemminaFTPFileBatch *
+remmina_ftp_file_batch_new(void)
+{
+	TRACE_CALL(__func__);
+	RemminaFTPFileBatch *batch;
+
+	batch = g_new(RemminaFTPFileBatch, 1);
+	batch->entries = g_array_new(FALSE, FALSE, sizeof(RemminaFTPFileEntry));
+	batch->strings = g_string_chunk_new(4096);
+	return batch;
+}
+
+void
+remmina_ftp_file_batch_add(RemminaFTPFileBatch *batch, gint type, const gchar *name, gfloat size,
+			   const gchar *user, const gchar *group, gint permission)
+{
+	TRACE_CALL(__func__);
+	RemminaFTPFileEntry entry;
+
+	entry.type = type;
+	entry.name = g_string_chunk_insert(batch->strings, name ? name : "");
+	entry.size = size;
+	entry.user = user ? g_string_chunk_insert_const(batch->strings, user) : NULL;
+	entry.group = group ? g_string_chunk_insert_const(batch->strings, group) : NULL;
+	entry.permission = permission;
+	g_array_append_val(batch->entries, entry);
+}
+
+void
+remmina_ftp_file_batch_free(RemminaFTPFileBatch *batch)
+{
+	TRACE_CALL(__func__);
+	if (!batch)
+		return;
+	g_array_free(batch->entries, TRUE);
+	g_string_chunk_free(batch->strings);
+	g_free(batch);
+}
+
+/* ------------------------------ Sorting -------------------------------- */
+
+typedef struct _RemminaFTPFileListSortData {
+	RemminaFTPFileList *list;
+	/* Collate keys by entry index, only when sorting by name */
+	gchar **keys;
+} RemminaFTPFileListSortData;
+
+static gint
+remmina_ftp_file_list_compare(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+	RemminaFTPFileListSortData *data = (RemminaFTPFileListSortData *)user_data;
+	RemminaFTPFileList *list = data->list;
+	guint ia = *(const guint *)a;
+	guint ib = *(const guint *)b;
+	RemminaFTPFileEntry *ea = &g_array_index(list->entries, RemminaFTPFileEntry, ia);
+	RemminaFTPFileEntry *eb = &g_array_index(list->entries, RemminaFTPFileEntry, ib);
+	gint ret = 0;
+
+	switch (list->sort_column_id) {
+	case REMMINA_FTP_FILE_COLUMN_NAME_SORT:
+		ret = ea->type - eb->type;
+		if (ret == 0)
+			ret = strcmp(data->keys[ia], data->keys[ib]);
+		break;
+	case REMMINA_FTP_FILE_COLUMN_NAME:
+		ret = strcmp(data->keys[ia], data->keys[ib]);
+		break;
+	case REMMINA_FTP_FILE_COLUMN_TYPE:
+		ret = ea->type - eb->type;
+		break;
+	case REMMINA_FTP_FILE_COLUMN_SIZE:
+		ret = (ea->size > eb->size) - (ea->size < eb->size);
+		break;
+	case REMMINA_FTP_FILE_COLUMN_USER:
+		ret = g_strcmp0(ea->user, eb->user);
+		break;
+	case REMMINA_FTP_FILE_COLUMN_GROUP:
+		ret = g_strcmp0(ea->group, eb->group);
+		break;
+	case REMMINA_FTP_FILE_COLUMN_PERMISSION:
+		ret = ea->permission - eb->permission;
+		break;
+	}
+
+	if (list->sort_order == GTK_SORT_DESCENDING)
+		ret = -ret;
+	/* Keep the sort stable */
+	if (ret == 0)
+		ret = (ia > ib) - (ia < ib);
+	return ret;
+}
+
+void
+remmina_ftp_file_list_sort(RemminaFTPFileList *list)
+{
+	TRACE_CALL(__func__);
+	RemminaFTPFileListSortData data;
+	GtkTreePath *path;
+	guint *position;
+	gint *new_order;
+	guint i;
+
+	if (list->sorted)
+		return;
+	list->sorted = TRUE;
+	if (list->rows->len < 2 || list->sort_column_id < 0)
+		return;
+
+	data.list = list;
+	data.keys = NULL;
+	if (list->sort_column_id == REMMINA_FTP_FILE_COLUMN_NAME_SORT ||
+	    list->sort_column_id == REMMINA_FTP_FILE_COLUMN_NAME) {
+		/* Compute the collate keys once instead of collating at each comparison */
+		data.keys = g_new0(gchar *, list->entries->len);
+		for (i = 0; i < list->rows->len; i++) {
+			guint idx = g_array_index(list->rows, guint, i);
+			data.keys[idx] = g_utf8_collate_key_for_filename(ENTRY_AT_ROW(list, i)->name, -1);
+		}
+	}
+
+	/* Remember where each entry was, to build the new_order array */
+	position = g_new(guint, list->entries->len);
+	for (i = 0; i < list->rows->len; i++)
+		position[g_array_index(list->rows, guint, i)] = i;
+
+	g_qsort_with_data(list->rows->data, list->rows->len, sizeof(guint), remmina_ftp_file_list_compare, &data);
+
+	new_order = g_new(gint, list->rows->len);
+	for (i = 0; i < list->rows->len; i++)
+		new_order[i] = position[g_array_index(list->rows, guint, i)];
+
+	list->stamp++;
+	path = gtk_tree_path_new();
+	gtk_tree_model_rows_reordered(GTK_TREE_MODEL(list), path, NULL, new_order);
+	gtk_tree_path_free(path);
+
+	g_free(new_order);
+	g_free(position);
+	if (data.keys) {
+		for (i = 0; i < list->entries->len; i++)
+			g_free(data.keys[i]);
+		g_free(data.keys);
+	}
+}
+
+/* ------------------------------ Rows ----------------------------------- */
+
+static void
+remmina_ftp_file_list_delete_rows(RemminaFTPFileList *list)
+{
+	TRACE_CALL(__func__);
+	GtkTreePath *path;
+	gint i;
+
+	/* Delete from the end, so the paths of the remaining rows do not change */
+	path = gtk_tree_path_new_from_indices(list->rows->len, -1);
+	for (i = list->rows->len - 1; i >= 0; i--) {
+		gtk_tree_path_prev(path);
+		g_array_set_size(list->rows, i);
+		gtk_tree_model_row_deleted(GTK_TREE_MODEL(list), path);
+	}
+	gtk_tree_path_free(path);
+}
+
+static void
+remmina_ftp_file_list_insert_row(RemminaFTPFileList *list, guint idx)
+{
+	TRACE_CALL(__func__);
+	GtkTreePath *path;
+	GtkTreeIter iter;
+
+	g_array_append_val(list->rows, idx);
+	iter.stamp = list->stamp;
+	iter.user_data = GUINT_TO_POINTER(list->rows->len - 1);
+	path = gtk_tree_path_new_from_indices(list->rows->len - 1, -1);
+	gtk_tree_model_row_inserted(GTK_TREE_MODEL(list), path, &iter);
+	gtk_tree_path_free(path);
+}
+
+void
+remmina_ftp_file_list_clear(RemminaFTPFileList *list)
+{
+	TRACE_CALL(__func__);
+	remmina_ftp_file_list_delete_rows(list);
+	g_array_set_size(list->entries, 0);
+	g_string_chunk_clear(list->strings);
+	list->sorted = TRUE;
+	list->stamp++;
+}
+
+void
+remmina_ftp_file_list_append(RemminaFTPFileList *list, RemminaFTPFileBatch *batch)
+{
+	TRACE_CALL(__func__);
+	RemminaFTPFileEntry *src;
+	RemminaFTPFileEntry entry;
+	guint i;
+
+	for (i = 0; i < batch->entries->len; i++) {
+		src = &g_array_index(batch->entries, RemminaFTPFileEntry, i);
+		entry.type = src->type;
+		entry.name = g_string_chunk_insert(list->strings, src->name);
+		entry.size = src->size;
+		/* Owners and groups repeat a lot, store each of them only once */
+		entry.user = src->user ? g_string_chunk_insert_const(list->strings, src->user) : NULL;
+		entry.group = src->group ? g_string_chunk_insert_const(list->strings, src->group) : NULL;
+		entry.permission = src->permission;
+		g_array_append_val(list->entries, entry);
+
+		if (ENTRY_IS_VISIBLE(list, &entry)) {
+			remmina_ftp_file_list_insert_row(list, list->entries->len - 1);
+			list->sorted = FALSE;
+		}
+	}
+}
+
+void
+remmina_ftp_file_list_set_show_hidden(RemminaFTPFileList *list, gboolean show_hidden)
+{
+	TRACE_CALL(__func__);
+	guint i;
+
+	if (list->show_hidden == show_hidden)
+		return;
+
+	remmina_ftp_file_list_delete_rows(list);
+	list->show_hidden = show_hidden;
+	list->stamp++;
+	for (i = 0; i < list->entries->len; i++) {
+		if (ENTRY_IS_VISIBLE(list, &g_array_index(list->entries, RemminaFTPFileEntry, i)))
+			remmina_ftp_file_list_insert_row(list, i);
+	}
+	list->sorted = FALSE;
+	remmina_ftp_file_list_sort(list);
+}
+
+/* --------------------------- GtkTreeModel ------------------------------ */
+
+static GtkTreeModelFlags
+remmina_ftp_file_list_get_flags(GtkTreeModel *model)
+{
+	return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint
+remmina_ftp_file_list_get_n_columns(GtkTreeModel *model)
+{
+	return REMMINA_FTP_FILE_N_COLUMNS;
+}
+
+static GType
+remmina_ftp_file_list_get_column_type(GtkTreeModel *model, gint column)
+{
+	switch (column) {
+	case REMMINA_FTP_FILE_COLUMN_TYPE:
+	case REMMINA_FTP_FILE_COLUMN_PERMISSION:
+		return G_TYPE_INT;
+	case REMMINA_FTP_FILE_COLUMN_SIZE:
+		return G_TYPE_FLOAT;
+	case REMMINA_FTP_FILE_COLUMN_NAME:
+	case REMMINA_FTP_FILE_COLUMN_USER:
+	case REMMINA_FTP_FILE_COLUMN_GROUP:
+	case REMMINA_FTP_FILE_COLUMN_NAME_SORT:
+		return G_TYPE_STRING;
+	}
+	return G_TYPE_INVALID;
+}
+
+static gboolean
+remmina_ftp_file_list_iter_nth_child(GtkTreeModel *model, GtkTreeIter *iter, GtkTreeIter *parent, gint n)
+{
+	RemminaFTPFileList *list = REMMINA_FTP_FILE_LIST(model);
+
+	if (parent || n < 0 || n >= list->rows->len)
+		return FALSE;
+	iter->stamp = list->stamp;
+	iter->user_data = GINT_TO_POINTER(n);
+	return TRUE;
+}
+
+static gboolean
+remmina_ftp_file_list_get_iter(GtkTreeModel *model, GtkTreeIter *iter, GtkTreePath *path)
+{
+	if (gtk_tree_path_get_depth(path) != 1)
+		return FALSE;
+	return remmina_ftp_file_list_iter_nth_child(model, iter, NULL, gtk_tree_path_get_indices(path)[0]);
+}
+
+static GtkTreePath *
+remmina_ftp_file_list_get_path(GtkTreeModel *model, GtkTreeIter *iter)
+{
+	g_return_val_if_fail(iter->stamp == REMMINA_FTP_FILE_LIST(model)->stamp, NULL);
+	return gtk_tree_path_new_from_indices(GPOINTER_TO_INT(iter->user_data), -1);
+}
+
+static void
+remmina_ftp_file_list_get_value(GtkTreeModel *model, GtkTreeIter *iter, gint column, GValue *value)
+{
+	RemminaFTPFileList *list = REMMINA_FTP_FILE_LIST(model);
+	RemminaFTPFileEntry *entry;
+
+	g_return_if_fail(iter->stamp == list->stamp);
+
+	entry = ENTRY_AT_ROW(list, GPOINTER_TO_UINT(iter->user_data));
+	g_value_init(value, remmina_ftp_file_list_get_column_type(model, column));
+	switch (column) {
+	case REMMINA_FTP_FILE_COLUMN_TYPE:
+		g_value_set_int(value, entry->type);
+		break;
+	case REMMINA_FTP_FILE_COLUMN_NAME:
+		g_value_set_static_string(value, entry->name);
+		break;
+	case REMMINA_FTP_FILE_COLUMN_SIZE:
+		g_value_set_float(value, entry->size);
+		break;
+	case REMMINA_FTP_FILE_COLUMN_USER:
+		g_value_set_static_string(value, entry->user);
+		break;
+	case REMMINA_FTP_FILE_COLUMN_GROUP:
+		g_value_set_static_string(value, entry->group);
+		break;
+	case REMMINA_FTP_FILE_COLUMN_PERMISSION:
+		g_value_set_int(value, entry->permission);
+		break;
+	case REMMINA_FTP_FILE_COLUMN_NAME_SORT:
+		g_value_take_string(value, g_strdup_printf("%i%s", entry->type, entry->name));
+		break;
+	}
+}
+
+static gboolean
+remmina_ftp_file_list_iter_next(GtkTreeModel *model, GtkTreeIter *iter)
+{
+	RemminaFTPFileList *list = REMMINA_FTP_FILE_LIST(model);
+	guint n = GPOINTER_TO_UINT(iter->user_data) + 1;
+
+	if (iter->stamp != list->stamp || n >= list->rows->len) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+	iter->user_data = GUINT_TO_POINTER(n);
+	return TRUE;
+}
+
+static gboolean
+remmina_ftp_file_list_iter_previous(GtkTreeModel *model, GtkTreeIter *iter)
+{
+	RemminaFTPFileList *list = REMMINA_FTP_FILE_LIST(model);
+	guint n = GPOINTER_TO_UINT(iter->user_data);
+
+	if (iter->stamp != list->stamp || n == 0) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+	iter->user_data = GUINT_TO_POINTER(n - 1);
+	return TRUE;
+}
+
+static gboolean
+remmina_ftp_file_list_iter_children(GtkTreeModel *model, GtkTreeIter *iter, GtkTreeIter *parent)
+{
+	return remmina_ftp_file_list_iter_nth_child(model, iter, parent, 0);
+}
+
+static gboolean
+remmina_ftp_file_list_iter_has_child(GtkTreeModel *model, GtkTreeIter *iter)
+{
+	return FALSE;
+}
+
+static gint
+remmina_ftp_file_list_iter_n_children(GtkTreeModel *model, GtkTreeIter *iter)
+{
+	return iter ? 0 : REMMINA_FTP_FILE_LIST(model)->rows->len;
+}
+
+static gboolean
+remmina_ftp_file_list_iter_parent(GtkTreeModel *model, GtkTreeIter *iter, GtkTreeIter *child)
+{
+	return FALSE;
+}
+
+static void
+remmina_ftp_file_list_tree_model_init(GtkTreeModelIface *iface)
+{
+	TRACE_CALL(__func__);
+	iface->get_flags = remmina_ftp_file_list_get_flags;
+	iface->get_n_columns = remmina_ftp_file_list_get_n_columns;
+	iface->get_column_type = remmina_ftp_file_list_get_column_type;
+	iface->get_iter = remmina_ftp_file_list_get_iter;
+	iface->get_path = remmina_ftp_file_list_get_path;
+	iface->get_value = remmina_ftp_file_list_get_value;
+	iface->iter_next = remmina_ftp_file_list_iter_next;
+	iface->iter_previous = remmina_ftp_file_list_iter_previous;
+	iface->iter_children = remmina_ftp_file_list_iter_children;
+	iface->iter_has_child = remmina_ftp_file_list_iter_has_child;
+	iface->iter_n_children = remmina_ftp_file_list_iter_n_children;
+	iface->iter_nth_child = remmina_ftp_file_list_iter_nth_child;
+	iface->iter_parent = remmina_ftp_file_list_iter_parent;
+}
+
+/* -------------------------- GtkTreeSortable ---------------------------- */
+
+static gboolean
+remmina_ftp_file_list_get_sort_column_id(GtkTreeSortable *sortable, gint *sort_column_id, GtkSortType *order)
+{
+	RemminaFTPFileList *list = REMMINA_FTP_FILE_LIST(sortable);
+
+	if (sort_column_id)
+		*sort_column_id = list->sort_column_id;
+	if (order)
+		*order = list->sort_order;
+	return list->sort_column_id >= 0;
+}
+
+static void
+remmina_ftp_file_list_set_sort_column_id(GtkTreeSortable *sortable, gint sort_column_id, GtkSortType order)
+{
+	TRACE_CALL(__func__);
+	RemminaFTPFileList *list = REMMINA_FTP_FILE_LIST(sortable);
+
+	if (list->sort_column_id == sort_column_id && list->sort_order == order)
+		return;
+
+	list->sort_column_id = sort_column_id;
+	list->sort_order = order;
+	gtk_tree_sortable_sort_column_changed(sortable);
+
+	list->sorted = FALSE;
+	remmina_ftp_file_list_sort(list);
+}
+
+static void
+remmina_ftp_file_list_set_sort_func(GtkTreeSortable *sortable, gint sort_column_id, GtkTreeIterCompareFunc func,
+				    gpointer data, GDestroyNotify destroy)
+{
+	g_warning("RemminaFTPFileList only sorts by its own columns, custom sort functions are not supported");
+}
+
+static void
+remmina_ftp_file_list_set_default_sort_func(GtkTreeSortable *sortable, GtkTreeIterCompareFunc func,
+					    gpointer data, GDestroyNotify destroy)
+{
+	g_warning("RemminaFTPFileList only sorts by its own columns, custom sort functions are not supported");
+}
+
+static gboolean
+remmina_ftp_file_list_has_default_sort_func(GtkTreeSortable *sortable)
+{
+	return FALSE;
+}
+
+static void
+remmina_ftp_file_list_tree_sortable_init(GtkTreeSortableIface *iface)
+{
+	TRACE_CALL(__func__);
+	iface->get_sort_column_id = remmina_ftp_file_list_get_sort_column_id;
+	iface->set_sort_column_id = remmina_ftp_file_list_set_sort_column_id;
+	iface->set_sort_func = remmina_ftp_file_list_set_sort_func;
+	iface->set_default_sort_func = remmina_ftp_file_list_set_default_sort_func;
+	iface->has_default_sort_func = remmina_ftp_file_list_has_default_sort_func;
+}
+
+/* ------------------------------ Object --------------------------------- */
+
+static void
+remmina_ftp_file_list_finalize(GObject *object)
+{
+	TRACE_CALL(__func__);
+	RemminaFTPFileList *list = REMMINA_FTP_FILE_LIST(object);
+
+	g_array_free(list->rows, TRUE);
+	g_array_free(list->entries, TRUE);
+	g_string_chunk_free(list->strings);
+
+	G_OBJECT_CLASS(remmina_ftp_file_list_parent_class)->finalize(object);
+}
+
+static void
+remmina_ftp_file_list_class_init(RemminaFTPFileListClass *klass)
+{
+	TRACE_CALL(__func__);
+	G_OBJECT_CLASS(klass)->finalize = remmina_ftp_file_list_finalize;
+}
+
+static void
+remmina_ftp_file_list_init(RemminaFTPFileList *list)
+{
+	TRACE_CALL(__func__);
+	list->stamp = g_random_int();
+	list->entries = g_array_new(FALSE, FALSE, sizeof(RemminaFTPFileEntry));
+	list->rows = g_array_new(FALSE, FALSE, sizeof(guint));
+	list->strings = g_string_chunk_new(64 * 1024);
+	list->show_hidden = FALSE;
+	list->sorted = TRUE;
+	list->sort_column_id = GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
+	list->sort_order = GTK_SORT_ASCENDING;
+}
+
+GtkTreeModel *
+remmina_ftp_file_list_new(void)
+{
+	TRACE_CALL(__func__);
+	return GTK_TREE_MODEL(g_object_new(REMMINA_TYPE_FTP_FILE_LIST, NULL));
+}
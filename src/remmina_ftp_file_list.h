@@ -0,0 +1,86 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2016-2019 Antenore Gatta, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+
+#pragma once
+
+G_BEGIN_DECLS
+
+#define REMMINA_TYPE_FTP_FILE_LIST            (remmina_ftp_file_list_get_type())
+#define REMMINA_FTP_FILE_LIST(obj)            (G_TYPE_CHECK_INSTANCE_CAST((obj), REMMINA_TYPE_FTP_FILE_LIST, RemminaFTPFileList))
+#define REMMINA_FTP_FILE_LIST_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST((klass), REMMINA_TYPE_FTP_FILE_LIST, RemminaFTPFileListClass))
+#define REMMINA_IS_FTP_FILE_LIST(obj)         (G_TYPE_CHECK_INSTANCE_TYPE((obj), REMMINA_TYPE_FTP_FILE_LIST))
+
+/* One remote directory entry. Strings are owned by the batch or the list
+ * holding the entry, never by the entry itself. */
+typedef struct _RemminaFTPFileEntry {
+	const gchar *	name;
+	const gchar *	user;
+	const gchar *	group;
+	gfloat		size;
+	gint		permission;
+	gint		type;
+} RemminaFTPFileEntry;
+
+/* A batch of entries produced by a directory reader thread and handed over
+ * to the main thread in one piece */
+typedef struct _RemminaFTPFileBatch {
+	GArray *	entries;
+	GStringChunk *	strings;
+} RemminaFTPFileBatch;
+
+typedef struct _RemminaFTPFileList RemminaFTPFileList;
+typedef struct _RemminaFTPFileListClass {
+	GObjectClass parent_class;
+} RemminaFTPFileListClass;
+
+GType remmina_ftp_file_list_get_type(void)
+G_GNUC_CONST;
+
+RemminaFTPFileBatch *remmina_ftp_file_batch_new(void);
+void remmina_ftp_file_batch_add(RemminaFTPFileBatch *batch, gint type, const gchar *name, gfloat size,
+				const gchar *user, const gchar *group, gint permission);
+void remmina_ftp_file_batch_free(RemminaFTPFileBatch *batch);
+
+/* A list-only GtkTreeModel with the REMMINA_FTP_FILE_COLUMN_* layout, backed by
+ * a flat array of entries. Hidden file filtering and sorting are done
+ * in place, so no GtkTreeModelFilter/GtkTreeModelSort is needed on top. */
+GtkTreeModel *remmina_ftp_file_list_new(void);
+void remmina_ftp_file_list_clear(RemminaFTPFileList *list);
+/* Append the batch at the end of the list; call remmina_ftp_file_list_sort() once the last batch arrived */
+void remmina_ftp_file_list_append(RemminaFTPFileList *list, RemminaFTPFileBatch *batch);
+void remmina_ftp_file_list_sort(RemminaFTPFileList *list);
+void remmina_ftp_file_list_set_show_hidden(RemminaFTPFileList *list, gboolean show_hidden);
+
+G_END_DECLS
@@ -63,6 +63,7 @@ typedef struct _RemminaIcon {
 	GtkStatusIcon *icon;
 #endif
 	RemminaAvahi *avahi;
+	guint avahi_changed_source;
 	guint32 popup_time;
 	gchar *autostart_file;
 	gchar *gsversion;       // GnomeShell version string, or null if not available
@@ -82,6 +83,10 @@ void remmina_icon_destroy(void)
 #endif
 		remmina_icon.icon = NULL;
 	}
+	if (remmina_icon.avahi_changed_source) {
+		g_source_remove(remmina_icon.avahi_changed_source);
+		remmina_icon.avahi_changed_source = 0;
+	}
 	if (remmina_icon.avahi) {
 		remmina_avahi_free(remmina_icon.avahi);
 		remmina_icon.avahi = NULL;
@@ -215,17 +220,14 @@ static void remmina_icon_on_edit_item(RemminaAppletMenu *menu, RemminaAppletMenu
 	}
 }
 
-static void remmina_icon_populate_extra_menu_item(GtkWidget *menu)
+/* Add an item for each service discovered by Avahi */
+static void remmina_icon_populate_discovered_menu_item(GtkWidget *menu)
 {
 	TRACE_CALL(__func__);
 	GtkWidget *menuitem;
-	gboolean new_ontop;
 	GHashTableIter iter;
 	gchar *tmp;
 
-	new_ontop = remmina_pref.applet_new_ontop;
-
-	/* Iterate all discovered services from Avahi */
 	if (remmina_icon.avahi) {
 		g_hash_table_iter_init(&iter, remmina_icon.avahi->discovered_services);
 		while (g_hash_table_iter_next(&iter, NULL, (gpointer*)&tmp)) {
@@ -234,6 +236,17 @@ static void remmina_icon_populate_extra_menu_item(GtkWidget *menu)
 			remmina_applet_menu_add_item(REMMINA_APPLET_MENU(menu), REMMINA_APPLET_MENU_ITEM(menuitem));
 		}
 	}
+}
+
+static void remmina_icon_populate_extra_menu_item(GtkWidget *menu)
+{
+	TRACE_CALL(__func__);
+	GtkWidget *menuitem;
+	gboolean new_ontop;
+
+	new_ontop = remmina_pref.applet_new_ontop;
+
+	remmina_icon_populate_discovered_menu_item(menu);
 
 	/* Separator */
 	menuitem = gtk_separator_menu_item_new();
@@ -271,6 +284,9 @@ remmina_icon_populate_menu(void)
 		menu = remmina_applet_menu_new();
 		app_indicator_set_menu(remmina_icon.icon, GTK_MENU(menu));
 
+		/* The indicator exports the whole menu tree at once over D-Bus,
+		 * groups cannot be filled when they are opened */
+		remmina_applet_menu_set_lazy(REMMINA_APPLET_MENU(menu), FALSE);
 		remmina_applet_menu_set_hide_count(REMMINA_APPLET_MENU(menu), remmina_pref.applet_hide_count);
 		remmina_applet_menu_populate(REMMINA_APPLET_MENU(menu));
 		remmina_icon_populate_extra_menu_item(menu);
@@ -426,6 +442,35 @@ gboolean remmina_icon_is_available(void)
 	return TRUE;
 }
 
+#ifdef HAVE_LIBAPPINDICATOR
+/* Replace the discovered services of the indicator menu, the profiles are left alone */
+static gboolean remmina_icon_update_discovered(gpointer data)
+{
+	TRACE_CALL(__func__);
+	GtkMenu *menu;
+
+	remmina_icon.avahi_changed_source = 0;
+	menu = remmina_icon.icon ? app_indicator_get_menu(remmina_icon.icon) : NULL;
+	if (menu && REMMINA_IS_APPLET_MENU(menu)) {
+		remmina_applet_menu_remove_group(REMMINA_APPLET_MENU(menu), _("Discovered"));
+		remmina_icon_populate_discovered_menu_item(GTK_WIDGET(menu));
+	}
+	return G_SOURCE_REMOVE;
+}
+#endif
+
+static void remmina_icon_on_avahi_changed(RemminaAvahi *ga, gpointer data)
+{
+	TRACE_CALL(__func__);
+#ifdef HAVE_LIBAPPINDICATOR
+	/* The indicator menu stays around, it must show the new services now.
+	 * A burst of browser events is applied at once.
+	 * The status icon menu is built at each popup. */
+	if (!remmina_icon.avahi_changed_source)
+		remmina_icon.avahi_changed_source = g_idle_add(remmina_icon_update_discovered, NULL);
+#endif
+}
+
 void remmina_icon_init(void)
 {
 	TRACE_CALL(__func__);
@@ -496,6 +541,8 @@ void remmina_icon_init(void)
 	}
 	if (!remmina_icon.avahi) {
 		remmina_icon.avahi = remmina_avahi_new();
+		if (remmina_icon.avahi)
+			remmina_avahi_set_changed_func(remmina_icon.avahi, remmina_icon_on_avahi_changed, NULL);
 	}
 	if (remmina_icon.avahi) {
 		if (remmina_pref.applet_enable_avahi) {
@@ -36,6 +36,7 @@
 
 #include <gtk/gtk.h>
 #include <glib/gi18n.h>
+#include <string.h>
 #include "remmina_public.h"
 #include "remmina_log.h"
 #include "remmina_stats_sender.h"
@@ -153,31 +154,92 @@ gboolean remmina_log_running(void)
 	return (log_window != NULL);
 }
 
-static gboolean remmina_log_scroll_to_end(gpointer data)
+/* Messages are collected in log_pending and inserted in the log window
+ * by a single flush, at most every LOG_FLUSH_INTERVAL milliseconds */
+#define LOG_FLUSH_INTERVAL 100
+/* Lines waiting for the next flush, further lines are dropped and counted */
+#define LOG_PENDING_MAX_LINES 5000
+/* Lines kept in the log window, older lines are removed */
+#define LOG_WINDOW_MAX_LINES 20000
+
+static GString *log_pending = NULL;
+static guint log_pending_lines = 0;
+static guint log_dropped_lines = 0;
+static guint log_flush_source = 0;
+G_LOCK_DEFINE_STATIC(log_pending);
+
+static void remmina_log_scroll_to_end(void)
 {
 	TRACE_CALL(__func__);
 	GtkTextIter iter;
 
-	if (log_window) {
-		gtk_text_buffer_get_end_iter(REMMINA_LOG_WINDOW(log_window)->log_buffer, &iter);
-		gtk_text_view_scroll_to_iter(GTK_TEXT_VIEW(REMMINA_LOG_WINDOW(log_window)->log_view), &iter, 0.0, FALSE, 0.0,
-			0.0);
+	gtk_text_buffer_get_end_iter(REMMINA_LOG_WINDOW(log_window)->log_buffer, &iter);
+	gtk_text_view_scroll_to_iter(GTK_TEXT_VIEW(REMMINA_LOG_WINDOW(log_window)->log_view), &iter, 0.0, FALSE, 0.0,
+		0.0);
+}
+
+static gboolean remmina_log_flush(gpointer data)
+{
+	TRACE_CALL(__func__);
+	GtkTextBuffer *buffer;
+	GtkTextIter start, end;
+	GString *text;
+	guint dropped;
+	gint lines;
+
+	G_LOCK(log_pending);
+	text = log_pending;
+	dropped = log_dropped_lines;
+	log_pending = NULL;
+	log_pending_lines = 0;
+	log_dropped_lines = 0;
+	log_flush_source = 0;
+	G_UNLOCK(log_pending);
+
+	if (log_window && text) {
+		buffer = REMMINA_LOG_WINDOW(log_window)->log_buffer;
+		if (dropped > 0)
+			g_string_append_printf(text, "[%u log lines dropped]\n", dropped);
+		gtk_text_buffer_get_end_iter(buffer, &end);
+		gtk_text_buffer_insert(buffer, &end, text->str, text->len);
+
+		lines = gtk_text_buffer_get_line_count(buffer);
+		if (lines > LOG_WINDOW_MAX_LINES) {
+			gtk_text_buffer_get_start_iter(buffer, &start);
+			gtk_text_buffer_get_iter_at_line(buffer, &end, lines - LOG_WINDOW_MAX_LINES);
+			gtk_text_buffer_delete(buffer, &start, &end);
+		}
+		remmina_log_scroll_to_end();
 	}
+	if (text)
+		g_string_free(text, TRUE);
 	return FALSE;
 }
 
-static gboolean remmina_log_print_real(gpointer data)
+/* Can be called from any thread */
+static void remmina_log_append(const gchar *text)
 {
 	TRACE_CALL(__func__);
-	GtkTextIter iter;
-
-	if (log_window) {
-		gtk_text_buffer_get_end_iter(REMMINA_LOG_WINDOW(log_window)->log_buffer, &iter);
-		gtk_text_buffer_insert(REMMINA_LOG_WINDOW(log_window)->log_buffer, &iter, (const gchar*)data, -1);
-		IDLE_ADD(remmina_log_scroll_to_end, NULL);
+	const gchar *p;
+	guint lines = 0;
+
+	for (p = text; (p = strchr(p, '\n')) != NULL; p++)
+		lines++;
+	if (lines == 0)
+		lines = 1;
+
+	G_LOCK(log_pending);
+	if (log_pending_lines + lines > LOG_PENDING_MAX_LINES) {
+		log_dropped_lines += lines;
+	} else {
+		if (!log_pending)
+			log_pending = g_string_sized_new(4096);
+		g_string_append(log_pending, text);
+		log_pending_lines += lines;
 	}
-	g_free(data);
-	return FALSE;
+	if (!log_flush_source)
+		log_flush_source = TIMEOUT_ADD(LOG_FLUSH_INTERVAL, remmina_log_flush, NULL);
+	G_UNLOCK(log_pending);
 }
 
 void remmina_log_print(const gchar *text)
@@ -186,7 +248,7 @@ void remmina_log_print(const gchar *text)
 	if (!log_window)
 		return;
 
-	IDLE_ADD(remmina_log_print_real, g_strdup(text));
+	remmina_log_append(text);
 }
 
 void remmina_log_printf(const gchar *fmt, ...)
@@ -201,6 +263,6 @@ void remmina_log_printf(const gchar *fmt, ...)
 	text = g_strdup_vprintf(fmt, args);
 	va_end(args);
 
-	IDLE_ADD(remmina_log_print_real, text);
+	remmina_log_append(text);
+	g_free(text);
 }
-
@@ -209,6 +209,7 @@ static gboolean remmina_main_rmodestroy(gpointer data)
 
 	g_object_unref(G_OBJECT(remminamain->priv->file_model_filter));
 	g_object_unref(remminamain->builder);
+	remmina_file_manager_remove_datadir_notify(remminamain->priv->datadir_notify_id);
 	g_free(remminamain->priv->selected_filename);
 	g_free(remminamain->priv->selected_name);
 	g_free(remminamain->priv);
@@ -653,6 +654,13 @@ void remmina_main_load_files_cb()
 	remmina_main_load_files();
 }
 
+static void remmina_main_on_datadir_changed(const gchar *datadir, gpointer user_data)
+{
+	TRACE_CALL(__func__);
+	if (remminamain && remminamain->window)
+		remmina_main_load_files();
+}
+
 void remmina_main_on_action_connection_connect(GSimpleAction *action, GVariant *param, gpointer data)
 {
 	TRACE_CALL(__func__);
@@ -1332,6 +1340,9 @@ GtkWidget* remmina_main_new(void)
 	gtk_accel_group_connect (accel_group, GDK_KEY_P, GDK_CONTROL_MASK, 0,
 			g_cclosure_new_swap (G_CALLBACK (remmina_main_on_action_application_preferences), NULL, NULL));
 
+	/* Reload the connection list when the data directory changes */
+	remminamain->priv->datadir_notify_id = remmina_file_manager_add_datadir_notify(remmina_main_on_datadir_changed, NULL);
+
 	/* Connect signals */
 	gtk_builder_connect_signals(remminamain->builder, NULL);
 	/* Initialize the window and load the preferences */
@@ -89,6 +89,7 @@ struct _RemminaMainPriv {
 	gchar *selected_name;
 	gboolean override_view_file_mode_to_list;
 	RemminaStringArray *expanded_group;
+	gulong datadir_notify_id;
 };
 
 G_BEGIN_DECLS
@@ -60,6 +60,9 @@ static gboolean remmina_masterthread_exec_callback(RemminaMTExecData *d)
 		case FUNC_FILE_GET_STRING:
 			d->p.file_get_string.retval = remmina_file_get_string( d->p.file_get_string.remminafile, d->p.file_get_string.setting );
 			break;
+		case FUNC_FILE_SNAPSHOT_NEW:
+			d->p.file_snapshot_new.retval = remmina_file_snapshot_new( d->p.file_snapshot_new.remminafile );
+			break;
 		case FUNC_GTK_LABEL_SET_TEXT:
 			gtk_label_set_text( d->p.gtk_label_set_text.label, d->p.gtk_label_set_text.str );
 			break;
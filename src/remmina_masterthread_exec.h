@@ -44,6 +44,7 @@ typedef struct remmina_masterthread_exec_data {
 
 	enum { FUNC_GTK_LABEL_SET_TEXT,
 	       FUNC_INIT_SAVE_CRED, FUNC_CHAT_RECEIVE, FUNC_FILE_GET_STRING,
+	       FUNC_FILE_SNAPSHOT_NEW,
 	       FUNC_FTP_CLIENT_UPDATE_TASK, FUNC_FTP_CLIENT_GET_WAITING_TASK,
 	       FUNC_SFTP_CLIENT_CONFIRM_RESUME,
 	       FUNC_PROTOCOLWIDGET_EMIT_SIGNAL,
@@ -71,6 +72,10 @@ typedef struct remmina_masterthread_exec_data {
 			const gchar *setting;
 			const gchar* retval;
 		} file_get_string;
+		struct {
+			RemminaFile *remminafile;
+			RemminaFileSnapshot *retval;
+		} file_snapshot_new;
 		struct {
 			RemminaFTPClient *client;
 			RemminaFTPTask* task;
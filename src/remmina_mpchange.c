@@ -49,6 +49,24 @@
 
 #define GET_DIALOG_OBJECT(object_name) gtk_builder_get_object(bu, object_name)
 
+/* Profiles written between two checks for cancellation */
+#define MPCHANGE_BATCH_SIZE 32
+/* Milliseconds between two updates of the progress shown in the dialog */
+#define MPCHANGE_PROGRESS_INTERVAL 200
+
+/* A profile to change, prepared by the worker pool */
+struct mpchanger_item {
+	gchar *filename;
+	GKeyFile *gkeyfile;     // NULL when the profile cannot be read
+	RemminaFile *spfile;    // Just filename and name, for the secret plugin
+	gboolean in_keyring;    // The password is already stored by the secret plugin
+	gboolean skip;          // The user does not want a password saved for this profile
+	gchar *old_value;       // Previous value of the password key in the profile
+	gchar *old_secret;      // Previous password in the keyring, for rollback
+	gboolean secret_stored;
+	gboolean file_written;
+};
+
 struct mpchanger_params {
 	gchar *username;        // New username
 	gchar *domain;          // New domain
@@ -62,11 +80,23 @@ struct mpchanger_params {
 	GtkTreeView* table;
 	GtkButton* btnDoChange;
 	GtkLabel* statusLabel;
+	GtkToggleButton* cAtomic;
 
-	GtkTreeIter iter;
 	int changed_passwords_count;
-	guint sid;
 	guint searchentrychange_timeout_source_id;
+
+	/* Bulk change, done by a worker thread. The main thread only reads
+	 * the counters below, from a timeout, until finished is set. */
+	GThread *worker;
+	GPtrArray *items;
+	RemminaSecretPlugin *secret_plugin;
+	gboolean atomic;
+	gint cancelled;
+	gint processed;
+	gint failed;
+	gint finished;
+	gboolean rolled_back;
+	guint progress_sid;
 };
 
 enum {
@@ -159,19 +189,165 @@ static void remmina_mpchange_checkbox_toggle(GtkCellRendererToggle *cell, gchar
 	gtk_list_store_set(mpcp->store, &iter, COL_F, !a, -1);
 }
 
-static void remmina_mpchange_dochange(gchar* fname, struct mpchanger_params* mpcp)
+static void remmina_mpchange_item_free(struct mpchanger_item* item)
 {
 	TRACE_CALL(__func__);
+	if (item->gkeyfile)
+		g_key_file_free(item->gkeyfile);
+	if (item->spfile)
+		remmina_file_free(item->spfile);
+	g_free(item->filename);
+	g_free(item->old_value);
+	g_free(item->old_secret);
+	g_free(item);
+}
 
-	RemminaFile* remminafile;
+/* Runs in the worker pool: read the profile, without decrypting anything
+ * or asking the secret plugin */
+static void remmina_mpchange_prepare(gpointer data, gpointer user_data)
+{
+	TRACE_CALL(__func__);
+	struct mpchanger_item* item = (struct mpchanger_item*)data;
+	gchar *name;
+
+	item->gkeyfile = g_key_file_new();
+	if (!g_key_file_load_from_file(item->gkeyfile, item->filename, G_KEY_FILE_KEEP_COMMENTS, NULL) ||
+	    !g_key_file_has_key(item->gkeyfile, "remmina", "name", NULL)) {
+		g_key_file_free(item->gkeyfile);
+		item->gkeyfile = NULL;
+		return;
+	}
+
+	/* The secret plugin finds the password from the file name and the name */
+	name = g_key_file_get_string(item->gkeyfile, "remmina", "name", NULL);
+	item->spfile = remmina_file_new_empty();
+	remmina_file_set_filename(item->spfile, item->filename);
+	remmina_file_set_string_ref(item->spfile, "name", name);
+
+	item->old_value = g_key_file_get_string(item->gkeyfile, "remmina", "password", NULL);
+	item->in_keyring = (g_strcmp0(item->old_value, ".") == 0);
+	item->skip = !item->in_keyring &&
+		     g_key_file_get_integer(item->gkeyfile, "remmina", "disablepasswordstoring", NULL) == 1;
+}
 
-	remminafile = remmina_file_load(fname);
-	if (remminafile) {
-		remmina_file_store_secret_plugin_password(remminafile, "password", mpcp->password);
-		remmina_file_free(remminafile);
-		mpcp->changed_passwords_count++;
+/* Rewrite only the password key of the profile */
+static gboolean remmina_mpchange_write_key(struct mpchanger_item* item, const gchar *value)
+{
+	TRACE_CALL(__func__);
+	gchar *content;
+	gsize length;
+	gboolean ret;
+	GError *err = NULL;
+
+	if (value)
+		g_key_file_set_string(item->gkeyfile, "remmina", "password", value);
+	else
+		g_key_file_remove_key(item->gkeyfile, "remmina", "password", NULL);
+
+	content = g_key_file_to_data(item->gkeyfile, &length, NULL);
+	ret = g_file_set_contents(item->filename, content, length, &err);
+	g_free(content);
+	if (!ret) {
+		remmina_log_printf("Unable to save profile %s: %s\n", item->filename, err->message);
+		g_error_free(err);
 	}
+	return ret;
+}
 
+static gboolean remmina_mpchange_dochange(struct mpchanger_params* mpcp, struct mpchanger_item* item)
+{
+	TRACE_CALL(__func__);
+
+	if (mpcp->atomic && item->in_keyring)
+		item->old_secret = mpcp->secret_plugin->get_password(item->spfile, "password");
+
+	mpcp->secret_plugin->store_password(item->spfile, "password", mpcp->password);
+	item->secret_stored = TRUE;
+
+	/* A password which was still in the profile moves to the keyring,
+	 * as remmina_file_save() would do */
+	if (!item->in_keyring) {
+		if (!remmina_mpchange_write_key(item, "."))
+			return FALSE;
+		item->file_written = TRUE;
+	}
+
+	return TRUE;
+}
+
+static void remmina_mpchange_rollback(struct mpchanger_params* mpcp)
+{
+	TRACE_CALL(__func__);
+	struct mpchanger_item* item;
+	guint i;
+
+	for (i = 0; i < mpcp->items->len; i++) {
+		item = g_ptr_array_index(mpcp->items, i);
+		if (item->secret_stored) {
+			if (item->old_secret)
+				mpcp->secret_plugin->store_password(item->spfile, "password", item->old_secret);
+			else
+				mpcp->secret_plugin->delete_password(item->spfile, "password");
+		}
+		if (item->file_written)
+			remmina_mpchange_write_key(item, item->old_value);
+	}
+	mpcp->changed_passwords_count = 0;
+	mpcp->rolled_back = TRUE;
+}
+
+static gpointer remmina_mpchange_worker(gpointer user_data)
+{
+	TRACE_CALL(__func__);
+	struct mpchanger_params* mpcp = (struct mpchanger_params*)user_data;
+	struct mpchanger_item* item;
+	GThreadPool *pool;
+	guint i, j;
+
+	/* Reading the profiles is independent work, spread it */
+	pool = g_thread_pool_new(remmina_mpchange_prepare, NULL, MIN(g_get_num_processors(), 8), FALSE, NULL);
+	for (i = 0; i < mpcp->items->len; i++)
+		g_thread_pool_push(pool, g_ptr_array_index(mpcp->items, i), NULL);
+	g_thread_pool_free(pool, FALSE, TRUE);
+
+	/* The secret service is a single D-Bus peer: its writes are done here,
+	 * one batch at a time, with a check for cancellation between batches */
+	for (i = 0; i < mpcp->items->len && !g_atomic_int_get(&mpcp->cancelled); i += MPCHANGE_BATCH_SIZE) {
+		for (j = i; j < MIN(i + MPCHANGE_BATCH_SIZE, mpcp->items->len); j++) {
+			item = g_ptr_array_index(mpcp->items, j);
+			if (!item->gkeyfile) {
+				g_atomic_int_inc(&mpcp->failed);
+			} else if (item->skip) {
+				continue;
+			} else if (remmina_mpchange_dochange(mpcp, item)) {
+				mpcp->changed_passwords_count++;
+			} else {
+				g_atomic_int_inc(&mpcp->failed);
+			}
+		}
+		g_atomic_int_set(&mpcp->processed, j);
+		if (mpcp->atomic && g_atomic_int_get(&mpcp->failed))
+			break;
+	}
+
+	if (mpcp->atomic && (g_atomic_int_get(&mpcp->cancelled) || g_atomic_int_get(&mpcp->failed)))
+		remmina_mpchange_rollback(mpcp);
+
+	g_atomic_int_set(&mpcp->finished, TRUE);
+	return NULL;
+}
+
+static void remmina_mpchange_worker_join(struct mpchanger_params* mpcp)
+{
+	TRACE_CALL(__func__);
+	if (!mpcp->worker)
+		return;
+
+	g_atomic_int_set(&mpcp->cancelled, TRUE);
+	g_thread_join(mpcp->worker);
+	mpcp->worker = NULL;
+	g_ptr_array_free(mpcp->items, TRUE);
+	mpcp->items = NULL;
 }
 
 static void enable_inputs(struct mpchanger_params* mpcp, gboolean ena)
@@ -183,29 +359,27 @@ static void enable_inputs(struct mpchanger_params* mpcp, gboolean ena)
 	gtk_widget_set_sensitive(GTK_WIDGET(mpcp->ePassword2), ena);
 	gtk_widget_set_sensitive(GTK_WIDGET(mpcp->btnDoChange), ena);
 	gtk_widget_set_sensitive(GTK_WIDGET(mpcp->table), ena);
+	gtk_widget_set_sensitive(GTK_WIDGET(mpcp->cAtomic), ena);
 }
 
-static gboolean changenext(gpointer user_data)
+static gboolean remmina_mpchange_progress(gpointer user_data)
 {
 	TRACE_CALL(__func__);
 	struct mpchanger_params* mpcp = (struct mpchanger_params*)user_data;
-	gchar* fname;
-	gboolean sel;
-
-	gtk_tree_model_get(GTK_TREE_MODEL(mpcp->store), &mpcp->iter, COL_F, &sel, -1);
-	gtk_tree_model_get(GTK_TREE_MODEL(mpcp->store), &mpcp->iter, COL_FILENAME, &fname, -1);
-	if (sel) {
-		remmina_mpchange_dochange(fname, mpcp);
-	}
-	g_free(fname);
+	gchar *s;
 
-	if (gtk_tree_model_iter_next(GTK_TREE_MODEL(mpcp->store), &mpcp->iter)) {
-		return G_SOURCE_CONTINUE;
-	}else  {
+	if (g_atomic_int_get(&mpcp->finished)) {
+		mpcp->progress_sid = 0;
 		gtk_dialog_response(mpcp->dialog, 1);
-		mpcp->sid = 0;
 		return G_SOURCE_REMOVE;
 	}
+
+	s = g_strdup_printf(_("Resetting passwords, please wait… %d of %d"),
+		g_atomic_int_get(&mpcp->processed), mpcp->items->len);
+	gtk_label_set_text(mpcp->statusLabel, s);
+	g_free(s);
+
+	return G_SOURCE_CONTINUE;
 }
 
 static void remmina_mpchange_dochange_clicked(GtkButton *btn, gpointer user_data)
@@ -213,13 +387,17 @@ static void remmina_mpchange_dochange_clicked(GtkButton *btn, gpointer user_data
 	TRACE_CALL(__func__);
 	struct mpchanger_params* mpcp = (struct mpchanger_params*)user_data;
 	const gchar *passwd1, *passwd2;
+	struct mpchanger_item* item;
+	GtkTreeIter iter;
+	gchar* fname;
+	gboolean sel;
 
 	if (mpcp->searchentrychange_timeout_source_id) {
 		g_source_remove(mpcp->searchentrychange_timeout_source_id);
 		mpcp->searchentrychange_timeout_source_id = 0;
 	}
 
-	if (!gtk_tree_model_get_iter_first(GTK_TREE_MODEL(mpcp->store), &mpcp->iter))
+	if (!gtk_tree_model_get_iter_first(GTK_TREE_MODEL(mpcp->store), &iter))
 		return;
 
 	passwd1 = gtk_entry_get_text(mpcp->ePassword1);
@@ -241,10 +419,29 @@ static void remmina_mpchange_dochange_clicked(GtkButton *btn, gpointer user_data
 	mpcp->password = g_strdup(passwd1);
 	mpcp->changed_passwords_count = 0;
 
+	/* The worker only gets file names, it never touches the list store */
+	mpcp->items = g_ptr_array_new_with_free_func((GDestroyNotify)remmina_mpchange_item_free);
+	do {
+		gtk_tree_model_get(GTK_TREE_MODEL(mpcp->store), &iter, COL_F, &sel, COL_FILENAME, &fname, -1);
+		if (sel) {
+			item = g_new0(struct mpchanger_item, 1);
+			item->filename = fname;
+			g_ptr_array_add(mpcp->items, item);
+		} else {
+			g_free(fname);
+		}
+	} while (gtk_tree_model_iter_next(GTK_TREE_MODEL(mpcp->store), &iter));
+
+	mpcp->secret_plugin = remmina_plugin_manager_get_secret_plugin();
+	mpcp->atomic = gtk_toggle_button_get_active(mpcp->cAtomic);
+	mpcp->cancelled = mpcp->processed = mpcp->failed = mpcp->finished = 0;
+	mpcp->rolled_back = FALSE;
+
 	gtk_label_set_text(mpcp->statusLabel, _("Resetting passwords, please wait…"));
 
 	enable_inputs(mpcp, FALSE);
-	mpcp->sid = g_idle_add(changenext, (gpointer)mpcp);
+	mpcp->worker = g_thread_new("mpchange", remmina_mpchange_worker, (gpointer)mpcp);
+	mpcp->progress_sid = g_timeout_add(MPCHANGE_PROGRESS_INTERVAL, remmina_mpchange_progress, (gpointer)mpcp);
 
 }
 
@@ -373,6 +570,8 @@ static gboolean remmina_file_multipasswd_changer_mt(gpointer d)
 
 	mpcp->statusLabel = GTK_LABEL(GET_DIALOG_OBJECT("statusLabel"));
 
+	mpcp->cAtomic = GTK_TOGGLE_BUTTON(GET_DIALOG_OBJECT("atomicCheck"));
+
 
 	mpcp->store = NULL;
 
@@ -400,17 +599,28 @@ static gboolean remmina_file_multipasswd_changer_mt(gpointer d)
 	gtk_dialog_run(dialog);
 	gtk_widget_destroy(GTK_WIDGET(dialog));
 
-	if (mpcp->sid) {
-		g_source_remove(mpcp->sid);
-		mpcp->sid = 0;
+	if (mpcp->progress_sid) {
+		g_source_remove(mpcp->progress_sid);
+		mpcp->progress_sid = 0;
 	}
+	/* Closing the dialog cancels a running change, after the current batch */
+	remmina_mpchange_worker_join(mpcp);
 
 	if (mpcp->searchentrychange_timeout_source_id) {
 		g_source_remove(mpcp->searchentrychange_timeout_source_id);
 		mpcp->searchentrychange_timeout_source_id = 0;
 	}
 
-	if (mpcp->changed_passwords_count) {
+	if (mpcp->rolled_back) {
+		GtkWidget *msgDialog;
+		msgDialog = gtk_message_dialog_new(mainwindow,
+			GTK_DIALOG_DESTROY_WITH_PARENT,
+			GTK_MESSAGE_WARNING,
+			GTK_BUTTONS_OK,
+			_("The passwords have not been changed, all changes have been undone."));
+		gtk_dialog_run(GTK_DIALOG(msgDialog));
+		gtk_widget_destroy(msgDialog);
+	} else if (mpcp->changed_passwords_count) {
 		GtkWidget *msgDialog;
 		msgDialog = gtk_message_dialog_new(GTK_WINDOW(mpcp->dialog),
 			GTK_DIALOG_DESTROY_WITH_PARENT,
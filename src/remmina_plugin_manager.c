@@ -237,7 +237,15 @@ RemminaPluginService remmina_plugin_manager_service =
 	remmina_masterthread_exec_is_main_thread,
 	remmina_gtksocket_available,
 	remmina_protocol_widget_get_profile_remote_width,
-	remmina_protocol_widget_get_profile_remote_height
+	remmina_protocol_widget_get_profile_remote_height,
+
+	remmina_file_snapshot_new,
+	remmina_file_snapshot_ref,
+	remmina_file_snapshot_unref,
+	remmina_file_snapshot_get_string,
+	remmina_file_snapshot_get_int,
+
+	remmina_protocol_widget_screenshot_ready
 
 };
 
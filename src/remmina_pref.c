@@ -68,15 +68,188 @@ static const gchar *default_keymap_data = "# Please check gdk/gdkkeysyms.h for a
 					  "Meta_L = Super_L\n"
 					  "Meta_R = Super_R\n";
 
+/* Delay of the write-behind flush, restarted by every change up to REMMINA_PREF_FLUSH_MAX_DELAY */
+#define REMMINA_PREF_FLUSH_DELAY 500
+#define REMMINA_PREF_FLUSH_MAX_DELAY 5000
+/* Minimum interval between two checks for changes done by other processes */
+#define REMMINA_PREF_CHECK_INTERVAL G_USEC_PER_SEC
+
+/* In-memory copy of remmina.pref, loaded once and written back lazily.
+ * Changes not yet on disk are also kept in remmina_pref_pending, so they can be
+ * applied again when the file has been modified by another process. */
+static GKeyFile *remmina_pref_store = NULL;
+static GKeyFile *remmina_pref_pending = NULL;
+static GStatBuf remmina_pref_store_stat;
+static gint64 remmina_pref_store_checked = 0;
+static gint64 remmina_pref_pending_since = 0;
+static guint remmina_pref_flush_source = 0;
+G_LOCK_DEFINE_STATIC(remmina_pref_store);
+
+static gboolean remmina_pref_store_changed(void)
+{
+	TRACE_CALL(__func__);
+	GStatBuf st;
+
+	if (g_stat(remmina_pref_file, &st) != 0)
+		return FALSE;
+	return st.st_mtime != remmina_pref_store_stat.st_mtime ||
+	       st.st_size != remmina_pref_store_stat.st_size ||
+	       st.st_ino != remmina_pref_store_stat.st_ino;
+}
+
+/* Apply the changes of src on top of dst */
+static void remmina_pref_store_merge(GKeyFile *dst, GKeyFile *src)
+{
+	TRACE_CALL(__func__);
+	gchar **groups, **keys;
+	gchar *value;
+	gint i, j;
+
+	groups = g_key_file_get_groups(src, NULL);
+	for (i = 0; groups[i]; i++) {
+		keys = g_key_file_get_keys(src, groups[i], NULL, NULL);
+		for (j = 0; keys && keys[j]; j++) {
+			value = g_key_file_get_value(src, groups[i], keys[j], NULL);
+			g_key_file_set_value(dst, groups[i], keys[j], value);
+			g_free(value);
+		}
+		g_strfreev(keys);
+	}
+	g_strfreev(groups);
+}
+
+/* (Re)load the store from disk, keeping the changes which are still pending. Called with the lock held */
+static void remmina_pref_store_load(void)
+{
+	TRACE_CALL(__func__);
+	GKeyFile *gkeyfile;
+
+	gkeyfile = g_key_file_new();
+	g_key_file_load_from_file(gkeyfile, remmina_pref_file, G_KEY_FILE_NONE, NULL);
+	if (remmina_pref_pending)
+		remmina_pref_store_merge(gkeyfile, remmina_pref_pending);
+	else
+		remmina_pref_pending = g_key_file_new();
+
+	if (remmina_pref_store)
+		g_key_file_free(remmina_pref_store);
+	remmina_pref_store = gkeyfile;
+
+	if (g_stat(remmina_pref_file, &remmina_pref_store_stat) != 0)
+		memset(&remmina_pref_store_stat, 0, sizeof(remmina_pref_store_stat));
+	remmina_pref_store_checked = g_get_monotonic_time();
+}
+
+/* Make sure the store reflects the file on disk. Unless force is set, the
+ * file is checked at most once every REMMINA_PREF_CHECK_INTERVAL.
+ * Called with the lock held */
+static void remmina_pref_store_sync(gboolean force)
+{
+	TRACE_CALL(__func__);
+	gint64 now;
+
+	if (!remmina_pref_store) {
+		remmina_pref_store_load();
+		return;
+	}
+	now = g_get_monotonic_time();
+	if (!force && now - remmina_pref_store_checked < REMMINA_PREF_CHECK_INTERVAL)
+		return;
+	remmina_pref_store_checked = now;
+	if (remmina_pref_store_changed()) {
+		g_debug("remmina.pref has been changed on disk, reloading it");
+		remmina_pref_store_load();
+	}
+}
+
+/* Write the store to disk, the caller should sync it first. Called with the lock held */
+static gboolean remmina_pref_store_write(GError **error)
+{
+	TRACE_CALL(__func__);
+	gchar *content;
+	gsize length;
+	gboolean ret;
+
+	content = g_key_file_to_data(remmina_pref_store, &length, NULL);
+	ret = g_file_set_contents(remmina_pref_file, content, length, error);
+	g_free(content);
+
+	if (ret) {
+		g_key_file_free(remmina_pref_pending);
+		remmina_pref_pending = g_key_file_new();
+		remmina_pref_pending_since = 0;
+		if (g_stat(remmina_pref_file, &remmina_pref_store_stat) != 0)
+			memset(&remmina_pref_store_stat, 0, sizeof(remmina_pref_store_stat));
+	}
+	return ret;
+}
+
+static gboolean remmina_pref_flush_cb(gpointer user_data)
+{
+	TRACE_CALL(__func__);
+	GError *error = NULL;
+
+	G_LOCK(remmina_pref_store);
+	remmina_pref_flush_source = 0;
+	remmina_pref_store_sync(TRUE);
+	if (!remmina_pref_store_write(&error)) {
+		g_warning("Unable to write remmina.pref: %s", error->message);
+		g_error_free(error);
+	}
+	G_UNLOCK(remmina_pref_store);
+	return G_SOURCE_REMOVE;
+}
+
+/* Set a value in the store and schedule a write-behind flush.
+ * Bursts of changes are coalesced in a single write. Called with the lock held */
+static void remmina_pref_store_set_string(const gchar *group, const gchar *key, const gchar *value)
+{
+	TRACE_CALL(__func__);
+	gint64 now;
+
+	remmina_pref_store_sync(FALSE);
+	g_key_file_set_string(remmina_pref_store, group, key, value);
+	g_key_file_set_string(remmina_pref_pending, group, key, value);
+
+	now = g_get_monotonic_time();
+	if (remmina_pref_pending_since == 0)
+		remmina_pref_pending_since = now;
+	if (remmina_pref_flush_source) {
+		if (now - remmina_pref_pending_since >= REMMINA_PREF_FLUSH_MAX_DELAY * 1000)
+			return;
+		g_source_remove(remmina_pref_flush_source);
+	}
+	remmina_pref_flush_source = g_timeout_add(REMMINA_PREF_FLUSH_DELAY, remmina_pref_flush_cb, NULL);
+}
+
+/**
+ * Write the pending preference changes to disk now, without waiting for the
+ * write-behind timer. Must be called before the application exits.
+ */
+void remmina_pref_flush(void)
+{
+	TRACE_CALL(__func__);
+	GError *error = NULL;
+
+	G_LOCK(remmina_pref_store);
+	if (remmina_pref_flush_source) {
+		g_source_remove(remmina_pref_flush_source);
+		remmina_pref_flush_source = 0;
+		remmina_pref_store_sync(TRUE);
+		if (!remmina_pref_store_write(&error)) {
+			g_warning("Unable to write remmina.pref: %s", error->message);
+			g_error_free(error);
+		}
+	}
+	G_UNLOCK(remmina_pref_store);
+}
+
 static void remmina_pref_gen_secret(void)
 {
 	TRACE_CALL(__func__);
 	guchar s[32];
 	gint i;
 	GTimeVal gtime;
-	GKeyFile *gkeyfile;
-	gchar *content;
-	gsize length;
 
 	g_get_current_time(&gtime);
 	srand(gtime.tv_sec);
@@ -86,14 +259,9 @@ static void remmina_pref_gen_secret(void)
 	}
 	remmina_pref.secret = g_base64_encode(s, 32);
 
-	gkeyfile = g_key_file_new();
-	g_key_file_load_from_file(gkeyfile, remmina_pref_file, G_KEY_FILE_NONE, NULL);
-	g_key_file_set_string(gkeyfile, "remmina_pref", "secret", remmina_pref.secret);
-	content = g_key_file_to_data(gkeyfile, &length, NULL);
-	g_file_set_contents(remmina_pref_file, content, length, NULL);
-
-	g_key_file_free(gkeyfile);
-	g_free(content);
+	G_LOCK(remmina_pref_store);
+	remmina_pref_store_set_string("remmina_pref", "secret", remmina_pref.secret);
+	G_UNLOCK(remmina_pref_store);
 }
 
 static guint remmina_pref_get_keyval_from_str(const gchar *str)
@@ -222,6 +390,7 @@ void remmina_pref_init(void)
 {
 	TRACE_CALL(__func__);
 	GKeyFile *gkeyfile;
+	GKeyFile *colors_keyfile;
 	gchar *remmina_dir;
 	const gchar *filename = "remmina.pref";
 	const gchar *colors_filename = "remmina.colors";
@@ -275,8 +444,9 @@ void remmina_pref_init(void)
 
 	remmina_keymap_file = g_strdup_printf("%s/remmina.keymap", remmina_dir);
 
-	gkeyfile = g_key_file_new();
-	g_key_file_load_from_file(gkeyfile, remmina_pref_file, G_KEY_FILE_NONE, NULL);
+	G_LOCK(remmina_pref_store);
+	remmina_pref_store_load();
+	gkeyfile = remmina_pref_store;
 
 	if (g_key_file_has_key(gkeyfile, "remmina_pref", "save_view_mode", NULL))
 		remmina_pref.save_view_mode = g_key_file_get_boolean(gkeyfile, "remmina_pref", "save_view_mode", NULL);
@@ -477,6 +647,16 @@ void remmina_pref_init(void)
 	else
 		remmina_pref.ssh_tcp_usrtimeout = SSH_SOCKET_TCP_USER_TIMEOUT;
 
+	if (g_key_file_has_key(gkeyfile, "remmina_pref", "ssh_tunnel_buffer_size", NULL))
+		remmina_pref.ssh_tunnel_buffer_size = g_key_file_get_integer(gkeyfile, "remmina_pref", "ssh_tunnel_buffer_size", NULL);
+	else
+		remmina_pref.ssh_tunnel_buffer_size = SSH_TUNNEL_BUFFER_SIZE;
+
+	if (g_key_file_has_key(gkeyfile, "remmina_pref", "ssh_tunnel_stats", NULL))
+		remmina_pref.ssh_tunnel_stats = g_key_file_get_boolean(gkeyfile, "remmina_pref", "ssh_tunnel_stats", NULL);
+	else
+		remmina_pref.ssh_tunnel_stats = FALSE;
+
 	if (g_key_file_has_key(gkeyfile, "remmina_pref", "applet_new_ontop", NULL))
 		remmina_pref.applet_new_ontop = g_key_file_get_boolean(gkeyfile, "remmina_pref", "applet_new_ontop", NULL);
 	else
@@ -641,13 +821,15 @@ void remmina_pref_init(void)
 	/* If we have a color scheme file, we switch to it, GIO will merge it in the
 	 * remmina.pref file */
 	if (g_file_test(remmina_colors_file, G_FILE_TEST_IS_REGULAR)) {
-		gkeyfile = g_key_file_new();
-		g_key_file_load_from_file(gkeyfile, remmina_colors_file, G_KEY_FILE_NONE, NULL);
+		colors_keyfile = g_key_file_new();
+		g_key_file_load_from_file(colors_keyfile, remmina_colors_file, G_KEY_FILE_NONE, NULL);
+		remmina_pref_file_load_colors(colors_keyfile, &remmina_pref.color_pref);
+		g_key_file_free(colors_keyfile);
 		g_remove(remmina_colors_file);
+	} else {
+		remmina_pref_file_load_colors(gkeyfile, &remmina_pref.color_pref);
 	}
 
-	remmina_pref_file_load_colors(gkeyfile, &remmina_pref.color_pref);
-
 	if (g_key_file_has_key(gkeyfile, "usage_stats", "periodic_usage_stats_permitted", NULL))
 		remmina_pref.periodic_usage_stats_permitted = g_key_file_get_boolean(gkeyfile, "usage_stats", "periodic_usage_stats_permitted", NULL);
 	else
@@ -670,14 +852,13 @@ void remmina_pref_init(void)
 
 	/* Default settings */
 	if (!g_key_file_has_key(gkeyfile, "remmina", "name", NULL)) {
-		g_key_file_set_string(gkeyfile, "remmina", "name", "");
-		g_key_file_set_integer(gkeyfile, "remmina", "ignore-tls-errors", 1);
 		g_key_file_set_integer(gkeyfile, "remmina", "enable-plugins", 1);
+		G_UNLOCK(remmina_pref_store);
 		remmina_pref_save();
+	} else {
+		G_UNLOCK(remmina_pref_store);
 	}
 
-	g_key_file_free(gkeyfile);
-
 	if (remmina_pref.secret == NULL)
 		remmina_pref_gen_secret();
 
@@ -704,12 +885,10 @@ gboolean remmina_pref_save(void)
 	}
 	GKeyFile *gkeyfile;
 	GError *error = NULL;
-	gchar *content;
-	gsize length;
-
-	gkeyfile = g_key_file_new();
 
-	g_key_file_load_from_file(gkeyfile, remmina_pref_file, G_KEY_FILE_NONE, NULL);
+	G_LOCK(remmina_pref_store);
+	remmina_pref_store_sync(TRUE);
+	gkeyfile = remmina_pref_store;
 
 	g_key_file_set_string(gkeyfile, "remmina_pref", "datadir_path", remmina_pref.datadir_path);
 	g_key_file_set_string(gkeyfile, "remmina_pref", "remmina_file_name", remmina_pref.remmina_file_name);
@@ -755,6 +934,8 @@ gboolean remmina_pref_save(void)
 	g_key_file_set_integer(gkeyfile, "remmina_pref", "ssh_tcp_keepintvl", remmina_pref.ssh_tcp_keepintvl);
 	g_key_file_set_integer(gkeyfile, "remmina_pref", "ssh_tcp_keepcnt", remmina_pref.ssh_tcp_keepcnt);
 	g_key_file_set_integer(gkeyfile, "remmina_pref", "ssh_tcp_usrtimeout", remmina_pref.ssh_tcp_usrtimeout);
+	g_key_file_set_integer(gkeyfile, "remmina_pref", "ssh_tunnel_buffer_size", remmina_pref.ssh_tunnel_buffer_size);
+	g_key_file_set_boolean(gkeyfile, "remmina_pref", "ssh_tunnel_stats", remmina_pref.ssh_tunnel_stats);
 	g_key_file_set_boolean(gkeyfile, "remmina_pref", "applet_new_ontop", remmina_pref.applet_new_ontop);
 	g_key_file_set_boolean(gkeyfile, "remmina_pref", "applet_hide_count", remmina_pref.applet_hide_count);
 	g_key_file_set_boolean(gkeyfile, "remmina_pref", "applet_enable_avahi", remmina_pref.applet_enable_avahi);
@@ -809,19 +990,20 @@ gboolean remmina_pref_save(void)
 	g_key_file_set_string(gkeyfile, "remmina", "name", "");
 	g_key_file_set_integer(gkeyfile, "remmina", "ignore-tls-errors", 1);
 
-	content = g_key_file_to_data(gkeyfile, &length, NULL);
-	g_file_set_contents(remmina_pref_file, content, length, &error);
+	/* An explicit save is written synchronously, together with any pending change */
+	if (remmina_pref_flush_source) {
+		g_source_remove(remmina_pref_flush_source);
+		remmina_pref_flush_source = 0;
+	}
+	remmina_pref_store_write(&error);
+	G_UNLOCK(remmina_pref_store);
 
 	if (error != NULL)
 	{
 		g_warning ("remmina_pref_save error: %s", error->message);
 		g_clear_error (&error);
-		g_key_file_free(gkeyfile);
-		g_free(content);
 		return FALSE;
 	}
-	g_key_file_free(gkeyfile);
-	g_free(content);
 	return TRUE;
 }
 
@@ -829,22 +1011,17 @@ void remmina_pref_add_recent(const gchar *protocol, const gchar *server)
 {
 	TRACE_CALL(__func__);
 	RemminaStringArray *array;
-	GKeyFile *gkeyfile;
 	gchar key[20];
 	gchar *val;
-	gchar *content;
-	gsize length;
 
 	if (remmina_pref.recent_maximum <= 0 || server == NULL || server[0] == 0)
 		return;
 
-	/* Load original value into memory */
-	gkeyfile = g_key_file_new();
-
-	g_key_file_load_from_file(gkeyfile, remmina_pref_file, G_KEY_FILE_NONE, NULL);
+	G_LOCK(remmina_pref_store);
+	remmina_pref_store_sync(FALSE);
 
 	g_snprintf(key, sizeof(key), "recent_%s", protocol);
-	array = remmina_string_array_new_from_allocated_string(g_key_file_get_string(gkeyfile, "remmina_pref", key, NULL));
+	array = remmina_string_array_new_from_allocated_string(g_key_file_get_string(remmina_pref_store, "remmina_pref", key, NULL));
 
 	/* Add the new value */
 	remmina_string_array_remove(array, server);
@@ -855,32 +1032,25 @@ void remmina_pref_add_recent(const gchar *protocol, const gchar *server)
 
 	/* Save */
 	val = remmina_string_array_to_string(array);
-	g_key_file_set_string(gkeyfile, "remmina_pref", key, val);
+	remmina_pref_store_set_string("remmina_pref", key, val);
+	G_UNLOCK(remmina_pref_store);
 	g_free(val);
-
-	content = g_key_file_to_data(gkeyfile, &length, NULL);
-	g_file_set_contents(remmina_pref_file, content, length, NULL);
-
-	g_key_file_free(gkeyfile);
-	g_free(content);
+	remmina_string_array_free(array);
 }
 
 gchar*
 remmina_pref_get_recent(const gchar *protocol)
 {
 	TRACE_CALL(__func__);
-	GKeyFile *gkeyfile;
 	gchar key[20];
 	gchar *val;
 
-	gkeyfile = g_key_file_new();
-
-	g_key_file_load_from_file(gkeyfile, remmina_pref_file, G_KEY_FILE_NONE, NULL);
-
 	g_snprintf(key, sizeof(key), "recent_%s", protocol);
-	val = g_key_file_get_string(gkeyfile, "remmina_pref", key, NULL);
 
-	g_key_file_free(gkeyfile);
+	G_LOCK(remmina_pref_store);
+	remmina_pref_store_sync(FALSE);
+	val = g_key_file_get_string(remmina_pref_store, "remmina_pref", key, NULL);
+	G_UNLOCK(remmina_pref_store);
 
 	return val;
 }
@@ -888,30 +1058,21 @@ remmina_pref_get_recent(const gchar *protocol)
 void remmina_pref_clear_recent(void)
 {
 	TRACE_CALL(__func__);
-	GKeyFile *gkeyfile;
 	gchar **keys;
 	gint i;
-	gchar *content;
-	gsize length;
-
-	gkeyfile = g_key_file_new();
 
-	g_key_file_load_from_file(gkeyfile, remmina_pref_file, G_KEY_FILE_NONE, NULL);
-	keys = g_key_file_get_keys(gkeyfile, "remmina_pref", NULL, NULL);
+	G_LOCK(remmina_pref_store);
+	remmina_pref_store_sync(FALSE);
+	keys = g_key_file_get_keys(remmina_pref_store, "remmina_pref", NULL, NULL);
 	if (keys) {
 		for (i = 0; keys[i]; i++) {
 			if (strncmp(keys[i], "recent_", 7) == 0) {
-				g_key_file_set_string(gkeyfile, "remmina_pref", keys[i], "");
+				remmina_pref_store_set_string("remmina_pref", keys[i], "");
 			}
 		}
 		g_strfreev(keys);
 	}
-
-	content = g_key_file_to_data(gkeyfile, &length, NULL);
-	g_file_set_contents(remmina_pref_file, content, length, NULL);
-
-	g_key_file_free(gkeyfile);
-	g_free(content);
+	G_UNLOCK(remmina_pref_store);
 }
 
 guint remmina_pref_keymap_get_keyval(const gchar *keymap, guint keyval)
@@ -1009,33 +1170,32 @@ gint remmina_pref_get_ssh_tcp_usrtimeout(void)
 	return remmina_pref.ssh_tcp_usrtimeout;
 }
 
-void remmina_pref_set_value(const gchar *key, const gchar *value)
+gint remmina_pref_get_ssh_tunnel_buffer_size(void)
 {
 	TRACE_CALL(__func__);
-	GKeyFile *gkeyfile;
-	gchar *content;
-	gsize length;
-
-	gkeyfile = g_key_file_new();
-	g_key_file_load_from_file(gkeyfile, remmina_pref_file, G_KEY_FILE_NONE, NULL);
-	g_key_file_set_string(gkeyfile, "remmina_pref", key, value);
-	content = g_key_file_to_data(gkeyfile, &length, NULL);
-	g_file_set_contents(remmina_pref_file, content, length, NULL);
+	/* Paranoid programming */
+	if (remmina_pref.ssh_tunnel_buffer_size < SSH_TUNNEL_BUFFER_SIZE_MIN)
+		return SSH_TUNNEL_BUFFER_SIZE_MIN;
+	return remmina_pref.ssh_tunnel_buffer_size;
+}
 
-	g_key_file_free(gkeyfile);
-	g_free(content);
+void remmina_pref_set_value(const gchar *key, const gchar *value)
+{
+	TRACE_CALL(__func__);
+	G_LOCK(remmina_pref_store);
+	remmina_pref_store_set_string("remmina_pref", key, value);
+	G_UNLOCK(remmina_pref_store);
 }
 
 gchar* remmina_pref_get_value(const gchar *key)
 {
 	TRACE_CALL(__func__);
-	GKeyFile *gkeyfile;
 	gchar *value;
 
-	gkeyfile = g_key_file_new();
-	g_key_file_load_from_file(gkeyfile, remmina_pref_file, G_KEY_FILE_NONE, NULL);
-	value = g_key_file_get_string(gkeyfile, "remmina_pref", key, NULL);
-	g_key_file_free(gkeyfile);
+	G_LOCK(remmina_pref_store);
+	remmina_pref_store_sync(FALSE);
+	value = g_key_file_get_string(remmina_pref_store, "remmina_pref", key, NULL);
+	G_UNLOCK(remmina_pref_store);
 
 	return value;
 }
@@ -1043,13 +1203,49 @@ gchar* remmina_pref_get_value(const gchar *key)
 gboolean remmina_pref_get_boolean(const gchar *key)
 {
 	TRACE_CALL(__func__);
-	GKeyFile *gkeyfile;
 	gboolean value;
 
-	gkeyfile = g_key_file_new();
-	g_key_file_load_from_file(gkeyfile, remmina_pref_file, G_KEY_FILE_NONE, NULL);
-	value = g_key_file_get_boolean(gkeyfile, "remmina_pref", key, NULL);
-	g_key_file_free(gkeyfile);
+	G_LOCK(remmina_pref_store);
+	remmina_pref_store_sync(FALSE);
+	value = g_key_file_get_boolean(remmina_pref_store, "remmina_pref", key, NULL);
+	G_UNLOCK(remmina_pref_store);
+
+	return value;
+}
+
+gint remmina_pref_get_integer(const gchar *key, gint default_value)
+{
+	TRACE_CALL(__func__);
+	GError *error = NULL;
+	gint value;
+
+	G_LOCK(remmina_pref_store);
+	remmina_pref_store_sync(FALSE);
+	value = g_key_file_get_integer(remmina_pref_store, "remmina_pref", key, &error);
+	G_UNLOCK(remmina_pref_store);
 
+	if (error) {
+		g_error_free(error);
+		return default_value;
+	}
 	return value;
 }
+
+void remmina_pref_set_boolean(const gchar *key, gboolean value)
+{
+	TRACE_CALL(__func__);
+	G_LOCK(remmina_pref_store);
+	remmina_pref_store_set_string("remmina_pref", key, value ? "true" : "false");
+	G_UNLOCK(remmina_pref_store);
+}
+
+void remmina_pref_set_integer(const gchar *key, gint value)
+{
+	TRACE_CALL(__func__);
+	gchar buf[16];
+
+	g_snprintf(buf, sizeof(buf), "%d", value);
+	G_LOCK(remmina_pref_store);
+	remmina_pref_store_set_string("remmina_pref", key, buf);
+	G_UNLOCK(remmina_pref_store);
+}
@@ -147,6 +147,8 @@ typedef struct _RemminaPref {
 	gint ssh_tcp_keepintvl;
 	gint ssh_tcp_keepcnt;
 	gint ssh_tcp_usrtimeout;
+	gint ssh_tunnel_buffer_size;
+	gboolean ssh_tunnel_stats;
 	/* In RemminaPrefDialog keyboard tab */
 	guint hostkey;
 	guint shortcutkey_fullscreen;
@@ -215,6 +217,8 @@ typedef struct _RemminaPref {
 #define SSH_SOCKET_TCP_KEEPINTVL 10
 #define SSH_SOCKET_TCP_KEEPCNT 3
 #define SSH_SOCKET_TCP_USER_TIMEOUT 60000 // 60 seconds
+#define SSH_TUNNEL_BUFFER_SIZE 65536 // Per channel and direction
+#define SSH_TUNNEL_BUFFER_SIZE_MIN 4096
 
 extern const gchar *default_resolutions;
 extern gchar *remmina_pref_file;
@@ -224,6 +228,7 @@ extern RemminaPref remmina_pref;
 void remmina_pref_init(void);
 gboolean remmina_pref_is_rw(void);
 gboolean remmina_pref_save(void);
+void remmina_pref_flush(void);
 
 void remmina_pref_add_recent(const gchar *protocol, const gchar *server);
 gchar* remmina_pref_get_recent(const gchar *protocol);
@@ -241,10 +246,14 @@ gint remmina_pref_get_ssh_tcp_keepidle(void);
 gint remmina_pref_get_ssh_tcp_keepintvl(void);
 gint remmina_pref_get_ssh_tcp_keepcnt(void);
 gint remmina_pref_get_ssh_tcp_usrtimeout(void);
+gint remmina_pref_get_ssh_tunnel_buffer_size(void);
 
 void remmina_pref_set_value(const gchar *key, const gchar *value);
 gchar* remmina_pref_get_value(const gchar *key);
 gboolean remmina_pref_get_boolean(const gchar *key);
+gint remmina_pref_get_integer(const gchar *key, gint default_value);
+void remmina_pref_set_boolean(const gchar *key, gboolean value);
+void remmina_pref_set_integer(const gchar *key, gint value);
 
 G_END_DECLS
 
@@ -71,6 +71,7 @@ struct _RemminaProtocolWidgetPriv {
 	gboolean has_error;
 	gchar* error_message;
 	RemminaSSHTunnel* ssh_tunnel;
+	RemminaSSHTunnelForward* ssh_forward;
 	RemminaTunnelInitFunc init_func;
 
 	GtkWidget* chat_window;
@@ -117,6 +118,7 @@ enum {
 	DESKTOP_RESIZE_SIGNAL,
 	UPDATE_ALIGN_SIGNAL,
 	UNLOCK_DYNRES_SIGNAL,
+	SCREENSHOT_READY_SIGNAL,
 	LAST_SIGNAL
 };
 
@@ -146,6 +148,9 @@ static void remmina_protocol_widget_class_init(RemminaProtocolWidgetClass *klass
 	remmina_protocol_widget_signals[UNLOCK_DYNRES_SIGNAL] = g_signal_new("unlock-dynres", G_TYPE_FROM_CLASS(klass),
 		G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION, G_STRUCT_OFFSET(RemminaProtocolWidgetClass, unlock_dynres), NULL, NULL,
 		g_cclosure_marshal_VOID__VOID, G_TYPE_NONE, 0);
+	remmina_protocol_widget_signals[SCREENSHOT_READY_SIGNAL] = g_signal_new("screenshot-ready", G_TYPE_FROM_CLASS(klass),
+		G_SIGNAL_RUN_LAST, G_STRUCT_OFFSET(RemminaProtocolWidgetClass, screenshot_ready), NULL, NULL,
+		g_cclosure_marshal_VOID__POINTER, G_TYPE_NONE, 1, G_TYPE_POINTER);
 }
 
 static void remmina_protocol_widget_destroy(RemminaProtocolWidget* gp, gpointer data)
@@ -190,7 +195,9 @@ static void remmina_protocol_widget_on_connected(RemminaProtocolWidget* gp, gpoi
 {
 	TRACE_CALL(__func__);
 #ifdef HAVE_LIBSSH
-	if (gp->priv->ssh_tunnel) {
+	if (gp->priv->ssh_forward) {
+		remmina_ssh_tunnel_forward_cancel_accept(gp->priv->ssh_tunnel, gp->priv->ssh_forward);
+	} else if (gp->priv->ssh_tunnel) {
 		remmina_ssh_tunnel_cancel_accept(gp->priv->ssh_tunnel);
 	}
 #endif
@@ -325,6 +332,20 @@ void remmina_protocol_widget_open_connection(RemminaProtocolWidget* gp)
 	remmina_protocol_widget_open_connection_real(gp);
 }
 
+#ifdef HAVE_LIBSSH
+/* Drop our SSH tunnel. A shared tunnel stays open for its other users. */
+static void remmina_protocol_widget_close_tunnel(RemminaProtocolWidget* gp)
+{
+	TRACE_CALL(__func__);
+	if (gp->priv->ssh_forward)
+		remmina_ssh_tunnel_forward_release(gp->priv->ssh_tunnel, gp->priv->ssh_forward);
+	else
+		remmina_ssh_tunnel_free(gp->priv->ssh_tunnel);
+	gp->priv->ssh_tunnel = NULL;
+	gp->priv->ssh_forward = NULL;
+}
+#endif
+
 gboolean remmina_protocol_widget_close_connection(RemminaProtocolWidget* gp)
 {
 	TRACE_CALL(__func__);
@@ -372,8 +393,8 @@ gboolean remmina_protocol_widget_close_connection(RemminaProtocolWidget* gp)
 
 #ifdef HAVE_LIBSSH
 	if (gp->priv->ssh_tunnel) {
-		remmina_ssh_tunnel_free(gp->priv->ssh_tunnel);
-		gp->priv->ssh_tunnel = NULL;
+		remmina_ssh_tunnel_log_stats(gp->priv->ssh_tunnel);
+		remmina_protocol_widget_close_tunnel(gp);
 	}
 #endif
 
@@ -389,21 +410,110 @@ gboolean remmina_protocol_widget_plugin_receives_keystrokes(RemminaProtocolWidge
 	return gp->priv->plugin->send_keystrokes ? TRUE : FALSE;
 }
 
+/* Cache of the shift level producing each keyval, rebuilt when the keymap changes */
+static GHashTable *keyval_levels = NULL;
+
+static void remmina_protocol_widget_keymap_changed(GdkKeymap *keymap, gpointer user_data)
+{
+	TRACE_CALL(__func__);
+	g_hash_table_remove_all(keyval_levels);
+}
+
+/* Get the shift level of the first keycode producing keyval, -1 if none */
+static gint remmina_protocol_widget_get_keyval_level(GdkKeymap *keymap, guint keyval)
+{
+	TRACE_CALL(__func__);
+	GdkKeymapKey *keys;
+	gint n_keys;
+	gpointer level;
+
+	if (!keyval_levels) {
+		keyval_levels = g_hash_table_new(g_direct_hash, g_direct_equal);
+		g_signal_connect(G_OBJECT(keymap), "keys-changed",
+				 G_CALLBACK(remmina_protocol_widget_keymap_changed), NULL);
+	}
+	/* Values are stored as level + 1, as NULL means not cached */
+	level = g_hash_table_lookup(keyval_levels, GUINT_TO_POINTER(keyval));
+	if (level)
+		return GPOINTER_TO_INT(level) - 1;
+
+	if (gdk_keymap_get_entries_for_keyval(keymap, keyval, &keys, &n_keys)) {
+		level = GINT_TO_POINTER(keys->level + 1);
+		g_free(keys);
+	} else {
+		level = GINT_TO_POINTER(0);
+	}
+	g_hash_table_insert(keyval_levels, GUINT_TO_POINTER(keyval), level);
+	return GPOINTER_TO_INT(level) - 1;
+}
+
+/* Send keyval as a keystroke, with the modifiers of its shift level */
+static void remmina_protocol_widget_send_keyval(RemminaProtocolWidget* gp, guint keyval, gint level)
+{
+	TRACE_CALL(__func__);
+	guint keyvals[3];
+	gint n_keys;
+
+	n_keys = 0;
+	if (level & 1)
+		keyvals[n_keys++] = GDK_KEY_Shift_L;
+	if (level & 2)
+		keyvals[n_keys++] = GDK_KEY_Alt_R;
+	keyvals[n_keys++] = keyval;
+	gp->priv->plugin->send_keystrokes(gp, keyvals, n_keys);
+}
+
+/* Send a plain character as a keystroke */
+static void remmina_protocol_widget_send_character(RemminaProtocolWidget* gp, GdkKeymap *keymap, gunichar character)
+{
+	TRACE_CALL(__func__);
+	guint keyval;
+	gint level;
+
+	keyval = gdk_unicode_to_keyval(character);
+	/* get keyval without modifications */
+	level = remmina_protocol_widget_get_keyval_level(keymap, keyval);
+	if (level < 0) {
+		g_warning("keyval 0x%04x has no keycode!", keyval);
+		return;
+	}
+	remmina_protocol_widget_send_keyval(gp, keyval, level);
+}
+
+/* Hand a run of plain characters to the plugin text injection, or type
+ * them one by one when the plugin cannot inject text right now */
+static void remmina_protocol_widget_send_text_run(RemminaProtocolWidget* gp, GdkKeymap *keymap, const gchar *start, const gchar *end)
+{
+	TRACE_CALL(__func__);
+	gchar *text;
+	const gchar *p;
+
+	if (start == end)
+		return;
+	text = g_strndup(start, end - start);
+	if (!gp->priv->plugin->send_text(gp, text)) {
+		for (p = text; *p; p = g_utf8_next_char(p))
+			remmina_protocol_widget_send_character(gp, keymap, g_utf8_get_char(p));
+	}
+	g_free(text);
+}
+
 /**
  * Send to the plugin some keystrokes.
+ *
+ * Plugins implementing send_text get whole runs of plain characters at once,
+ * the special characters (\n, \t, \b, \e) are always sent as keystrokes.
  */
 void remmina_protocol_widget_send_keystrokes(RemminaProtocolWidget* gp, GtkMenuItem *widget)
 {
 	TRACE_CALL(__func__);
 	gchar *keystrokes = g_object_get_data(G_OBJECT(widget), "keystrokes");
-	guint *keyvals;
 	gint i;
 	GdkKeymap *keymap = gdk_keymap_get_for_display(gdk_display_get_default());
 	gchar *iter = keystrokes;
+	gchar *run = keystrokes;
 	gunichar character;
 	guint keyval;
-	GdkKeymapKey *keys;
-	gint n_keys;
 	/* Single keystroke replace */
 	typedef struct _KeystrokeReplace {
 		gchar *search;
@@ -428,46 +538,38 @@ void remmina_protocol_widget_send_keystrokes(RemminaProtocolWidget* gp, GtkMenuI
 				keystrokes_replaces[i].search,
 				keystrokes_replaces[i].replace);
 		}
-		keyvals = (guint*)g_malloc(strlen(keystrokes));
 		while (TRUE) {
 			/* Process each character in the keystrokes */
 			character = g_utf8_get_char_validated(iter, -1);
-			if (character == 0)
+			if (character == 0 || character == (gunichar)-1 || character == (gunichar)-2)
 				break;
-			keyval = gdk_unicode_to_keyval(character);
+			keyval = 0;
 			/* Replace all the special character with its keyval */
 			for (i = 0; keystrokes_replaces[i].replace; i++) {
 				if (character == keystrokes_replaces[i].replace[0]) {
-					keys = g_new0(GdkKeymapKey, 1);
 					keyval = keystrokes_replaces[i].keyval;
 					/* A special character was generated, no keyval lookup needed */
 					character = 0;
 					break;
 				}
 			}
-			/* Decode character if it’s not a special character */
-			if (character) {
-				/* get keyval without modifications */
-				if (!gdk_keymap_get_entries_for_keyval(keymap, keyval, &keys, &n_keys)) {
-					g_warning("keyval 0x%04x has no keycode!", keyval);
-					iter = g_utf8_find_next_char(iter, NULL);
-					continue;
-				}
+			/* Plain characters are batched when the plugin can inject text */
+			if (character && gp->priv->plugin->send_text) {
+				iter = g_utf8_find_next_char(iter, NULL);
+				continue;
 			}
-			/* Add modifier keys */
-			n_keys = 0;
-			if (keys->level & 1)
-				keyvals[n_keys++] = GDK_KEY_Shift_L;
-			if (keys->level & 2)
-				keyvals[n_keys++] = GDK_KEY_Alt_R;
-			keyvals[n_keys++] = keyval;
+			if (gp->priv->plugin->send_text)
+				remmina_protocol_widget_send_text_run(gp, keymap, run, iter);
 			/* Send keystroke to the plugin */
-			gp->priv->plugin->send_keystrokes(gp, keyvals, n_keys);
-			g_free(keys);
+			if (character)
+				remmina_protocol_widget_send_character(gp, keymap, character);
+			else
+				remmina_protocol_widget_send_keyval(gp, keyval, 0);
 			/* Process next character in the keystrokes */
-			iter = g_utf8_find_next_char(iter, NULL);
+			iter = run = g_utf8_find_next_char(iter, NULL);
 		}
-		g_free(keyvals);
+		if (gp->priv->plugin->send_text)
+			remmina_protocol_widget_send_text_run(gp, keymap, run, iter);
 	}
 	g_free(keystrokes);
 	return;
@@ -484,6 +586,14 @@ gboolean remmina_protocol_widget_plugin_screenshot(RemminaProtocolWidget* gp, Re
 
 }
 
+/* Called on the main thread by plugins whose get_plugin_screenshot() returned
+ * TRUE without a buffer. The buffer stays owned by the plugin. */
+void remmina_protocol_widget_screenshot_ready(RemminaProtocolWidget* gp, RemminaPluginScreenshotData *rpsd)
+{
+	TRACE_CALL(__func__);
+	g_signal_emit(G_OBJECT(gp), remmina_protocol_widget_signals[SCREENSHOT_READY_SIGNAL], 0, rpsd);
+}
+
 void remmina_protocol_widget_emit_signal(RemminaProtocolWidget* gp, const gchar* signal_name)
 {
 	TRACE_CALL(__func__);
@@ -728,6 +838,7 @@ gchar* remmina_protocol_widget_start_direct_tunnel(RemminaProtocolWidget* gp, gi
 
 #ifdef HAVE_LIBSSH
 	RemminaMessagePanel *mp;
+	RemminaSSHTunnel *tunnel;
 
 	if (!remmina_file_get_int(gp->priv->remmina_file, "ssh_enabled", FALSE)) {
 		dest = g_strdup_printf("[%s]:%i", host, port);
@@ -735,13 +846,17 @@ gchar* remmina_protocol_widget_start_direct_tunnel(RemminaProtocolWidget* gp, gi
 		return dest;
 	}
 
+	/* Look for a session to the same SSH server first, so that a
+	 * reconnection does not drop a session we could use again */
+	tunnel = remmina_ssh_tunnel_pool_get(gp->priv->remmina_file);
+
 	/* If we have a previous SSH tunnel, destroy it */
-	if (gp->priv->ssh_tunnel) {
-		remmina_ssh_tunnel_free(gp->priv->ssh_tunnel);
-		gp->priv->ssh_tunnel = NULL;
-	}
+	if (gp->priv->ssh_tunnel)
+		remmina_protocol_widget_close_tunnel(gp);
 
-	if (!remmina_protocol_widget_init_tunnel(gp)) {
+	if (tunnel) {
+		gp->priv->ssh_tunnel = tunnel;
+	} else if (!remmina_protocol_widget_init_tunnel(gp)) {
 		g_free(host);
 		return NULL;
 	}
@@ -755,16 +870,24 @@ gchar* remmina_protocol_widget_start_direct_tunnel(RemminaProtocolWidget* gp, gi
 		host = g_strdup("127.0.0.1");
 	}
 
-	if (!remmina_ssh_tunnel_open(gp->priv->ssh_tunnel, host, port, remmina_pref.sshtunnel_port)) {
+	/* Every connection gets its own direct-tcpip forward on a free local
+	 * port, the SSH session is shared */
+	gp->priv->ssh_forward = remmina_ssh_tunnel_forward_open(gp->priv->ssh_tunnel, host, port);
+	if (!gp->priv->ssh_forward) {
 		g_free(host);
 		remmina_protocol_widget_set_error(gp, REMMINA_SSH(gp->priv->ssh_tunnel)->error);
+		/* Do not free a session which other connections still use */
+		remmina_ssh_tunnel_forward_release(gp->priv->ssh_tunnel, NULL);
+		gp->priv->ssh_tunnel = NULL;
 		return NULL;
 	}
 	g_free(host);
+	if (!tunnel)
+		remmina_ssh_tunnel_pool_add(gp->priv->ssh_tunnel);
 
 	remmina_protocol_widget_mpdestroy(gp->cnnobj, mp);
 
-	return g_strdup_printf("127.0.0.1:%i", remmina_pref.sshtunnel_port);
+	return g_strdup_printf("127.0.0.1:%i", remmina_ssh_tunnel_forward_get_localport(gp->priv->ssh_forward));
 
 #else
 
@@ -961,6 +1084,27 @@ void remmina_protocol_widget_set_display(RemminaProtocolWidget* gp, gint display
 #endif
 }
 
+/* Get the traffic counters of the SSH tunnel of the connection, if any,
+ * see remmina_ssh_tunnel_get_stats() */
+gboolean remmina_protocol_widget_get_tunnel_stats(RemminaProtocolWidget* gp, RemminaSSHTunnelStats *total, GArray *channels)
+{
+	TRACE_CALL(__func__);
+#ifdef HAVE_LIBSSH
+	if (gp->priv->ssh_tunnel)
+		return remmina_ssh_tunnel_get_stats(gp->priv->ssh_tunnel, total, channels);
+#endif
+	return FALSE;
+}
+
+void remmina_protocol_widget_log_tunnel_stats(RemminaProtocolWidget* gp)
+{
+	TRACE_CALL(__func__);
+#ifdef HAVE_LIBSSH
+	if (gp->priv->ssh_tunnel)
+		remmina_ssh_tunnel_log_stats(gp->priv->ssh_tunnel);
+#endif
+}
+
 gint remmina_protocol_widget_get_profile_remote_width(RemminaProtocolWidget* gp)
 {
 	TRACE_CALL(__func__);
@@ -68,6 +68,7 @@ struct _RemminaProtocolWidgetClass {
 	void (*desktop_resize)(RemminaProtocolWidget *gp);
 	void (*update_align)(RemminaProtocolWidget *gp);
 	void (*unlock_dynres)(RemminaProtocolWidget *gp);
+	void (*screenshot_ready)(RemminaProtocolWidget *gp, RemminaPluginScreenshotData *rpsd);
 };
 
 GType remmina_protocol_widget_get_type(void)
@@ -119,6 +120,9 @@ gchar* remmina_protocol_widget_start_direct_tunnel(RemminaProtocolWidget *gp, gi
 gboolean remmina_protocol_widget_start_reverse_tunnel(RemminaProtocolWidget *gp, gint local_port);
 gboolean remmina_protocol_widget_start_xport_tunnel(RemminaProtocolWidget *gp, RemminaXPortTunnelInitFunc init_func);
 void remmina_protocol_widget_set_display(RemminaProtocolWidget *gp, gint display);
+/* SSH tunnel traffic counters, enabled by the ssh_tunnel_stats preference */
+gboolean remmina_protocol_widget_get_tunnel_stats(RemminaProtocolWidget *gp, RemminaSSHTunnelStats *total, GArray *channels);
+void remmina_protocol_widget_log_tunnel_stats(RemminaProtocolWidget *gp);
 
 /* Extension for remmina_protocol_widget_panel_authuserpwd() not currently exported to plugins */
 gint remmina_protocol_widget_panel_authuserpwd_ssh_tunnel(RemminaProtocolWidget* gp, gboolean want_domain, gboolean allow_password_saving);
@@ -160,6 +164,8 @@ gboolean remmina_protocol_widget_plugin_receives_keystrokes(RemminaProtocolWidge
 void remmina_protocol_widget_send_keystrokes(RemminaProtocolWidget* gp, GtkMenuItem *widget);
 /* Take screenshot of plugin */
 gboolean remmina_protocol_widget_plugin_screenshot(RemminaProtocolWidget* gp, RemminaPluginScreenshotData *rpsd);
+/* Deliver a screenshot the plugin took asynchronously, rpsd is NULL on failure */
+void remmina_protocol_widget_screenshot_ready(RemminaProtocolWidget* gp, RemminaPluginScreenshotData *rpsd);
 
 void remmina_protocol_widget_update_remote_resolution(RemminaProtocolWidget* gp);
 
@@ -633,74 +633,262 @@ remmina_sftp_client_thread_main(gpointer data)
 	return NULL;
 }
 
-/* ------------------------ The SFTP Client routines ----------------------------- */
+/* ------------------------ The Directory Listing Thread ------------------------- */
+
+/* Entries are handed to the main thread in batches, so a huge directory
+ * does not flood the main loop with one idle callback per entry */
+#define LISTING_BATCH_SIZE 1024
+#define LISTING_BATCH_INTERVAL_US (100 * 1000)
+
+typedef struct _RemminaSFTPClientListing {
+	RemminaSFTPClient *	client;
+	guint			generation;
+	/* Requested directory in the request, then the canonical directory
+	 * in the first message sent back to the main thread */
+	gchar *			dir;
+	RemminaFTPFileBatch *	batch;
+	gchar *			error;
+	gboolean		done;
+} RemminaSFTPClientListing;
 
 static void
-remmina_sftp_client_destroy(RemminaSFTPClient *client, gpointer data)
+remmina_sftp_client_listing_free(RemminaSFTPClientListing *listing)
 {
 	TRACE_CALL(__func__);
-	if (client->sftp) {
-		remmina_sftp_free(client->sftp);
-		client->sftp = NULL;
+	g_object_unref(listing->client);
+	g_free(listing->dir);
+	remmina_ftp_file_batch_free(listing->batch);
+	g_free(listing->error);
+	g_free(listing);
+}
+
+static void remmina_sftp_client_listing_start(RemminaSFTPClient *client, gchar *dir);
+
+static gboolean
+remmina_sftp_client_listing_dispatch(RemminaSFTPClientListing *listing)
+{
+	TRACE_CALL(__func__);
+	RemminaSFTPClient *client = listing->client;
+	GtkWidget *dialog;
+	gchar *dir;
+
+	/* The last result of a listing: its thread no longer uses the session */
+	if (listing->done) {
+		client->listing_thread = 0;
+		client->listing_abort = FALSE;
+		if (client->listing_free_sftp) {
+			client->listing_free_sftp = FALSE;
+			remmina_sftp_free(client->sftp);
+			client->sftp = NULL;
+		} else if (client->listing_next_dir) {
+			dir = client->listing_next_dir;
+			client->listing_next_dir = NULL;
+			remmina_sftp_client_listing_start(client, dir);
+		} else {
+			SET_CURSOR(NULL);
+		}
 	}
-	client->thread_abort = TRUE;
-	/* We will wait for the thread to quit itself, and hopefully the thread is handling things correctly */
-	while (client->thread) {
-		/* gdk_threads_leave (); */
-		sleep(1);
-		/* gdk_threads_enter (); */
+
+	/* A newer listing was started, or the client was destroyed */
+	if (listing->generation != client->listing_generation) {
+		remmina_sftp_client_listing_free(listing);
+		return FALSE;
 	}
+
+	if (listing->dir) {
+		remmina_ftp_client_clear_file_list(REMMINA_FTP_CLIENT(client));
+		remmina_ftp_client_set_dir(REMMINA_FTP_CLIENT(client), listing->dir);
+	}
+	if (listing->batch)
+		remmina_ftp_client_add_files(REMMINA_FTP_CLIENT(client), listing->batch);
+
+	if (listing->done) {
+		remmina_ftp_client_sort_file_list(REMMINA_FTP_CLIENT(client));
+		SET_CURSOR(NULL);
+		if (listing->error) {
+			dialog = gtk_message_dialog_new(GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(client))),
+							GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+							"%s", listing->error);
+			gtk_widget_show(dialog);
+			g_signal_connect(G_OBJECT(dialog), "response", G_CALLBACK(gtk_widget_destroy), NULL);
+		}
+	}
+
+	remmina_sftp_client_listing_free(listing);
+	return FALSE;
+}
+
+static void
+remmina_sftp_client_listing_post(RemminaSFTPClient *client, guint generation, gchar *dir,
+				 RemminaFTPFileBatch *batch, gchar *error, gboolean done)
+{
+	TRACE_CALL(__func__);
+	RemminaSFTPClientListing *listing;
+
+	listing = g_new0(RemminaSFTPClientListing, 1);
+	listing->client = g_object_ref(client);
+	listing->generation = generation;
+	listing->dir = dir;
+	listing->batch = batch;
+	listing->error = error;
+	listing->done = done;
+	IDLE_ADD((GSourceFunc)remmina_sftp_client_listing_dispatch, listing);
 }
 
-static sftp_dir
-remmina_sftp_client_sftp_session_opendir(RemminaSFTPClient *client, const gchar *dir)
+static gpointer
+remmina_sftp_client_listing_thread(gpointer data)
 {
 	TRACE_CALL(__func__);
+	RemminaSFTPClientListing *request = (RemminaSFTPClientListing *)data;
+	RemminaSFTPClient *client = request->client;
+	RemminaSFTP *sftp = client->sftp;
+	guint generation = request->generation;
+	RemminaFTPFileBatch *batch;
 	sftp_dir sftpdir;
-	GtkWidget *dialog;
+	sftp_attributes sftpattr;
+	gchar *newdir;
+	gchar *newdir_conv;
+	gchar *tmp;
+	gint type;
+	gint64 last_post;
 
-	sftpdir = sftp_opendir(client->sftp->sftp_sess, (gchar *)dir);
+	/* The session is only locked for one request at a time, so the main
+	 * thread never waits for more than one round trip */
+	tmp = remmina_ssh_unconvert(REMMINA_SSH(sftp), request->dir);
+	LOCK_SSH(sftp)
+	newdir_conv = sftp_canonicalize_path(sftp->sftp_sess, tmp);
+	g_free(tmp);
+	newdir = remmina_ssh_convert(REMMINA_SSH(sftp), newdir_conv);
+	if (!newdir) {
+		tmp = g_strdup_printf(_("Failed to open directory %s. %s"), request->dir,
+				      ssh_get_error(REMMINA_SSH(sftp)->session));
+		UNLOCK_SSH(sftp)
+		remmina_sftp_client_listing_post(client, generation, NULL, NULL, tmp, TRUE);
+		g_free(newdir_conv);
+		remmina_sftp_client_listing_free(request);
+		return NULL;
+	}
+
+	sftpdir = sftp_opendir(sftp->sftp_sess, newdir_conv);
+	g_free(newdir_conv);
 	if (!sftpdir) {
-		dialog = gtk_message_dialog_new(GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(client))),
-						GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
-						_("Failed to open directory %s. %s"), dir,
-						ssh_get_error(REMMINA_SSH(client->sftp)->session));
-		gtk_dialog_run(GTK_DIALOG(dialog));
-		gtk_widget_destroy(dialog);
+		tmp = g_strdup_printf(_("Failed to open directory %s. %s"), newdir,
+				      ssh_get_error(REMMINA_SSH(sftp)->session));
+		UNLOCK_SSH(sftp)
+		remmina_sftp_client_listing_post(client, generation, NULL, NULL, tmp, TRUE);
+		g_free(newdir);
+		remmina_sftp_client_listing_free(request);
 		return NULL;
 	}
-	return sftpdir;
+	UNLOCK_SSH(sftp)
+
+	/* The directory is readable: let the main thread switch to it */
+	remmina_sftp_client_listing_post(client, generation, newdir, NULL, NULL, FALSE);
+
+	batch = remmina_ftp_file_batch_new();
+	last_post = g_get_monotonic_time();
+	while (!client->listing_abort) {
+		LOCK_SSH(sftp)
+		sftpattr = sftp_readdir(sftp->sftp_sess, sftpdir);
+		UNLOCK_SSH(sftp)
+		if (!sftpattr)
+			break;
+		if (g_strcmp0(sftpattr->name, ".") != 0 &&
+		    g_strcmp0(sftpattr->name, "..") != 0) {
+			GET_SFTPATTR_TYPE(sftpattr, type);
+
+			tmp = remmina_ssh_convert(REMMINA_SSH(sftp), sftpattr->name);
+			remmina_ftp_file_batch_add(batch, type, tmp, (gfloat)sftpattr->size,
+						   sftpattr->owner, sftpattr->group, sftpattr->permissions);
+			g_free(tmp);
+		}
+		sftp_attributes_free(sftpattr);
+
+		if (batch->entries->len >= LISTING_BATCH_SIZE ||
+		    g_get_monotonic_time() - last_post >= LISTING_BATCH_INTERVAL_US) {
+			remmina_sftp_client_listing_post(client, generation, NULL, batch, NULL, FALSE);
+			batch = remmina_ftp_file_batch_new();
+			last_post = g_get_monotonic_time();
+		}
+	}
+
+	LOCK_SSH(sftp)
+	if (!client->listing_abort && !sftp_dir_eof(sftpdir))
+		tmp = g_strdup_printf(_("Failed reading directory. %s"), ssh_get_error(REMMINA_SSH(sftp)->session));
+	else
+		tmp = NULL;
+	sftp_closedir(sftpdir);
+	UNLOCK_SSH(sftp)
+
+	remmina_sftp_client_listing_post(client, generation, NULL, batch, tmp, TRUE);
+	remmina_sftp_client_listing_free(request);
+	return NULL;
+}
+
+/* List dir in a new thread, the main thread only receives batches of entries */
+static void
+remmina_sftp_client_listing_start(RemminaSFTPClient *client, gchar *dir)
+{
+	TRACE_CALL(__func__);
+	RemminaSFTPClientListing *request;
+
+	request = g_new0(RemminaSFTPClientListing, 1);
+	request->client = g_object_ref(client);
+	request->generation = client->listing_generation;
+	request->dir = dir;
+
+	if (pthread_create(&client->listing_thread, NULL, remmina_sftp_client_listing_thread, request)) {
+		client->listing_thread = 0;
+		SET_CURSOR(NULL);
+		remmina_sftp_client_listing_free(request);
+		return;
+	}
+	pthread_detach(client->listing_thread);
 }
 
-static gboolean
-remmina_sftp_client_sftp_session_closedir(RemminaSFTPClient *client, sftp_dir sftpdir)
+/* Ask the listing thread, if any, to stop at its next entry. It is not
+ * waited for: client->sftp must be used under LOCK_SSH() meanwhile */
+static void
+remmina_sftp_client_listing_cancel(RemminaSFTPClient *client)
 {
 	TRACE_CALL(__func__);
-	GtkWidget *dialog;
+	/* Results still queued in the main loop will be discarded */
+	client->listing_generation++;
+	g_free(client->listing_next_dir);
+	client->listing_next_dir = NULL;
+	if (client->listing_thread)
+		client->listing_abort = TRUE;
+}
 
-	if (!sftp_dir_eof(sftpdir)) {
-		dialog = gtk_message_dialog_new(GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(client))),
-						GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
-						_("Failed reading directory. %s"), ssh_get_error(REMMINA_SSH(client->sftp)->session));
-		gtk_dialog_run(GTK_DIALOG(dialog));
-		gtk_widget_destroy(dialog);
-		return FALSE;
+/* ------------------------ The SFTP Client routines ----------------------------- */
+
+static void
+remmina_sftp_client_destroy(RemminaSFTPClient *client, gpointer data)
+{
+	TRACE_CALL(__func__);
+	remmina_sftp_client_listing_cancel(client);
+	if (client->listing_thread) {
+		/* Freed when the listing thread is reaped */
+		client->listing_free_sftp = TRUE;
+	} else if (client->sftp) {
+		remmina_sftp_free(client->sftp);
+		client->sftp = NULL;
+	}
+	client->thread_abort = TRUE;
+	/* We will wait for the thread to quit itself, and hopefully the thread is handling things correctly */
+	while (client->thread) {
+		/* gdk_threads_leave (); */
+		sleep(1);
+		/* gdk_threads_enter (); */
 	}
-	sftp_closedir(sftpdir);
-	return TRUE;
 }
 
 static void
 remmina_sftp_client_on_opendir(RemminaSFTPClient *client, gchar *dir, gpointer data)
 {
 	TRACE_CALL(__func__);
-	sftp_dir sftpdir;
-	sftp_attributes sftpattr;
-	GtkWidget *dialog;
 	gchar *newdir;
-	gchar *newdir_conv;
 	gchar *tmp;
-	gint type;
 
 	if (client->sftp == NULL) return;
 
@@ -718,53 +906,15 @@ remmina_sftp_client_on_opendir(RemminaSFTPClient *client, gchar *dir, gpointer d
 		}
 	}
 
-	tmp = remmina_ssh_unconvert(REMMINA_SSH(client->sftp), newdir);
-	newdir_conv = sftp_canonicalize_path(client->sftp->sftp_sess, tmp);
-	g_free(tmp);
-	g_free(newdir);
-	newdir = remmina_ssh_convert(REMMINA_SSH(client->sftp), newdir_conv);
-	if (!newdir) {
-		dialog = gtk_message_dialog_new(NULL,
-						GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
-						_("Failed to open directory %s. %s"), dir,
-						ssh_get_error(REMMINA_SSH(client->sftp)->session));
-		gtk_widget_show(dialog);
-		g_signal_connect(G_OBJECT(dialog), "response", G_CALLBACK(gtk_widget_destroy), NULL);
-		g_free(newdir_conv);
-		return;
-	}
+	remmina_sftp_client_listing_cancel(client);
 
-	sftpdir = remmina_sftp_client_sftp_session_opendir(client, newdir_conv);
-	g_free(newdir_conv);
-	if (!sftpdir) {
-		g_free(newdir);
+	SET_CURSOR(gdk_cursor_new_for_display(gdk_display_get_default(), GDK_WATCH));
+	if (client->listing_thread) {
+		/* Started when the running listing is reaped */
+		client->listing_next_dir = newdir;
 		return;
 	}
-
-	remmina_ftp_client_clear_file_list(REMMINA_FTP_CLIENT(client));
-
-	while ((sftpattr = sftp_readdir(client->sftp->sftp_sess, sftpdir))) {
-		if (g_strcmp0(sftpattr->name, ".") != 0 &&
-		    g_strcmp0(sftpattr->name, "..") != 0) {
-			GET_SFTPATTR_TYPE(sftpattr, type);
-
-			tmp = remmina_ssh_convert(REMMINA_SSH(client->sftp), sftpattr->name);
-			remmina_ftp_client_add_file(REMMINA_FTP_CLIENT(client),
-						    REMMINA_FTP_FILE_COLUMN_TYPE, type,
-						    REMMINA_FTP_FILE_COLUMN_NAME, tmp,
-						    REMMINA_FTP_FILE_COLUMN_SIZE, (gfloat)sftpattr->size,
-						    REMMINA_FTP_FILE_COLUMN_USER, sftpattr->owner,
-						    REMMINA_FTP_FILE_COLUMN_GROUP, sftpattr->group,
-						    REMMINA_FTP_FILE_COLUMN_PERMISSION, sftpattr->permissions,
-						    -1);
-			g_free(tmp);
-		}
-		sftp_attributes_free(sftpattr);
-	}
-	remmina_sftp_client_sftp_session_closedir(client, sftpdir);
-
-	remmina_ftp_client_set_dir(REMMINA_FTP_CLIENT(client), newdir);
-	g_free(newdir);
+	remmina_sftp_client_listing_start(client, newdir);
 }
 
 static void
@@ -807,7 +957,10 @@ remmina_sftp_client_on_deletefile(RemminaSFTPClient *client, gint type, gchar *n
 	gint ret = 0;
 	gchar *tmp;
 
+	remmina_sftp_client_listing_cancel(client);
+
 	tmp = remmina_ssh_unconvert(REMMINA_SSH(client->sftp), name);
+	LOCK_SSH(client->sftp)
 	switch (type) {
 	case REMMINA_FTP_FILE_TYPE_DIR:
 		ret = sftp_rmdir(client->sftp->sftp_sess, tmp);
@@ -818,12 +971,15 @@ remmina_sftp_client_on_deletefile(RemminaSFTPClient *client, gint type, gchar *n
 		break;
 	}
 	g_free(tmp);
+	tmp = (ret != 0) ? g_strdup(ssh_get_error(REMMINA_SSH(client->sftp)->session)) : NULL;
+	UNLOCK_SSH(client->sftp)
 
 	if (ret != 0) {
 		dialog = gtk_message_dialog_new(GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(client))),
 						GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
 						_("Failed to delete '%s'. %s"),
-						name, ssh_get_error(REMMINA_SSH(client->sftp)->session));
+						name, tmp);
+		g_free(tmp);
 		gtk_dialog_run(GTK_DIALOG(dialog));
 		gtk_widget_destroy(dialog);
 		return FALSE;
@@ -839,6 +995,11 @@ remmina_sftp_client_init(RemminaSFTPClient *client)
 	client->thread = 0;
 	client->taskid = 0;
 	client->thread_abort = FALSE;
+	client->listing_thread = 0;
+	client->listing_abort = FALSE;
+	client->listing_generation = 0;
+	client->listing_next_dir = NULL;
+	client->listing_free_sftp = FALSE;
 
 	/* Setup the internal signals */
 	g_signal_connect(G_OBJECT(client), "destroy",
@@ -858,15 +1019,9 @@ remmina_sftp_client_refresh(RemminaSFTPClient *client)
 {
 	TRACE_CALL(__func__);
 
-	GdkDisplay *display = gdk_display_get_default();
-
-	SET_CURSOR(gdk_cursor_new_for_display(display, GDK_WATCH));
-	gdk_display_flush(display);
-
+	/* The cursor is reset when the listing thread is done */
 	remmina_sftp_client_on_opendir(client, ".", NULL);
 
-	SET_CURSOR(NULL);
-
 	return FALSE;
 }
 
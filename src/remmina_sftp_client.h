@@ -61,6 +61,17 @@ typedef struct _RemminaSFTPClient {
 	pthread_t		thread;
 	gint			taskid;
 	gboolean		thread_abort;
+
+	/* Directory listing thread, detached. It shares the sftp session with
+	 * the main thread under the session lock, and is reaped by the main
+	 * thread when its last result is dispatched */
+	pthread_t		listing_thread;
+	gboolean		listing_abort;
+	guint			listing_generation;
+	/* Directory to list once the running listing has stopped */
+	gchar *			listing_next_dir;
+	/* Free sftp once the running listing has stopped */
+	gboolean		listing_free_sftp;
 } RemminaSFTPClient;
 
 typedef struct _RemminaSFTPClientClass {
@@ -47,10 +47,12 @@
 #include <gtk/gtk.h>
 #include <glib/gi18n.h>
 #include <stdlib.h>
+#include <string.h>
 #include <signal.h>
 #include <time.h>
 #include <sys/types.h>
 #include <pthread.h>
+#include <sys/uio.h>
 #ifdef HAVE_NETDB_H
 #include <netdb.h>
 #endif
@@ -104,9 +106,6 @@
 *                           SSH Base                                          *
 *-----------------------------------------------------------------------------*/
 
-#define LOCK_SSH(ssh) pthread_mutex_lock(&REMMINA_SSH(ssh)->ssh_mutex);
-#define UNLOCK_SSH(ssh) pthread_mutex_unlock(&REMMINA_SSH(ssh)->ssh_mutex);
-
 static const gchar *common_identities[] =
 {
 	".ssh/id_ed25519",
@@ -798,33 +797,53 @@ remmina_ssh_free(RemminaSSH *ssh)
 /*-----------------------------------------------------------------------------*
 *                           SSH Tunnel                                        *
 *-----------------------------------------------------------------------------*/
-struct _RemminaSSHTunnelBuffer {
-	gchar * data;
-	gchar * ptr;
-	ssize_t len;
+/* Update a counter of channel n, at the cost of a single test when counters are disabled */
+#define TUNNEL_STAT_ADD(tunnel, n, field, value) \
+	do { \
+		if (G_UNLIKELY((tunnel)->stats_enabled)) \
+			(tunnel)->channelstats[n].field += (value); \
+	} while (0)
+
+#define TUNNEL_STAT_MAX(tunnel, n, field, value) \
+	do { \
+		if (G_UNLIKELY((tunnel)->stats_enabled) && (value) > (tunnel)->channelstats[n].field) \
+			(tunnel)->channelstats[n].field = (value); \
+	} while (0)
+
+/* A local listener of a shared tunnel. The flags are set atomically by
+ * other threads, the tunnel thread does the actual work. */
+struct _RemminaSSHTunnelForward {
+	gint		server_sock;
+	gchar *		dest;
+	gint		port;
+	gint		localport;
+	gint		accept_cancelled;
+	gint		closing;
 };
 
-static RemminaSSHTunnelBuffer *
-remmina_ssh_tunnel_buffer_new(ssize_t len)
-{
-	TRACE_CALL(__func__);
-	RemminaSSHTunnelBuffer *buffer;
+/* A forward with a pending local connection, copied out of the forwards
+ * array so it can be accepted without holding forwards_mutex */
+typedef struct _RemminaSSHTunnelReadyForward {
+	RemminaSSHTunnelForward *	forward;
+	gint				server_sock;
+	gchar *				dest;
+	gint				port;
+} RemminaSSHTunnelReadyForward;
 
-	buffer = g_new(RemminaSSHTunnelBuffer, 1);
-	buffer->data = (gchar *)g_malloc(len);
-	buffer->ptr = buffer->data;
-	buffer->len = len;
-	return buffer;
-}
+/* Shared tunnels by pool key */
+static GHashTable *remmina_ssh_tunnel_pool = NULL;
+G_LOCK_DEFINE_STATIC(remmina_ssh_tunnel_pool);
 
+/* Stop handing out tunnel to new connections, its users keep their reference */
 static void
-remmina_ssh_tunnel_buffer_free(RemminaSSHTunnelBuffer *buffer)
+remmina_ssh_tunnel_pool_retire(RemminaSSHTunnel *tunnel)
 {
 	TRACE_CALL(__func__);
-	if (buffer) {
-		g_free(buffer->data);
-		g_free(buffer);
-	}
+	G_LOCK(remmina_ssh_tunnel_pool);
+	if (tunnel->pool_key && remmina_ssh_tunnel_pool &&
+	    g_hash_table_lookup(remmina_ssh_tunnel_pool, tunnel->pool_key) == tunnel)
+		g_hash_table_remove(remmina_ssh_tunnel_pool, tunnel->pool_key);
+	G_UNLOCK(remmina_ssh_tunnel_pool);
 }
 
 RemminaSSHTunnel *
@@ -840,7 +859,10 @@ remmina_ssh_tunnel_new_from_file(RemminaFile *remminafile)
 	tunnel->tunnel_type = -1;
 	tunnel->channels = NULL;
 	tunnel->sockets = NULL;
+	tunnel->channelforwards = NULL;
 	tunnel->socketbuffers = NULL;
+	tunnel->channelbuffers = NULL;
+	tunnel->channelstats = NULL;
 	tunnel->num_channels = 0;
 	tunnel->max_channels = 0;
 	tunnel->x11_channel = NULL;
@@ -849,28 +871,50 @@ remmina_ssh_tunnel_new_from_file(RemminaFile *remminafile)
 	tunnel->server_sock = -1;
 	tunnel->dest = NULL;
 	tunnel->port = 0;
-	tunnel->buffer = NULL;
-	tunnel->buffer_len = 0;
+	tunnel->buffer_size = remmina_pref_get_ssh_tunnel_buffer_size();
+	tunnel->channels_in = NULL;
 	tunnel->channels_out = NULL;
+	tunnel->stats_enabled = remmina_pref.ssh_tunnel_stats;
+	memset(&tunnel->stats, 0, sizeof(RemminaSSHTunnelStats));
+	pthread_mutex_init(&tunnel->stats_mutex, NULL);
 	tunnel->remotedisplay = 0;
 	tunnel->localdisplay = NULL;
 	tunnel->init_func = NULL;
 	tunnel->connect_func = NULL;
 	tunnel->disconnect_func = NULL;
 	tunnel->callback_data = NULL;
+	tunnel->refcount = 1;
+	tunnel->pool_key = NULL;
+	tunnel->forwards = NULL;
+	pthread_mutex_init(&tunnel->forwards_mutex, NULL);
 
 	return tunnel;
 }
 
+static void
+remmina_ssh_tunnel_stats_merge(RemminaSSHTunnelStats *total, const RemminaSSHTunnelStats *stats)
+{
+	total->bytes_in += stats->bytes_in;
+	total->bytes_out += stats->bytes_out;
+	total->read_calls += stats->read_calls;
+	total->write_calls += stats->write_calls;
+	total->stalls += stats->stalls;
+	total->max_buffered = MAX(total->max_buffered, stats->max_buffered);
+	total->select_wakeups += stats->select_wakeups;
+}
+
 static void
 remmina_ssh_tunnel_close_all_channels(RemminaSSHTunnel *tunnel)
 {
 	TRACE_CALL(__func__);
 	int i;
 
+	pthread_mutex_lock(&tunnel->stats_mutex);
 	for (i = 0; i < tunnel->num_channels; i++) {
+		remmina_ssh_tunnel_stats_merge(&tunnel->stats, &tunnel->channelstats[i]);
 		close(tunnel->sockets[i]);
-		remmina_ssh_tunnel_buffer_free(tunnel->socketbuffers[i]);
+		remmina_ring_buffer_free(tunnel->socketbuffers[i]);
+		remmina_ring_buffer_free(tunnel->channelbuffers[i]);
 		ssh_channel_close(tunnel->channels[i]);
 		ssh_channel_send_eof(tunnel->channels[i]);
 		ssh_channel_free(tunnel->channels[i]);
@@ -880,11 +924,18 @@ remmina_ssh_tunnel_close_all_channels(RemminaSSHTunnel *tunnel)
 	tunnel->channels = NULL;
 	g_free(tunnel->sockets);
 	tunnel->sockets = NULL;
+	g_free(tunnel->channelforwards);
+	tunnel->channelforwards = NULL;
 	g_free(tunnel->socketbuffers);
 	tunnel->socketbuffers = NULL;
+	g_free(tunnel->channelbuffers);
+	tunnel->channelbuffers = NULL;
+	g_free(tunnel->channelstats);
+	tunnel->channelstats = NULL;
 
 	tunnel->num_channels = 0;
 	tunnel->max_channels = 0;
+	pthread_mutex_unlock(&tunnel->stats_mutex);
 
 	if (tunnel->x11_channel) {
 		ssh_channel_close(tunnel->x11_channel);
@@ -902,22 +953,30 @@ remmina_ssh_tunnel_remove_channel(RemminaSSHTunnel *tunnel, gint n)
 	ssh_channel_send_eof(tunnel->channels[n]);
 	ssh_channel_free(tunnel->channels[n]);
 	close(tunnel->sockets[n]);
-	remmina_ssh_tunnel_buffer_free(tunnel->socketbuffers[n]);
+	remmina_ring_buffer_free(tunnel->socketbuffers[n]);
+	remmina_ring_buffer_free(tunnel->channelbuffers[n]);
+	pthread_mutex_lock(&tunnel->stats_mutex);
+	remmina_ssh_tunnel_stats_merge(&tunnel->stats, &tunnel->channelstats[n]);
 	tunnel->num_channels--;
 	tunnel->channels[n] = tunnel->channels[tunnel->num_channels];
 	tunnel->channels[tunnel->num_channels] = NULL;
 	tunnel->sockets[n] = tunnel->sockets[tunnel->num_channels];
+	tunnel->channelforwards[n] = tunnel->channelforwards[tunnel->num_channels];
 	tunnel->socketbuffers[n] = tunnel->socketbuffers[tunnel->num_channels];
+	tunnel->channelbuffers[n] = tunnel->channelbuffers[tunnel->num_channels];
+	tunnel->channelstats[n] = tunnel->channelstats[tunnel->num_channels];
+	pthread_mutex_unlock(&tunnel->stats_mutex);
 }
 
 /* Register the new channel/socket pair */
 static void
-remmina_ssh_tunnel_add_channel(RemminaSSHTunnel *tunnel, ssh_channel channel, gint sock)
+remmina_ssh_tunnel_add_channel(RemminaSSHTunnel *tunnel, ssh_channel channel, gint sock, RemminaSSHTunnelForward *forward)
 {
 	TRACE_CALL(__func__);
 	gint flags;
 	gint i;
 
+	pthread_mutex_lock(&tunnel->stats_mutex);
 	i = tunnel->num_channels++;
 	if (tunnel->num_channels > tunnel->max_channels) {
 		/* Allocate an extra NULL pointer in channels for ssh_select */
@@ -925,17 +984,30 @@ remmina_ssh_tunnel_add_channel(RemminaSSHTunnel *tunnel, ssh_channel channel, gi
 							    sizeof(ssh_channel) * (tunnel->num_channels + 1));
 		tunnel->sockets = (gint *)g_realloc(tunnel->sockets,
 						    sizeof(gint) * tunnel->num_channels);
-		tunnel->socketbuffers = (RemminaSSHTunnelBuffer **)g_realloc(tunnel->socketbuffers,
-									     sizeof(RemminaSSHTunnelBuffer *) * tunnel->num_channels);
+		tunnel->channelforwards = (RemminaSSHTunnelForward **)g_realloc(tunnel->channelforwards,
+										sizeof(RemminaSSHTunnelForward *) * tunnel->num_channels);
+		tunnel->socketbuffers = (RemminaRingBuffer **)g_realloc(tunnel->socketbuffers,
+									sizeof(RemminaRingBuffer *) * tunnel->num_channels);
+		tunnel->channelbuffers = (RemminaRingBuffer **)g_realloc(tunnel->channelbuffers,
+									 sizeof(RemminaRingBuffer *) * tunnel->num_channels);
+		tunnel->channelstats = (RemminaSSHTunnelStats *)g_realloc(tunnel->channelstats,
+									  sizeof(RemminaSSHTunnelStats) * tunnel->num_channels);
 		tunnel->max_channels = tunnel->num_channels;
 
+		tunnel->channels_in = (ssh_channel *)g_realloc(tunnel->channels_in,
+							       sizeof(ssh_channel) * (tunnel->num_channels + 1));
 		tunnel->channels_out = (ssh_channel *)g_realloc(tunnel->channels_out,
 								sizeof(ssh_channel) * (tunnel->num_channels + 1));
 	}
 	tunnel->channels[i] = channel;
 	tunnel->channels[i + 1] = NULL;
 	tunnel->sockets[i] = sock;
-	tunnel->socketbuffers[i] = NULL;
+	tunnel->channelforwards[i] = forward;
+	/* Both directions get their buffer once, for the whole life of the channel */
+	tunnel->socketbuffers[i] = remmina_ring_buffer_new(tunnel->buffer_size);
+	tunnel->channelbuffers[i] = remmina_ring_buffer_new(tunnel->buffer_size);
+	memset(&tunnel->channelstats[i], 0, sizeof(RemminaSSHTunnelStats));
+	pthread_mutex_unlock(&tunnel->stats_mutex);
 
 	flags = fcntl(sock, F_GETFL, 0);
 	fcntl(sock, F_SETFL, flags | O_NONBLOCK);
@@ -962,7 +1034,7 @@ remmina_ssh_tunnel_accept_local_connection(RemminaSSHTunnel *tunnel, gboolean bl
 }
 
 static ssh_channel
-remmina_ssh_tunnel_create_forward_channel(RemminaSSHTunnel *tunnel)
+remmina_ssh_tunnel_create_forward_channel(RemminaSSHTunnel *tunnel, const gchar *dest, gint port)
 {
 	ssh_channel channel = NULL;
 
@@ -973,8 +1045,8 @@ remmina_ssh_tunnel_create_forward_channel(RemminaSSHTunnel *tunnel)
 	}
 
 	/* Request the SSH server to connect to the destination */
-	g_debug("SSH tunnel destination is %s", tunnel->dest);
-	if (ssh_channel_open_forward(channel, tunnel->dest, tunnel->port, "127.0.0.1", 0) != SSH_OK) {
+	g_debug("SSH tunnel destination is %s", dest);
+	if (ssh_channel_open_forward(channel, dest, port, "127.0.0.1", 0) != SSH_OK) {
 		ssh_channel_close(channel);
 		ssh_channel_send_eof(channel);
 		ssh_channel_free(channel);
@@ -985,13 +1057,132 @@ remmina_ssh_tunnel_create_forward_channel(RemminaSSHTunnel *tunnel)
 	return channel;
 }
 
+static void
+remmina_ssh_tunnel_forward_free(RemminaSSHTunnelForward *forward)
+{
+	TRACE_CALL(__func__);
+	if (forward->server_sock >= 0)
+		close(forward->server_sock);
+	g_free(forward->dest);
+	g_free(forward);
+}
+
+/* Add the listening sockets of a shared tunnel to the select set */
+static void
+remmina_ssh_tunnel_forwards_fd_set(RemminaSSHTunnel *tunnel, fd_set *set, gint *maxfd)
+{
+	TRACE_CALL(__func__);
+	RemminaSSHTunnelForward *forward;
+	guint i;
+
+	pthread_mutex_lock(&tunnel->forwards_mutex);
+	for (i = 0; i < tunnel->forwards->len; i++) {
+		forward = g_ptr_array_index(tunnel->forwards, i);
+		if (g_atomic_int_get(&forward->closing) || g_atomic_int_get(&forward->accept_cancelled) ||
+		    forward->server_sock < 0)
+			continue;
+		if (forward->server_sock > *maxfd)
+			*maxfd = forward->server_sock;
+		FD_SET(forward->server_sock, set);
+	}
+	pthread_mutex_unlock(&tunnel->forwards_mutex);
+}
+
+/* Drop the released forwards of a shared tunnel and open a new channel
+ * for every pending local connection, towards the destination of the
+ * forward it came from. The forwards are only looked at under
+ * forwards_mutex, accept() and the channel requests run without it so
+ * the main thread is never kept waiting on the SSH server. */
+static void
+remmina_ssh_tunnel_forwards_update(RemminaSSHTunnel *tunnel, fd_set *set)
+{
+	TRACE_CALL(__func__);
+	RemminaSSHTunnelForward *forward;
+	RemminaSSHTunnelReadyForward *ready;
+	GPtrArray *closed;
+	GArray *pending;
+	ssh_channel channel;
+	gint sock, i;
+	guint j;
+
+	closed = g_ptr_array_new();
+	pending = g_array_new(FALSE, FALSE, sizeof(RemminaSSHTunnelReadyForward));
+
+	pthread_mutex_lock(&tunnel->forwards_mutex);
+	j = 0;
+	while (j < tunnel->forwards->len) {
+		forward = g_ptr_array_index(tunnel->forwards, j);
+		if (g_atomic_int_get(&forward->closing)) {
+			g_ptr_array_remove_index_fast(tunnel->forwards, j);
+			g_ptr_array_add(closed, forward);
+			continue;
+		}
+		if (g_atomic_int_get(&forward->accept_cancelled) && forward->server_sock >= 0) {
+			close(forward->server_sock);
+			forward->server_sock = -1;
+		} else if (forward->server_sock >= 0 && FD_ISSET(forward->server_sock, set)) {
+			g_array_set_size(pending, pending->len + 1);
+			ready = &g_array_index(pending, RemminaSSHTunnelReadyForward, pending->len - 1);
+			ready->forward = forward;
+			ready->server_sock = forward->server_sock;
+			ready->dest = g_strdup(forward->dest);
+			ready->port = forward->port;
+		}
+		j++;
+	}
+	pthread_mutex_unlock(&tunnel->forwards_mutex);
+
+	/* Channels and forwards are only freed by this thread */
+	for (j = 0; j < closed->len; j++) {
+		forward = g_ptr_array_index(closed, j);
+		i = 0;
+		while (i < tunnel->num_channels) {
+			if (tunnel->channelforwards[i] == forward)
+				remmina_ssh_tunnel_remove_channel(tunnel, i);
+			else
+				i++;
+		}
+		remmina_ssh_tunnel_forward_free(forward);
+	}
+	g_ptr_array_free(closed, TRUE);
+
+	for (j = 0; j < pending->len; j++) {
+		ready = &g_array_index(pending, RemminaSSHTunnelReadyForward, j);
+		sock = accept(ready->server_sock, NULL, NULL);
+		if (sock >= 0) {
+			channel = remmina_ssh_tunnel_create_forward_channel(tunnel, ready->dest, ready->port);
+			if (!channel) {
+				/* Other connections on this session keep going */
+				remmina_log_printf("[SSH] Failed to open new connection: %s\n", REMMINA_SSH(tunnel)->error);
+				close(sock);
+			} else {
+				remmina_ssh_tunnel_add_channel(tunnel, channel, sock, ready->forward);
+			}
+		}
+		g_free(ready->dest);
+	}
+	g_array_free(pending, TRUE);
+
+	/* A dead session cannot open channels any more: leave the thread loop
+	 * so that reconnections get a new session instead of this one */
+	if (!ssh_is_connected(REMMINA_SSH(tunnel)->session)) {
+		remmina_log_printf("[SSH] Shared tunnel session has been disconnected\n");
+		tunnel->running = FALSE;
+		remmina_ssh_tunnel_pool_retire(tunnel);
+	}
+}
+
 static gpointer
 remmina_ssh_tunnel_main_thread_proc(gpointer data)
 {
 	TRACE_CALL(__func__);
 	RemminaSSHTunnel *tunnel = (RemminaSSHTunnel *)data;
+	RemminaRingBuffer *buffer;
+	struct iovec iov[2];
 	gchar *ptr;
 	ssize_t len = 0, lenw = 0;
+	gboolean pending;
+	gint n, j;
 	fd_set set;
 	struct timeval timeout;
 	GTimeVal t1, t2;
@@ -1010,20 +1201,24 @@ remmina_ssh_tunnel_main_thread_proc(gpointer data)
 
 	switch (tunnel->tunnel_type) {
 	case REMMINA_SSH_TUNNEL_OPEN:
+		/* Shared tunnels accept on their forwards, in the loop */
+		if (tunnel->forwards)
+			break;
+
 		sock = remmina_ssh_tunnel_accept_local_connection(tunnel, TRUE);
 		if (sock < 0) {
 			tunnel->thread = 0;
 			return NULL;
 		}
 
-		channel = remmina_ssh_tunnel_create_forward_channel(tunnel);
+		channel = remmina_ssh_tunnel_create_forward_channel(tunnel, tunnel->dest, tunnel->port);
 		if (!tunnel) {
 			close(sock);
 			tunnel->thread = 0;
 			return NULL;
 		}
 
-		remmina_ssh_tunnel_add_channel(tunnel, channel, sock);
+		remmina_ssh_tunnel_add_channel(tunnel, channel, sock, NULL);
 		break;
 
 	case REMMINA_SSH_TUNNEL_X11:
@@ -1132,9 +1327,6 @@ remmina_ssh_tunnel_main_thread_proc(gpointer data)
 		break;
 	}
 
-	tunnel->buffer_len = 10240;
-	tunnel->buffer = g_malloc(tunnel->buffer_len);
-
 	/* Start the tunnel data transmission */
 	while (tunnel->running) {
 		if (tunnel->tunnel_type == REMMINA_SSH_TUNNEL_XPORT ||
@@ -1195,7 +1387,7 @@ remmina_ssh_tunnel_main_thread_proc(gpointer data)
 					sock = remmina_public_open_xdisplay(tunnel->localdisplay);
 				}
 				if (sock >= 0) {
-					remmina_ssh_tunnel_add_channel(tunnel, channel, sock);
+					remmina_ssh_tunnel_add_channel(tunnel, channel, sock, NULL);
 				} else {
 					/* Failed to create unix socket. Will this happen? */
 					ssh_channel_close(channel);
@@ -1206,46 +1398,77 @@ remmina_ssh_tunnel_main_thread_proc(gpointer data)
 			}
 		}
 
-		if (tunnel->num_channels <= 0)
+		if (tunnel->num_channels <= 0 && !tunnel->forwards)
 			/* No more connections. We should quit */
 			break;
 
-		timeout.tv_sec = 0;
-		timeout.tv_usec = 200000;
-
+		/* Only wait for data which we have room for: a full buffer stops
+		 * reading from its source until the other side drained it */
 		FD_ZERO(&set);
 		maxfd = 0;
+		n = 0;
+		pending = FALSE;
 		for (i = 0; i < tunnel->num_channels; i++) {
-			if (tunnel->sockets[i] > maxfd)
-				maxfd = tunnel->sockets[i];
-			FD_SET(tunnel->sockets[i], &set);
+			if (tunnel->channelbuffers[i]->len < tunnel->channelbuffers[i]->size) {
+				if (tunnel->sockets[i] > maxfd)
+					maxfd = tunnel->sockets[i];
+				FD_SET(tunnel->sockets[i], &set);
+			}
+			if (tunnel->socketbuffers[i]->len < tunnel->socketbuffers[i]->size &&
+			    !ssh_channel_is_eof(tunnel->channels[i]))
+				tunnel->channels_in[n++] = tunnel->channels[i];
+			if (tunnel->socketbuffers[i]->len > 0)
+				pending = TRUE;
 		}
+		tunnel->channels_in[n] = NULL;
+		if (tunnel->forwards)
+			remmina_ssh_tunnel_forwards_fd_set(tunnel, &set, &maxfd);
+
+		/* ssh_select() cannot wait for a socket to become writable, retry
+		 * soon when a local socket could not take all its data */
+		timeout.tv_sec = 0;
+		timeout.tv_usec = pending ? 10000 : 200000;
 
-		ret = ssh_select(tunnel->channels, tunnel->channels_out, maxfd + 1, &set, &timeout);
+		ret = ssh_select(tunnel->channels_in, tunnel->channels_out, maxfd + 1, &set, &timeout);
+		if (G_UNLIKELY(tunnel->stats_enabled))
+			tunnel->stats.select_wakeups++;
 		if (!tunnel->running) break;
 		if (ret == SSH_EINTR) continue;
 		if (ret == -1) break;
 
+		/* Local socket -> SSH channel */
 		i = 0;
 		while (tunnel->running && i < tunnel->num_channels) {
 			disconnected = FALSE;
+			buffer = tunnel->channelbuffers[i];
 			if (FD_ISSET(tunnel->sockets[i], &set)) {
-				while (!disconnected &&
-				       (len = read(tunnel->sockets[i], tunnel->buffer, tunnel->buffer_len)) > 0) {
-					for (ptr = tunnel->buffer, lenw = 0; len > 0; len -= lenw, ptr += lenw) {
-						lenw = ssh_channel_write(tunnel->channels[i], (char *)ptr, len);
-						if (lenw <= 0) {
-							disconnected = TRUE;
-							remmina_ssh_set_error(REMMINA_SSH(tunnel), _("ssh_channel_write() returned an error: %s"));
-							break;
-						}
-					}
-				}
-				if (len == 0) {
+				n = remmina_ring_buffer_space(buffer, iov);
+				len = n > 0 ? readv(tunnel->sockets[i], iov, n) : -1;
+				TUNNEL_STAT_ADD(tunnel, i, read_calls, 1);
+				if (len > 0) {
+					remmina_ring_buffer_produce(buffer, len);
+					TUNNEL_STAT_MAX(tunnel, i, max_buffered, buffer->len);
+				} else if (len == 0 || (n > 0 && errno != EAGAIN && errno != EINTR)) {
 					remmina_ssh_set_error(REMMINA_SSH(tunnel), _("read on tunnel listening socket returned an error: %s"));
 					disconnected = TRUE;
 				}
 			}
+			while (!disconnected && buffer->len > 0) {
+				remmina_ring_buffer_pending(buffer, iov);
+				lenw = ssh_channel_write(tunnel->channels[i], iov[0].iov_base, iov[0].iov_len);
+				TUNNEL_STAT_ADD(tunnel, i, write_calls, 1);
+				if (lenw < 0) {
+					remmina_ssh_set_error(REMMINA_SSH(tunnel), _("ssh_channel_write() returned an error: %s"));
+					disconnected = TRUE;
+				} else if (lenw == 0) {
+					/* The remote window is closed, keep the data for later */
+					TUNNEL_STAT_ADD(tunnel, i, stalls, 1);
+					break;
+				} else {
+					remmina_ring_buffer_consume(buffer, lenw);
+					TUNNEL_STAT_ADD(tunnel, i, bytes_out, lenw);
+				}
+			}
 			if (disconnected) {
 				remmina_log_printf("[SSH] tunnel has been disconnected. Reason: %s\n", REMMINA_SSH(tunnel)->error);
 				remmina_ssh_tunnel_remove_channel(tunnel, i);
@@ -1255,45 +1478,50 @@ remmina_ssh_tunnel_main_thread_proc(gpointer data)
 		}
 		if (!tunnel->running) break;
 
+		/* SSH channel -> local socket */
 		i = 0;
 		while (tunnel->running && i < tunnel->num_channels) {
 			disconnected = FALSE;
-			if (!tunnel->socketbuffers[i]) {
+			buffer = tunnel->socketbuffers[i];
+			if (buffer->len < buffer->size) {
 				len = ssh_channel_poll(tunnel->channels[i], 0);
-				if (len == SSH_ERROR || len == SSH_EOF) {
+				if (len == SSH_ERROR || (len == SSH_EOF && buffer->len == 0)) {
 					remmina_ssh_set_error(REMMINA_SSH(tunnel), _("ssh_channel_poll() returned an error: %s"));
 					disconnected = TRUE;
 				} else if (len > 0) {
-					tunnel->socketbuffers[i] = remmina_ssh_tunnel_buffer_new(len);
-					len = ssh_channel_read_nonblocking(tunnel->channels[i], tunnel->socketbuffers[i]->data, len, 0);
-					if (len <= 0) {
-						remmina_ssh_set_error(REMMINA_SSH(tunnel), _("ssh_channel_read_nonblocking() returned an error: %s"));
-						disconnected = TRUE;
-					} else {
-						tunnel->socketbuffers[i]->len = len;
+					n = remmina_ring_buffer_space(buffer, iov);
+					for (j = 0; j < n && len > 0; j++) {
+						lenw = ssh_channel_read_nonblocking(tunnel->channels[i], iov[j].iov_base, MIN(iov[j].iov_len, len), 0);
+						TUNNEL_STAT_ADD(tunnel, i, read_calls, 1);
+						if (lenw < 0) {
+							remmina_ssh_set_error(REMMINA_SSH(tunnel), _("ssh_channel_read_nonblocking() returned an error: %s"));
+							disconnected = TRUE;
+							break;
+						}
+						remmina_ring_buffer_produce(buffer, lenw);
+						if (lenw < iov[j].iov_len)
+							break;
+						len -= lenw;
 					}
+					TUNNEL_STAT_MAX(tunnel, i, max_buffered, buffer->len);
 				}
 			}
 
-			if (!disconnected && tunnel->socketbuffers[i]) {
-				for (lenw = 0; tunnel->socketbuffers[i]->len > 0;
-				     tunnel->socketbuffers[i]->len -= lenw, tunnel->socketbuffers[i]->ptr += lenw) {
-					lenw = write(tunnel->sockets[i], tunnel->socketbuffers[i]->ptr, tunnel->socketbuffers[i]->len);
-					if (lenw == -1 && errno == EAGAIN && tunnel->running)
-						/* Sometimes we cannot write to a socket (always EAGAIN), probably because it’s internal
-						 * buffer is full. We need read the pending bytes from the socket first. so here we simply
-						 * break, leave the buffer there, and continue with other data */
-						break;
-					if (lenw <= 0) {
-						remmina_ssh_set_error(REMMINA_SSH(tunnel), _("write on tunnel listening socket returned an error: %s"));
-						disconnected = TRUE;
-						break;
-					}
-				}
-				if (tunnel->socketbuffers[i]->len <= 0) {
-					remmina_ssh_tunnel_buffer_free(tunnel->socketbuffers[i]);
-					tunnel->socketbuffers[i] = NULL;
+			if (!disconnected && buffer->len > 0) {
+				n = remmina_ring_buffer_pending(buffer, iov);
+				lenw = writev(tunnel->sockets[i], iov, n);
+				TUNNEL_STAT_ADD(tunnel, i, write_calls, 1);
+				if (lenw > 0) {
+					remmina_ring_buffer_consume(buffer, lenw);
+					TUNNEL_STAT_ADD(tunnel, i, bytes_in, lenw);
+				} else if (lenw == 0 || (errno != EAGAIN && errno != EINTR)) {
+					remmina_ssh_set_error(REMMINA_SSH(tunnel), _("write on tunnel listening socket returned an error: %s"));
+					disconnected = TRUE;
+				} else {
+					TUNNEL_STAT_ADD(tunnel, i, stalls, 1);
 				}
+				/* On EAGAIN the local socket is full: the data stays in the
+				 * buffer, and the channel is not read until there is room again */
 			}
 
 			if (disconnected) {
@@ -1307,16 +1535,20 @@ remmina_ssh_tunnel_main_thread_proc(gpointer data)
 		 * Some protocols may open new connections during the session.
 		 * e.g: SPICE opens a new connection for some channels.
 		 */
+		if (tunnel->forwards) {
+			remmina_ssh_tunnel_forwards_update(tunnel, &set);
+			continue;
+		}
 		sock = remmina_ssh_tunnel_accept_local_connection(tunnel, FALSE);
 		if (sock > 0) {
-			channel = remmina_ssh_tunnel_create_forward_channel(tunnel);
+			channel = remmina_ssh_tunnel_create_forward_channel(tunnel, tunnel->dest, tunnel->port);
 			if (!channel) {
 				remmina_log_printf("[SSH] Failed to open new connection: %s\n", REMMINA_SSH(tunnel)->error);
 				close(sock);
 				/* Leave thread loop */
 				tunnel->running = FALSE;
 			} else {
-				remmina_ssh_tunnel_add_channel(tunnel, channel, sock);
+				remmina_ssh_tunnel_add_channel(tunnel, channel, sock, NULL);
 			}
 		}
 	}
@@ -1338,6 +1570,9 @@ remmina_ssh_tunnel_main_thread(gpointer data)
 		remmina_ssh_tunnel_main_thread_proc(data);
 		if (tunnel->server_sock < 0 || tunnel->thread == 0 || !tunnel->running) break;
 	}
+	/* A shared tunnel which lost its session must not be handed out again */
+	if (tunnel->forwards)
+		tunnel->running = FALSE;
 	tunnel->thread = 0;
 	return NULL;
 }
@@ -1459,6 +1694,57 @@ remmina_ssh_tunnel_terminated(RemminaSSHTunnel *tunnel)
 	return tunnel->thread == 0;
 }
 
+gboolean
+remmina_ssh_tunnel_get_stats(RemminaSSHTunnel *tunnel, RemminaSSHTunnelStats *total, GArray *channels)
+{
+	TRACE_CALL(__func__);
+	gint i;
+
+	if (!tunnel->stats_enabled)
+		return FALSE;
+
+	/* The tunnel thread updates the counters without locking: a value may
+	 * be a few bytes behind, which is fine for statistics */
+	pthread_mutex_lock(&tunnel->stats_mutex);
+	*total = tunnel->stats;
+	for (i = 0; i < tunnel->num_channels; i++) {
+		remmina_ssh_tunnel_stats_merge(total, &tunnel->channelstats[i]);
+		if (channels)
+			g_array_append_val(channels, tunnel->channelstats[i]);
+	}
+	pthread_mutex_unlock(&tunnel->stats_mutex);
+
+	return TRUE;
+}
+
+void
+remmina_ssh_tunnel_log_stats(RemminaSSHTunnel *tunnel)
+{
+	TRACE_CALL(__func__);
+	RemminaSSHTunnelStats total;
+	RemminaSSHTunnelStats *stats;
+	GArray *channels;
+	guint i;
+
+	channels = g_array_new(FALSE, FALSE, sizeof(RemminaSSHTunnelStats));
+	if (remmina_ssh_tunnel_get_stats(tunnel, &total, channels)) {
+		remmina_log_printf("[SSH] tunnel to %s:%i: %" G_GUINT64_FORMAT " bytes in, %" G_GUINT64_FORMAT " bytes out, "
+				   "%" G_GUINT64_FORMAT " reads, %" G_GUINT64_FORMAT " writes, %" G_GUINT64_FORMAT " stalls, "
+				   "%" G_GUINT64_FORMAT " bytes max buffered, %" G_GUINT64_FORMAT " select wakeups\n",
+				   tunnel->dest ? tunnel->dest : "", tunnel->port, total.bytes_in, total.bytes_out,
+				   total.read_calls, total.write_calls, total.stalls, total.max_buffered, total.select_wakeups);
+		for (i = 0; i < channels->len; i++) {
+			stats = &g_array_index(channels, RemminaSSHTunnelStats, i);
+			remmina_log_printf("[SSH]   channel %u: %" G_GUINT64_FORMAT " bytes in, %" G_GUINT64_FORMAT " bytes out, "
+					   "%" G_GUINT64_FORMAT " reads, %" G_GUINT64_FORMAT " writes, %" G_GUINT64_FORMAT " stalls, "
+					   "%" G_GUINT64_FORMAT " bytes max buffered\n",
+					   i, stats->bytes_in, stats->bytes_out, stats->read_calls, stats->write_calls,
+					   stats->stalls, stats->max_buffered);
+		}
+	}
+	g_array_free(channels, TRUE);
+}
+
 void
 remmina_ssh_tunnel_free(RemminaSSHTunnel *tunnel)
 {
@@ -1485,15 +1771,210 @@ remmina_ssh_tunnel_free(RemminaSSHTunnel *tunnel)
 		tunnel->server_sock = -1;
 	}
 	remmina_ssh_tunnel_close_all_channels(tunnel);
+	if (tunnel->forwards) {
+		g_ptr_array_foreach(tunnel->forwards, (GFunc)remmina_ssh_tunnel_forward_free, NULL);
+		g_ptr_array_free(tunnel->forwards, TRUE);
+		tunnel->forwards = NULL;
+	}
 
-	g_free(tunnel->buffer);
+	g_free(tunnel->channels_in);
 	g_free(tunnel->channels_out);
 	g_free(tunnel->dest);
 	g_free(tunnel->localdisplay);
+	g_free(tunnel->pool_key);
+	pthread_mutex_destroy(&tunnel->stats_mutex);
+	pthread_mutex_destroy(&tunnel->forwards_mutex);
 
 	remmina_ssh_free(REMMINA_SSH(tunnel));
 }
 
+/* Sessions may be shared when they reach the same server as the same
+ * user with the same credentials and the same session options. Profile
+ * values never hold a newline, so it separates the fields. */
+static gchar *
+remmina_ssh_tunnel_pool_key(RemminaSSH *ssh)
+{
+	TRACE_CALL(__func__);
+	return g_strdup_printf("%s@%s:%i\n%i\n%s\n%s\n%i\n%s\n%s\n%s\n%s",
+			       ssh->user ? ssh->user : "", ssh->server, ssh->port,
+			       ssh->auth, ssh->privkeyfile ? ssh->privkeyfile : "",
+			       ssh->proxycommand ? ssh->proxycommand : "", ssh->stricthostkeycheck,
+			       ssh->kex_algorithms ? ssh->kex_algorithms : "",
+			       ssh->ciphers ? ssh->ciphers : "",
+			       ssh->hostkeytypes ? ssh->hostkeytypes : "",
+			       ssh->compression ? ssh->compression : "");
+}
+
+/* Return a new reference to a connected tunnel for the SSH server of
+ * remminafile, or NULL when there is none yet */
+RemminaSSHTunnel *
+remmina_ssh_tunnel_pool_get(RemminaFile *remminafile)
+{
+	TRACE_CALL(__func__);
+	RemminaSSHTunnel *tunnel = NULL;
+	RemminaSSH *ssh;
+	gchar *key;
+
+	ssh = g_new0(RemminaSSH, 1);
+	remmina_ssh_init_from_file(ssh, remminafile);
+	key = remmina_ssh_tunnel_pool_key(ssh);
+	remmina_ssh_free(ssh);
+
+	G_LOCK(remmina_ssh_tunnel_pool);
+	if (remmina_ssh_tunnel_pool)
+		tunnel = g_hash_table_lookup(remmina_ssh_tunnel_pool, key);
+	if (tunnel && tunnel->running && tunnel->thread != 0 && ssh_is_connected(REMMINA_SSH(tunnel)->session))
+		tunnel->refcount++;
+	else
+		tunnel = NULL;
+	G_UNLOCK(remmina_ssh_tunnel_pool);
+
+	g_free(key);
+	return tunnel;
+}
+
+/* Make a connected tunnel available to later connections */
+void
+remmina_ssh_tunnel_pool_add(RemminaSSHTunnel *tunnel)
+{
+	TRACE_CALL(__func__);
+	RemminaSSHTunnel *current;
+	gchar *key;
+
+	key = remmina_ssh_tunnel_pool_key(REMMINA_SSH(tunnel));
+
+	G_LOCK(remmina_ssh_tunnel_pool);
+	if (!remmina_ssh_tunnel_pool)
+		remmina_ssh_tunnel_pool = g_hash_table_new(g_str_hash, g_str_equal);
+	current = g_hash_table_lookup(remmina_ssh_tunnel_pool, key);
+	if (!tunnel->pool_key && (!current || !current->running)) {
+		if (current)
+			g_hash_table_remove(remmina_ssh_tunnel_pool, current->pool_key);
+		tunnel->pool_key = key;
+		g_hash_table_insert(remmina_ssh_tunnel_pool, tunnel->pool_key, tunnel);
+		key = NULL;
+	}
+	G_UNLOCK(remmina_ssh_tunnel_pool);
+
+	g_free(key);
+}
+
+/* Listen on a new local port whose connections are forwarded to host:port
+ * through the session of tunnel */
+RemminaSSHTunnelForward *
+remmina_ssh_tunnel_forward_open(RemminaSSHTunnel *tunnel, const gchar *host, gint port)
+{
+	TRACE_CALL(__func__);
+	RemminaSSHTunnelForward *forward;
+	struct sockaddr_in sin;
+	socklen_t len;
+	gint sock;
+	gint flags;
+
+	if (port == 0) {
+		REMMINA_SSH(tunnel)->error = g_strdup(_("Destination port has not been assigned."));
+		return NULL;
+	}
+
+	sock = socket(AF_INET, SOCK_STREAM, 0);
+	if (sock < 0) {
+		REMMINA_SSH(tunnel)->error = g_strdup(_("Failed to create socket."));
+		return NULL;
+	}
+
+	/* Let the system pick a free local port */
+	sin.sin_family = AF_INET;
+	sin.sin_port = 0;
+	sin.sin_addr.s_addr = inet_addr("127.0.0.1");
+	len = sizeof(sin);
+
+	if (bind(sock, (struct sockaddr *)&sin, sizeof(sin)) ||
+	    getsockname(sock, (struct sockaddr *)&sin, &len)) {
+		REMMINA_SSH(tunnel)->error = g_strdup(_("Failed to bind on local port."));
+		close(sock);
+		return NULL;
+	}
+
+	if (listen(sock, 5)) {
+		REMMINA_SSH(tunnel)->error = g_strdup(_("Failed to listen on local port."));
+		close(sock);
+		return NULL;
+	}
+	flags = fcntl(sock, F_GETFL, 0);
+	fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+
+	forward = g_new0(RemminaSSHTunnelForward, 1);
+	forward->server_sock = sock;
+	forward->dest = g_strdup(host);
+	forward->port = port;
+	forward->localport = ntohs(sin.sin_port);
+
+	pthread_mutex_lock(&tunnel->forwards_mutex);
+	if (!tunnel->forwards) {
+		tunnel->forwards = g_ptr_array_new();
+		tunnel->tunnel_type = REMMINA_SSH_TUNNEL_OPEN;
+	}
+	g_ptr_array_add(tunnel->forwards, forward);
+	pthread_mutex_unlock(&tunnel->forwards_mutex);
+
+	if (tunnel->thread == 0) {
+		if (!tunnel->channels_in) {
+			tunnel->channels_in = g_new0(ssh_channel, 1);
+			tunnel->channels_out = g_new0(ssh_channel, 1);
+		}
+		tunnel->running = TRUE;
+		if (pthread_create(&tunnel->thread, NULL, remmina_ssh_tunnel_main_thread, tunnel)) {
+			remmina_ssh_set_application_error(REMMINA_SSH(tunnel), _("Failed to initialize pthread."));
+			tunnel->thread = 0;
+			tunnel->running = FALSE;
+			return NULL;
+		}
+	}
+
+	return forward;
+}
+
+gint
+remmina_ssh_tunnel_forward_get_localport(RemminaSSHTunnelForward *forward)
+{
+	TRACE_CALL(__func__);
+	return forward->localport;
+}
+
+/* Stop accepting new local connections on forward, the connections
+ * already established stay open */
+void
+remmina_ssh_tunnel_forward_cancel_accept(RemminaSSHTunnel *tunnel, RemminaSSHTunnelForward *forward)
+{
+	TRACE_CALL(__func__);
+	g_atomic_int_set(&forward->accept_cancelled, TRUE);
+}
+
+/* Close forward and drop the reference on tunnel taken by
+ * remmina_ssh_tunnel_pool_get() or remmina_ssh_tunnel_new_from_file().
+ * The session is disconnected with its last user. */
+void
+remmina_ssh_tunnel_forward_release(RemminaSSHTunnel *tunnel, RemminaSSHTunnelForward *forward)
+{
+	TRACE_CALL(__func__);
+	gboolean last;
+
+	G_LOCK(remmina_ssh_tunnel_pool);
+	last = (--tunnel->refcount == 0);
+	if (last && tunnel->pool_key &&
+	    g_hash_table_lookup(remmina_ssh_tunnel_pool, tunnel->pool_key) == tunnel)
+		g_hash_table_remove(remmina_ssh_tunnel_pool, tunnel->pool_key);
+	G_UNLOCK(remmina_ssh_tunnel_pool);
+
+	if (last) {
+		remmina_ssh_tunnel_free(tunnel);
+		return;
+	}
+
+	if (forward)
+		g_atomic_int_set(&forward->closing, TRUE);
+}
+
 /*-----------------------------------------------------------------------------*
 *                           SSH sFTP                                          *
 *-----------------------------------------------------------------------------*/
@@ -1569,6 +2050,7 @@ remmina_ssh_shell_new_from_file(RemminaFile *remminafile)
 
 	shell->master = -1;
 	shell->slave = -1;
+	shell->notify_pipe[0] = shell->notify_pipe[1] = -1;
 	shell->exec = g_strdup(remmina_file_get_string(remminafile, "exec"));
 
 	return shell;
@@ -1586,6 +2068,7 @@ remmina_ssh_shell_new_from_ssh(RemminaSSH *ssh)
 
 	shell->master = -1;
 	shell->slave = -1;
+	shell->notify_pipe[0] = shell->notify_pipe[1] = -1;
 
 	return shell;
 }
@@ -1601,6 +2084,34 @@ remmina_ssh_call_exit_callback_on_main_thread(gpointer data)
 	return FALSE;
 }
 
+/* The shell pump buffers grow when a read fills them (bulk output, like
+ * cat of a large file) and shrink back when the traffic gets interactive */
+#define SHELL_BUFFER_MIN 4096
+#define SHELL_BUFFER_MAX (256 * 1024)
+#define SHELL_BUFFER_SHRINK_READS 64
+/* Seconds. Wakeups are driven by data and by the notify pipe, not by this timeout */
+#define SHELL_SELECT_TIMEOUT 30
+
+static gchar *
+remmina_ssh_shell_buffer_adapt(gchar *buf, gsize *buf_len, gsize used, gint *small_reads)
+{
+	if (used == *buf_len && *buf_len < SHELL_BUFFER_MAX) {
+		*buf_len *= 2;
+		*small_reads = 0;
+		return (gchar *)g_realloc(buf, *buf_len);
+	}
+	if (used < *buf_len / 4 && *buf_len > SHELL_BUFFER_MIN) {
+		if (++(*small_reads) >= SHELL_BUFFER_SHRINK_READS) {
+			*buf_len /= 2;
+			*small_reads = 0;
+			return (gchar *)g_realloc(buf, *buf_len);
+		}
+	} else {
+		*small_reads = 0;
+	}
+	return buf;
+}
+
 static gpointer
 remmina_ssh_shell_thread(gpointer data)
 {
@@ -1610,9 +2121,12 @@ remmina_ssh_shell_thread(gpointer data)
 	struct timeval timeout;
 	ssh_channel channel = NULL;
 	ssh_channel ch[2], chout[2];
-	gchar *buf = NULL;
-	gint buf_len;
-	gint len;
+	gchar *outbuf, *inbuf, *ptr;
+	gsize outbuf_len, inbuf_len;
+	gint out_small_reads, in_small_reads;
+	gssize len;
+	gsize n;
+	gint maxfd;
 	gint i, ret;
 	//gint screen;
 
@@ -1662,56 +2176,73 @@ remmina_ssh_shell_thread(gpointer data)
 
 	UNLOCK_SSH(shell)
 
-	buf_len = 1000;
-	buf = g_malloc(buf_len + 1);
+	outbuf_len = SHELL_BUFFER_MIN;
+	outbuf = g_malloc(outbuf_len);
+	inbuf_len = SHELL_BUFFER_MIN;
+	inbuf = g_malloc(inbuf_len);
+	out_small_reads = in_small_reads = 0;
 
 	ch[0] = channel;
 	ch[1] = NULL;
 
+	maxfd = MAX(shell->slave, shell->notify_pipe[0]);
+
 	while (!shell->closed) {
-		timeout.tv_sec = 1;
+		/* The thread is woken up by data on either side, or by
+		 * remmina_ssh_shell_free() through the notify pipe */
+		timeout.tv_sec = SHELL_SELECT_TIMEOUT;
 		timeout.tv_usec = 0;
 
 		FD_ZERO(&fds);
 		FD_SET(shell->slave, &fds);
+		if (shell->notify_pipe[0] >= 0)
+			FD_SET(shell->notify_pipe[0], &fds);
 
-		ret = ssh_select(ch, chout, shell->slave + 1, &fds, &timeout);
+		ret = ssh_select(ch, chout, maxfd + 1, &fds, &timeout);
 		if (ret == SSH_EINTR) continue;
 		if (ret == -1) break;
+		if (shell->closed) break;
 
 		if (FD_ISSET(shell->slave, &fds)) {
-			len = read(shell->slave, buf, buf_len);
+			len = read(shell->slave, outbuf, outbuf_len);
 			if (len <= 0) break;
 			LOCK_SSH(shell)
-			ssh_channel_write(channel, buf, len);
+			for (ptr = outbuf, n = len; n > 0; n -= ret, ptr += ret) {
+				ret = ssh_channel_write(channel, ptr, n);
+				if (ret <= 0) break;
+			}
 			UNLOCK_SSH(shell)
+			outbuf = remmina_ssh_shell_buffer_adapt(outbuf, &outbuf_len, len, &out_small_reads);
 		}
-		for (i = 0; i < 2; i++) {
-			LOCK_SSH(shell)
-			len = ssh_channel_poll(channel, i);
-			UNLOCK_SSH(shell)
-			if (len == SSH_ERROR || len == SSH_EOF) {
+
+		/* Drain stdout and stderr with a single lock acquisition */
+		len = 0;
+		LOCK_SSH(shell)
+		for (i = 0; i < 2 && len < inbuf_len; i++) {
+			ret = ssh_channel_poll(channel, i);
+			if (ret == SSH_ERROR || ret == SSH_EOF) {
 				shell->closed = TRUE;
 				break;
 			}
-			if (len <= 0) continue;
-			if (len > buf_len) {
-				buf_len = len;
-				buf = (gchar *)g_realloc(buf, buf_len + 1);
-			}
-			LOCK_SSH(shell)
-			len = ssh_channel_read_nonblocking(channel, buf, len, i);
-			UNLOCK_SSH(shell)
-			if (len <= 0) {
+			if (ret <= 0) continue;
+			ret = ssh_channel_read_nonblocking(channel, inbuf + len, MIN((gsize)ret, inbuf_len - len), i);
+			if (ret <= 0) {
 				shell->closed = TRUE;
 				break;
 			}
-			while (len > 0) {
-				ret = write(shell->slave, buf, len);
-				if (ret <= 0) break;
-				len -= ret;
-			}
+			len += ret;
+		}
+		UNLOCK_SSH(shell)
+
+		/* Data read before an EOF is still delivered */
+		for (ptr = inbuf, n = len; n > 0; n -= ret, ptr += ret) {
+			ret = write(shell->slave, ptr, n);
+			if (ret <= 0) break;
 		}
+		if (len > 0 && shell->tap)
+			shell->tap(inbuf, len, shell->tap_data);
+		if (len > 0)
+			inbuf = remmina_ssh_shell_buffer_adapt(inbuf, &inbuf_len, len, &in_small_reads);
 	}
 
 	LOCK_SSH(shell)
@@ -1721,7 +2252,8 @@ remmina_ssh_shell_thread(gpointer data)
 	ssh_channel_free(channel);
 	UNLOCK_SSH(shell)
 
-	g_free(buf);
+	g_free(outbuf);
+	g_free(inbuf);
 	shell->thread = 0;
 
 	if (shell->exit_callback)
@@ -1759,6 +2291,10 @@ remmina_ssh_shell_open(RemminaSSHShell *shell, RemminaSSHExitFunc exit_callback,
 	shell->exit_callback = exit_callback;
 	shell->user_data = data;
 
+	/* Used to wake up the shell thread when the shell is freed */
+	if (pipe(shell->notify_pipe) < 0)
+		shell->notify_pipe[0] = shell->notify_pipe[1] = -1;
+
 	/* Once the process started, we should always TRUE and assume the pthread will be created always */
 	pthread_create(&shell->thread, NULL, remmina_ssh_shell_thread, shell);
 
@@ -1784,8 +2320,14 @@ remmina_ssh_shell_free(RemminaSSHShell *shell)
 	shell->exit_callback = NULL;
 	if (thread) {
 		shell->closed = TRUE;
+		if (shell->notify_pipe[1] >= 0 && write(shell->notify_pipe[1], "", 1) < 0)
+			g_debug("[SSH] cannot wake up the shell thread: %s", g_strerror(errno));
 		pthread_join(thread, NULL);
 	}
+	if (shell->notify_pipe[0] >= 0) {
+		close(shell->notify_pipe[0]);
+		close(shell->notify_pipe[1]);
+	}
 	close(shell->slave);
 	if (shell->exec) {
 		g_free(shell->exec);
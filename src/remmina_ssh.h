@@ -47,6 +47,7 @@
 #include <pthread.h>
 #include "remmina_file.h"
 #include "rcw.h"
+#include "remmina/remmina_ring_buffer.h"
 
 G_BEGIN_DECLS
 
@@ -83,6 +84,10 @@ typedef struct _RemminaSSH {
 	gchar *		passphrase;
 } RemminaSSH;
 
+/* Serialize the use of a session shared between threads */
+#define LOCK_SSH(ssh) pthread_mutex_lock(&REMMINA_SSH(ssh)->ssh_mutex);
+#define UNLOCK_SSH(ssh) pthread_mutex_unlock(&REMMINA_SSH(ssh)->ssh_mutex);
+
 gchar *remmina_ssh_identity_path(const gchar *id);
 
 /* Auto-detect commonly used private key identities */
@@ -116,10 +121,24 @@ void remmina_ssh_free(RemminaSSH *ssh);
 *                           SSH Tunnel                                        *
 *-----------------------------------------------------------------------------*/
 typedef struct _RemminaSSHTunnel RemminaSSHTunnel;
-typedef struct _RemminaSSHTunnelBuffer RemminaSSHTunnelBuffer;
+typedef struct _RemminaSSHTunnelForward RemminaSSHTunnelForward;
 
 typedef gboolean (*RemminaSSHTunnelCallback) (RemminaSSHTunnel *, gpointer);
 
+/* Traffic counters of a tunnel, or of one of its channels.
+ * "in" is the SSH channel -> local socket direction, "out" the other one. */
+typedef struct _RemminaSSHTunnelStats {
+	guint64 bytes_in;
+	guint64 bytes_out;
+	guint64 read_calls;
+	guint64 write_calls;
+	/* Writes which could not proceed: local socket full (EAGAIN) or SSH window closed */
+	guint64 stalls;
+	guint64 max_buffered;
+	/* Tunnel only: returns from ssh_select() */
+	guint64 select_wakeups;
+} RemminaSSHTunnelStats;
+
 enum {
 	REMMINA_SSH_TUNNEL_OPEN,
 	REMMINA_SSH_TUNNEL_X11,
@@ -134,7 +153,12 @@ struct _RemminaSSHTunnel {
 
 	ssh_channel *			channels;
 	gint *				sockets;
-	RemminaSSHTunnelBuffer **	socketbuffers;
+	/* Forward of each channel, for shared tunnels only */
+	RemminaSSHTunnelForward **	channelforwards;
+	/* Channel to socket and socket to channel ring buffers */
+	RemminaRingBuffer **		socketbuffers;
+	RemminaRingBuffer **		channelbuffers;
+	RemminaSSHTunnelStats *		channelstats;
 	gint				num_channels;
 	gint				max_channels;
 
@@ -143,10 +167,16 @@ struct _RemminaSSHTunnel {
 	pthread_t			thread;
 	gboolean			running;
 
-	gchar *				buffer;
-	gint				buffer_len;
+	gsize				buffer_size;
+	ssh_channel *			channels_in;
 	ssh_channel *			channels_out;
 
+	/* Counters are only updated when stats_enabled is set. stats holds the
+	 * select wakeups and the totals of the channels already closed. */
+	gboolean			stats_enabled;
+	RemminaSSHTunnelStats		stats;
+	pthread_mutex_t			stats_mutex;
+
 	gint				server_sock;
 	gchar *				dest;
 	gint				port;
@@ -160,6 +190,13 @@ struct _RemminaSSHTunnel {
 	RemminaSSHTunnelCallback	connect_func;
 	RemminaSSHTunnelCallback	disconnect_func;
 	gpointer			callback_data;
+
+	/* Shared tunnels: one SSH session, and one local listener per forward.
+	 * forwards is NULL for the other tunnels. */
+	gint				refcount;
+	gchar *				pool_key;
+	GPtrArray *			forwards;
+	pthread_mutex_t			forwards_mutex;
 };
 
 /* Create a new SSH Tunnel session and connects to the SSH server */
@@ -195,9 +232,39 @@ gboolean remmina_ssh_tunnel_reverse(RemminaSSHTunnel *tunnel, gint port, gint lo
 /* Tells if the tunnel is terminated after start */
 gboolean remmina_ssh_tunnel_terminated(RemminaSSHTunnel *tunnel);
 
+/* Get the traffic counters of the tunnel, returns FALSE if they are disabled.
+ * total: sum of all channels, past and current
+ * channels: if not NULL, filled with one RemminaSSHTunnelStats per open channel */
+gboolean remmina_ssh_tunnel_get_stats(RemminaSSHTunnel *tunnel, RemminaSSHTunnelStats *total, GArray *channels);
+
+/* Dump the traffic counters of the tunnel to the debug log */
+void remmina_ssh_tunnel_log_stats(RemminaSSHTunnel *tunnel);
+
 /* Free the tunnel */
 void remmina_ssh_tunnel_free(RemminaSSHTunnel *tunnel);
 
+/* Get an open shared tunnel to the same SSH server, port, user and
+ * authentication as remminafile, with a new reference. Returns NULL if none. */
+RemminaSSHTunnel *remmina_ssh_tunnel_pool_get(RemminaFile *remminafile);
+
+/* Share an authenticated tunnel, which has already a forward, with the next
+ * connections to the same SSH server */
+void remmina_ssh_tunnel_pool_add(RemminaSSHTunnel *tunnel);
+
+/* Open a new direct-tcpip forward to host:port on the tunnel, and start the
+ * tunnel thread if needed. The forward listens on a dynamically allocated
+ * local port, see remmina_ssh_tunnel_forward_get_localport(). */
+RemminaSSHTunnelForward *remmina_ssh_tunnel_forward_open(RemminaSSHTunnel *tunnel, const gchar *host, gint port);
+
+gint remmina_ssh_tunnel_forward_get_localport(RemminaSSHTunnelForward *forward);
+
+/* Stop accepting new local connections on the forward */
+void remmina_ssh_tunnel_forward_cancel_accept(RemminaSSHTunnel *tunnel, RemminaSSHTunnelForward *forward);
+
+/* Close the forward and its connections, and drop a reference to the tunnel.
+ * The last reference frees the tunnel. */
+void remmina_ssh_tunnel_forward_release(RemminaSSHTunnel *tunnel, RemminaSSHTunnelForward *forward);
+
 /*-----------------------------------------------------------------------------*
 *                           SSH sFTP                                          *
 *-----------------------------------------------------------------------------*/
@@ -224,18 +291,23 @@ void remmina_sftp_free(RemminaSFTP *sftp);
 *                           SSH Shell                                         *
 *-----------------------------------------------------------------------------*/
 typedef void (*RemminaSSHExitFunc) (gpointer data);
+/* Called from the shell thread with every chunk received from the remote end */
+typedef void (*RemminaSSHShellTapFunc) (const gchar *buf, gsize len, gpointer data);
 
 typedef struct _RemminaSSHShell {
 	RemminaSSH		ssh;
 
 	gint			master;
 	gint			slave;
+	gint			notify_pipe[2];
 	gchar *			exec;
 	pthread_t		thread;
 	ssh_channel		channel;
 	gboolean		closed;
 	RemminaSSHExitFunc	exit_callback;
 	gpointer		user_data;
+	RemminaSSHShellTapFunc	tap;
+	gpointer		tap_data;
 } RemminaSSHShell;
 
 /* Create a new SSH Shell session object from RemminaFile */
@@ -259,6 +331,8 @@ G_END_DECLS
 
 #define RemminaSSH void
 #define RemminaSSHTunnel void
+#define RemminaSSHTunnelForward void
+#define RemminaSSHTunnelStats void
 #define RemminaSFTP void
 #define RemminaSSHShell void
 typedef void (*RemminaSSHTunnelCallback)(void);
@@ -44,6 +44,7 @@
 #include <glib/gi18n.h>
 #include <gio/gio.h>
 #include <vte/vte.h>
+#include <glib/gstdio.h>
 #include <locale.h>
 #include <langinfo.h>
 #include "remmina_public.h"
@@ -191,11 +192,35 @@ static struct {
 
 #define DEFAULT_PALETTE "linux_palette"
 
+/* Session capture limits: memory queued between the shell thread and the
+ * writer thread, raw bytes per log file and number of rotated files kept */
+#define CAPTURE_QUEUE_MAX  (4 * 1024 * 1024)
+#define CAPTURE_FILE_MAX   (64 * 1024 * 1024)
+#define CAPTURE_FILES_KEPT 4
+
+/** Continuous, gzip compressed capture of the terminal output */
+typedef struct _RemminaPluginSshCapture {
+	GMutex		mutex;
+	GCond		cond;
+	GQueue		chunks;
+	gsize		queued;
+	gboolean	flush_requested;
+	gboolean	stop;
+	gboolean	failed;
+
+	gchar *		path;
+	GOutputStream * stream;
+	gsize		written;
+
+	GThread *	thread;
+} RemminaPluginSshCapture;
+
 
 /** The SSH plugin implementation */
 typedef struct _RemminaPluginSshData {
 	RemminaSSHShell *	shell;
 	GFile *			vte_session_file;
+	RemminaPluginSshCapture *capture;
 	GtkWidget *		vte;
 
 	const GdkRGBA *		palette;
@@ -210,6 +235,225 @@ static gboolean
 remmina_plugin_ssh_on_size_allocate(GtkWidget *widget, GtkAllocation *alloc, RemminaProtocolWidget *gp);
 
 
+static gchar *
+remmina_plugin_ssh_capture_file_name(RemminaPluginSshCapture *capture, guint index)
+{
+	TRACE_CALL(__func__);
+	if (index == 0)
+		return g_strdup_printf("%s.gz", capture->path);
+	return g_strdup_printf("%s.%u.gz", capture->path, index);
+}
+
+static void
+remmina_plugin_ssh_capture_close_stream(RemminaPluginSshCapture *capture)
+{
+	TRACE_CALL(__func__);
+	GError *err = NULL;
+
+	if (!capture->stream)
+		return;
+	/* Closing the converter finishes the gzip stream and closes the file */
+	if (!g_output_stream_close(capture->stream, NULL, &err)) {
+		g_warning("[SSH] cannot close session capture %s: %s", capture->path, err->message);
+		g_error_free(err);
+	}
+	g_object_unref(capture->stream);
+	capture->stream = NULL;
+}
+
+static gboolean
+remmina_plugin_ssh_capture_open_stream(RemminaPluginSshCapture *capture)
+{
+	TRACE_CALL(__func__);
+	GFileOutputStream *fstream;
+	GZlibCompressor *compressor;
+	GError *err = NULL;
+	GFile *file;
+	gchar *from, *to;
+	guint i;
+
+	/* Shift the previous files: name.gz -> name.1.gz -> … -> dropped */
+	to = remmina_plugin_ssh_capture_file_name(capture, CAPTURE_FILES_KEPT - 1);
+	g_unlink(to);
+	for (i = CAPTURE_FILES_KEPT - 1; i > 0; i--) {
+		from = remmina_plugin_ssh_capture_file_name(capture, i - 1);
+		g_rename(from, to);
+		g_free(to);
+		to = from;
+	}
+
+	file = g_file_new_for_path(to);
+	fstream = g_file_replace(file, NULL, FALSE, G_FILE_CREATE_PRIVATE, NULL, &err);
+	g_object_unref(file);
+	g_free(to);
+	if (!fstream) {
+		g_warning("[SSH] cannot open session capture %s: %s", capture->path, err->message);
+		g_error_free(err);
+		return FALSE;
+	}
+
+	compressor = g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+	capture->stream = g_converter_output_stream_new(G_OUTPUT_STREAM(fstream), G_CONVERTER(compressor));
+	g_object_unref(compressor);
+	g_object_unref(fstream);
+	capture->written = 0;
+	return TRUE;
+}
+
+static gboolean
+remmina_plugin_ssh_capture_notify_saved(gchar *path)
+{
+	TRACE_CALL(__func__);
+	remmina_public_send_notification("remmina-terminal-saved",
+					 _("Terminal content saved under"), path);
+	g_free(path);
+	return FALSE;
+}
+
+static gpointer
+remmina_plugin_ssh_capture_thread(gpointer data)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginSshCapture *capture = (RemminaPluginSshCapture *)data;
+	GError *err = NULL;
+	GBytes *chunk;
+	gconstpointer buf;
+	gsize len;
+
+	g_mutex_lock(&capture->mutex);
+	for (;;) {
+		while (!capture->stop && !capture->flush_requested && g_queue_is_empty(&capture->chunks))
+			g_cond_wait(&capture->cond, &capture->mutex);
+
+		if ((chunk = g_queue_pop_head(&capture->chunks)) != NULL) {
+			len = g_bytes_get_size(chunk);
+			capture->queued -= len;
+			/* Wake up the shell thread if it was waiting for room */
+			g_cond_broadcast(&capture->cond);
+			g_mutex_unlock(&capture->mutex);
+
+			if (!capture->failed) {
+				if (capture->stream && capture->written + len > CAPTURE_FILE_MAX)
+					remmina_plugin_ssh_capture_close_stream(capture);
+				if (!capture->stream && !remmina_plugin_ssh_capture_open_stream(capture))
+					capture->failed = TRUE;
+			}
+			if (!capture->failed) {
+				buf = g_bytes_get_data(chunk, NULL);
+				if (g_output_stream_write_all(capture->stream, buf, len, NULL, NULL, &err)) {
+					capture->written += len;
+				} else {
+					g_warning("[SSH] cannot write session capture %s: %s", capture->path, err->message);
+					g_clear_error(&err);
+					capture->failed = TRUE;
+				}
+			}
+			g_bytes_unref(chunk);
+			g_mutex_lock(&capture->mutex);
+			continue;
+		}
+
+		if (capture->flush_requested) {
+			/* The queue is drained: sync the compressor so the file
+			 * can be read up to this point while capture goes on */
+			capture->flush_requested = FALSE;
+			g_mutex_unlock(&capture->mutex);
+			if (!capture->failed && capture->stream) {
+				if (g_output_stream_flush(capture->stream, NULL, &err))
+					IDLE_ADD((GSourceFunc)remmina_plugin_ssh_capture_notify_saved,
+						 remmina_plugin_ssh_capture_file_name(capture, 0));
+				else {
+					g_warning("[SSH] cannot flush session capture %s: %s", capture->path, err->message);
+					g_clear_error(&err);
+				}
+			}
+			g_mutex_lock(&capture->mutex);
+			continue;
+		}
+
+		if (capture->stop)
+			break;
+	}
+	g_mutex_unlock(&capture->mutex);
+
+	remmina_plugin_ssh_capture_close_stream(capture);
+	return NULL;
+}
+
+/**
+ * Shell tap, called from the SSH shell thread.
+ *
+ * Data are only queued here, compression and disk I/O happen in the capture
+ * thread. When the writer falls behind by more than CAPTURE_QUEUE_MAX the
+ * shell thread waits, so memory stays bounded and no output is lost.
+ */
+static void
+remmina_plugin_ssh_capture_tap(const gchar *buf, gsize len, gpointer data)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginSshCapture *capture = (RemminaPluginSshCapture *)data;
+
+	g_mutex_lock(&capture->mutex);
+	while (!capture->stop && capture->queued >= CAPTURE_QUEUE_MAX)
+		g_cond_wait(&capture->cond, &capture->mutex);
+	if (!capture->stop) {
+		g_queue_push_tail(&capture->chunks, g_bytes_new(buf, len));
+		capture->queued += len;
+		g_cond_broadcast(&capture->cond);
+	}
+	g_mutex_unlock(&capture->mutex);
+}
+
+static RemminaPluginSshCapture *
+remmina_plugin_ssh_capture_new(GFile *file)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginSshCapture *capture;
+	gchar *dir;
+
+	capture = g_new0(RemminaPluginSshCapture, 1);
+	capture->path = g_file_get_path(file);
+	dir = g_path_get_dirname(capture->path);
+	g_mkdir_with_parents(dir, 0750);
+	g_free(dir);
+
+	g_mutex_init(&capture->mutex);
+	g_cond_init(&capture->cond);
+	g_queue_init(&capture->chunks);
+	capture->thread = g_thread_new("remmina-ssh-capture", remmina_plugin_ssh_capture_thread, capture);
+	return capture;
+}
+
+/* Ask the capture thread to make everything received so far readable on disk */
+static void
+remmina_plugin_ssh_capture_flush(RemminaPluginSshCapture *capture)
+{
+	TRACE_CALL(__func__);
+	g_mutex_lock(&capture->mutex);
+	capture->flush_requested = TRUE;
+	g_cond_broadcast(&capture->cond);
+	g_mutex_unlock(&capture->mutex);
+}
+
+/* Write out what is still queued, finish the gzip stream and free the capture.
+ * The shell feeding the capture must be already stopped. */
+static void
+remmina_plugin_ssh_capture_free(RemminaPluginSshCapture *capture)
+{
+	TRACE_CALL(__func__);
+	g_mutex_lock(&capture->mutex);
+	capture->stop = TRUE;
+	g_cond_broadcast(&capture->cond);
+	g_mutex_unlock(&capture->mutex);
+	g_thread_join(capture->thread);
+
+	g_queue_clear(&capture->chunks);
+	g_mutex_clear(&capture->mutex);
+	g_cond_clear(&capture->cond);
+	g_free(capture->path);
+	g_free(capture);
+}
+
 /**
  * Remmina Protocol plugin main function.
  *
@@ -285,6 +529,10 @@ remmina_plugin_ssh_main_thread(gpointer data)
 	if (ssh) {
 		/* Create SSH Shell connection based on existing SSH session */
 		shell = remmina_ssh_shell_new_from_ssh(ssh);
+		if (gpdata->capture) {
+			shell->tap = remmina_plugin_ssh_capture_tap;
+			shell->tap_data = gpdata->capture;
+		}
 		if (remmina_ssh_init_session(REMMINA_SSH(shell)) &&
 		    remmina_ssh_auth(REMMINA_SSH(shell), NULL, gp, remminafile) > 0 &&
 		    remmina_ssh_shell_open(shell, (RemminaSSHExitFunc)
@@ -301,6 +549,10 @@ remmina_plugin_ssh_main_thread(gpointer data)
 		g_free(host);
 
 		shell = remmina_ssh_shell_new_from_file(remminafile);
+		if (gpdata->capture) {
+			shell->tap = remmina_plugin_ssh_capture_tap;
+			shell->tap_data = gpdata->capture;
+		}
 		while (1) {
 			if (!remmina_ssh_init_session(REMMINA_SSH(shell))) {
 				remmina_plugin_service->protocol_plugin_set_error(gp, "%s", REMMINA_SSH(shell)->error);
@@ -471,6 +723,12 @@ remmina_plugin_ssh_vte_save_session(GtkMenuItem *menuitem, RemminaProtocolWidget
 	GtkWidget *widget;
 	GError *err = NULL;
 
+	/* With session logging enabled the output is already on disk */
+	if (gpdata->capture) {
+		remmina_plugin_ssh_capture_flush(gpdata->capture);
+		return;
+	}
+
 	GFileOutputStream *stream = g_file_replace(gpdata->vte_session_file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &err);
 
 	if (err != NULL) {
@@ -851,6 +1109,9 @@ remmina_plugin_ssh_open_connection(RemminaProtocolWidget *gp)
 	remmina_plugin_service->protocol_plugin_set_width(gp, 640);
 	remmina_plugin_service->protocol_plugin_set_height(gp, 480);
 
+	if (remmina_plugin_service->file_get_int(remmina_plugin_service->protocol_plugin_get_file(gp), "sshlogenabled", FALSE))
+		gpdata->capture = remmina_plugin_ssh_capture_new(gpdata->vte_session_file);
+
 	if (pthread_create(&gpdata->thread, NULL, remmina_plugin_ssh_main_thread, gp)) {
 		remmina_plugin_service->protocol_plugin_set_error(gp,
 								  "Failed to initialize pthread. Falling back to non-thread mode…");
@@ -868,12 +1129,6 @@ remmina_plugin_ssh_close_connection(RemminaProtocolWidget *gp)
 	TRACE_CALL(__func__);
 	RemminaPluginSshData *gpdata = GET_PLUGIN_DATA(gp);
 
-	RemminaFile *remminafile;
-
-	remminafile = remmina_plugin_service->protocol_plugin_get_file(gp);
-
-	if (remmina_file_get_int(remminafile, "sshlogenabled", FALSE))
-		remmina_plugin_ssh_vte_save_session(NULL, gp);
 	if (gpdata->thread) {
 		pthread_cancel(gpdata->thread);
 		if (gpdata->thread) pthread_join(gpdata->thread, NULL);
@@ -882,6 +1137,10 @@ remmina_plugin_ssh_close_connection(RemminaProtocolWidget *gp)
 		remmina_ssh_shell_free(gpdata->shell);
 		gpdata->shell = NULL;
 	}
+	if (gpdata->capture) {
+		remmina_plugin_ssh_capture_free(gpdata->capture);
+		gpdata->capture = NULL;
+	}
 
 	remmina_plugin_service->protocol_plugin_emit_signal(gp, "disconnect");
 	return FALSE;
@@ -1081,7 +1340,7 @@ static const RemminaProtocolSetting remmina_ssh_advanced_settings[] =
 	{ REMMINA_PROTOCOL_SETTING_TYPE_TEXT,	"ssh_hostkeytypes",	  N_("Preferred server host key types"),    FALSE, NULL,		 NULL },
 	{ REMMINA_PROTOCOL_SETTING_TYPE_FOLDER, "sshlogfolder",		  N_("SSH session log folder"),		    FALSE, NULL,		 NULL },
 	{ REMMINA_PROTOCOL_SETTING_TYPE_TEXT,	"sshlogname",		  N_("SSH session log file name"),	    FALSE, NULL,		 NULL },
-	{ REMMINA_PROTOCOL_SETTING_TYPE_CHECK,	"sshlogenabled",	  N_("Enable SSH session logging at exit"), FALSE, NULL,		 NULL },
+	{ REMMINA_PROTOCOL_SETTING_TYPE_CHECK,	"sshlogenabled",	  N_("Enable SSH session logging"),	    FALSE, NULL,		 NULL },
 	{ REMMINA_PROTOCOL_SETTING_TYPE_CHECK,	"audiblebell",		  N_("Enable terminal audible bell"),	    FALSE, NULL,		 NULL },
 	{ REMMINA_PROTOCOL_SETTING_TYPE_CHECK,	"ssh_compression",	  N_("Enable SSH compression"),		    FALSE, NULL,		 NULL },
 	{ REMMINA_PROTOCOL_SETTING_TYPE_CHECK,	"disablepasswordstoring", N_("Disable password storing"),	    TRUE,  NULL,		 NULL },
@@ -160,14 +160,37 @@
 
 struct utsname u;
 
-struct ProfilesData {
-	GHashTable *proto_count;
-	GHashTable *proto_date;
-	const gchar *protocol;          /** Key in the proto_count hash table.*/
-	const gchar *pdatestr;          /** Date in string format in the proto_date hash table. */
-	gint pcount;
-	gchar datestr;
-};
+/** Delay before the profile statistics are written to the cache, in seconds */
+#define REMMINA_STATS_PROFILES_FLUSH_DELAY 5
+
+/**
+ * Contribution of a profile to the statistics.
+ * The protocol is an interned string, last_success is YYYYMMDD or 0.
+ */
+typedef struct {
+	const gchar *protocol;
+	guint32 last_success;
+} RemminaStatsProfile;
+
+/** Aggregate of the profiles using a protocol */
+typedef struct {
+	gint count;
+	guint32 last_success;
+	gboolean last_success_stale;    /** A profile with the latest date went away */
+} RemminaStatsProtocol;
+
+/**
+ * Profile statistics, kept up to date by remmina_stats_profile_update() and
+ * remmina_stats_profile_remove() once loaded. They are persisted in the cache
+ * dir with the mtime of the data dir: every profile save changes it, so a
+ * mismatch means profiles changed while nobody was tracking them, and a full
+ * scan is needed.
+ */
+static GHashTable *remmina_stats_profiles = NULL;       /** file name -> RemminaStatsProfile */
+static GHashTable *remmina_stats_protocols = NULL;      /** protocol -> RemminaStatsProtocol */
+static gchar *remmina_stats_profiles_datadir = NULL;
+static guint remmina_stats_profiles_flush_source = 0;
+G_LOCK_DEFINE_STATIC(remmina_stats_profiles);
 
 static gchar* remmina_stats_gen_random_uuid_prefix()
 {
@@ -570,100 +593,301 @@ JsonNode *remmina_stats_get_indicator()
 	return r;
 }
 
-/**
- * Given a remmina file, fills a structure containing profiles keys/value tuples.
- *
- * This is used as a callback function with remmina_file_manager_iterate.
- * @todo Move this in a separate file.
- */
-static void remmina_profiles_get_data(RemminaFile *remminafile, gpointer user_data)
+static guint32 remmina_stats_parse_date(const gchar *date)
 {
 	TRACE_CALL(__func__);
+	gint i;
+
+	/* last_success is YYYYMMDD, see rco_on_connect() */
+	if (!date)
+		return 0;
+	for (i = 0; i < 8; i++)
+		if (!g_ascii_isdigit(date[i]))
+			return 0;
+	return (guint32)g_ascii_strtoull(date, NULL, 10);
+}
 
-	gint count = 0;
-	gpointer pcount, kpo;
-	gpointer pdate, kdo;
-	gchar *sday, *smonth, *syear;
-	gchar *dday, *dmonth, *dyear;
-
-	GDateTime *ds;          /** Source date -> from profile */
-	GDateTime *dd;          /** Destination date -> The date in the pdata structure */
-
-	struct ProfilesData* pdata;
-	pdata = (struct ProfilesData*)user_data;
-
-	pdata->protocol = remmina_file_get_string(remminafile, "protocol");
-	pdata->pdatestr = remmina_file_get_string(remminafile, "last_success");
-
-	ds = dd = NULL;
-	if (pdata->pdatestr && pdata->pdatestr[0] != '\0' && strlen(pdata->pdatestr) >= 6) {
-		dyear = g_strdup_printf("%.4s", pdata->pdatestr);
-		dmonth = g_strdup_printf("%.2s", pdata->pdatestr + 4);
-		dday = g_strdup_printf("%.2s", pdata->pdatestr + 6);
-		dd = g_date_time_new_local(g_ascii_strtoll(dyear, NULL, 0),
-				g_ascii_strtoll(dmonth, NULL, 0),
-				g_ascii_strtoll(dday, NULL, 0), 0, 0, 0.0);
-		g_free(dyear);
-		g_free(dmonth);
-		g_free(dday);
-	}
+static gchar *remmina_stats_profiles_cache_file(void)
+{
+	TRACE_CALL(__func__);
+	return g_build_filename(g_get_user_cache_dir(), "remmina", "profile_stats", NULL);
+}
+
+static gint64 remmina_stats_datadir_mtime(const gchar *datadir)
+{
+	TRACE_CALL(__func__);
+	GStatBuf st;
 
+	/* With nanoseconds: saves in the same second as a flush must be seen */
+	if (g_stat(datadir, &st) != 0)
+		return 0;
+	return (gint64)st.st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) + st.st_mtim.tv_nsec;
+}
 
-	if (pdata->protocol && pdata->protocol[0] != '\0') {
-		if (g_hash_table_lookup_extended(pdata->proto_count, pdata->protocol, &kpo, &pcount)) {
-			count = GPOINTER_TO_INT(pcount) + 1;
-		}else {
-			count = 1;
-			g_hash_table_insert(pdata->proto_count, g_strdup(pdata->protocol), GINT_TO_POINTER(count));
+/** Add or replace the contribution of a profile to profiles and protocols */
+static void remmina_stats_profiles_set(GHashTable *profiles, GHashTable *protocols,
+				       const gchar *filename, const gchar *protocol, guint32 last_success)
+{
+	TRACE_CALL(__func__);
+	RemminaStatsProfile *profile;
+	RemminaStatsProtocol *proto;
+
+	profile = g_hash_table_lookup(profiles, filename);
+	if (profile) {
+		proto = profile->protocol ? g_hash_table_lookup(protocols, profile->protocol) : NULL;
+		if (proto) {
+			proto->count--;
+			if (profile->last_success && profile->last_success == proto->last_success)
+				proto->last_success_stale = TRUE;
 		}
-		g_hash_table_replace(pdata->proto_count, g_strdup(pdata->protocol), GINT_TO_POINTER(count));
-		pdate = NULL;
-		if (g_hash_table_lookup_extended(pdata->proto_date, pdata->protocol, &kdo, &pdate)) {
-
-			ds = NULL;
-			if (pdate && strlen(pdate) >= 6) {
-				syear = g_strdup_printf("%.4s", (char*)pdate);
-				smonth = g_strdup_printf("%.2s", (char*)pdate + 4);
-				sday = g_strdup_printf("%.2s", (char*)pdate + 6);
-				ds = g_date_time_new_local(g_ascii_strtoll(syear, NULL, 0),
-						g_ascii_strtoll(smonth, NULL, 0),
-						g_ascii_strtoll(sday, NULL, 0), 0, 0, 0.0);
-				g_free(syear);
-				g_free(smonth);
-				g_free(sday);
-			}
+	} else {
+		profile = g_new0(RemminaStatsProfile, 1);
+		g_hash_table_insert(profiles, g_strdup(filename), profile);
+	}
+
+	profile->protocol = (protocol && protocol[0] != '\0') ? g_intern_string(protocol) : NULL;
+	profile->last_success = last_success;
+	if (!profile->protocol)
+		return;
 
-			/** When both date in the has and in the profile are valid we compare the date */
-			if (ds && dd) {
-				gint res = g_date_time_compare( ds, dd );
-				/** If the date in the hash less than the date in the profile, we take the latter */
-				if (res < 0 ) {
-					g_hash_table_replace(pdata->proto_date, g_strdup(pdata->protocol), g_strdup(pdata->pdatestr));
+	proto = g_hash_table_lookup(protocols, profile->protocol);
+	if (!proto) {
+		proto = g_new0(RemminaStatsProtocol, 1);
+		g_hash_table_insert(protocols, (gpointer)profile->protocol, proto);
+	}
+	proto->count++;
+	if (last_success > proto->last_success)
+		proto->last_success = last_success;
+}
+
+/** Replace the statistics with profiles and protocols, loaded from datadir. Called with the lock held */
+static void remmina_stats_profiles_install(const gchar *datadir, GHashTable *profiles, GHashTable *protocols)
+{
+	TRACE_CALL(__func__);
+	if (remmina_stats_profiles) {
+		g_hash_table_destroy(remmina_stats_profiles);
+		g_hash_table_destroy(remmina_stats_protocols);
+	}
+	remmina_stats_profiles = profiles;
+	remmina_stats_protocols = protocols;
+	g_free(remmina_stats_profiles_datadir);
+	remmina_stats_profiles_datadir = g_strdup(datadir);
+}
+
+/** Read back the persisted statistics into profiles and protocols, if they are still valid */
+static gboolean remmina_stats_profiles_read(const gchar *datadir, GHashTable *profiles, GHashTable *protocols)
+{
+	TRACE_CALL(__func__);
+	GKeyFile *gkeyfile;
+	gchar *cachefile, *cached_datadir, *value, *p, *filename;
+	gchar **keys;
+	gint i;
+	gboolean ret = FALSE;
+
+	gkeyfile = g_key_file_new();
+	cachefile = remmina_stats_profiles_cache_file();
+	if (g_key_file_load_from_file(gkeyfile, cachefile, G_KEY_FILE_NONE, NULL)) {
+		cached_datadir = g_key_file_get_string(gkeyfile, "profile_stats", "datadir", NULL);
+		if (g_strcmp0(cached_datadir, datadir) == 0 &&
+		    g_key_file_get_int64(gkeyfile, "profile_stats", "datadir_mtime", NULL) == remmina_stats_datadir_mtime(datadir)) {
+			/* One "protocol;last_success" value per profile file name */
+			keys = g_key_file_get_keys(gkeyfile, "profiles", NULL, NULL);
+			for (i = 0; keys && keys[i]; i++) {
+				value = g_key_file_get_string(gkeyfile, "profiles", keys[i], NULL);
+				p = value ? strchr(value, ';') : NULL;
+				if (p) {
+					*p++ = '\0';
+					filename = g_build_filename(datadir, keys[i], NULL);
+					remmina_stats_profiles_set(profiles, protocols, filename, value, remmina_stats_parse_date(p));
+					g_free(filename);
 				}
+				g_free(value);
 			}
-			/** If the date in the hash is NOT valid and the date in the profile is valid we keep the latter */
-			if (!ds && dd) {
-				g_hash_table_replace(pdata->proto_date, g_strdup(pdata->protocol), g_strdup(pdata->pdatestr));
-			}
-			/** If both date are NULL, we insert NULL for that protocol */
-			if ((!ds && !dd) && pdata->pdatestr) {
-				g_hash_table_replace(pdata->proto_date, g_strdup(pdata->protocol), NULL);
-			}
-		}else {
-			/** If there is not the protocol in the hash, we add it */
-			/** If the date in the profile is not NULL we use it */
-			if (pdata->pdatestr) {
-				g_hash_table_replace(pdata->proto_date, g_strdup(pdata->protocol), g_strdup(pdata->pdatestr));
-			}else {
-				/** Otherwise we set it to NULL */
-				g_hash_table_replace(pdata->proto_date, g_strdup(pdata->protocol), NULL);
+			g_strfreev(keys);
+			ret = TRUE;
+		}
+		g_free(cached_datadir);
+	}
+	g_free(cachefile);
+	g_key_file_free(gkeyfile);
+	return ret;
+}
+
+/** Read the protocol and the last success date of every profile into profiles and protocols */
+static void remmina_stats_profiles_scan(const gchar *datadir, GHashTable *profiles, GHashTable *protocols)
+{
+	TRACE_CALL(__func__);
+	GKeyFile *gkeyfile;
+	GDir *dir;
+	const gchar *name;
+	gchar *filename, *protocol, *last_success;
+
+	dir = g_dir_open(datadir, 0, NULL);
+	if (dir == NULL)
+		return;
+	while ((name = g_dir_read_name(dir)) != NULL) {
+		if (!g_str_has_suffix(name, ".remmina"))
+			continue;
+		filename = g_build_filename(datadir, name, NULL);
+		gkeyfile = g_key_file_new();
+		if (g_key_file_load_from_file(gkeyfile, filename, G_KEY_FILE_NONE, NULL) &&
+		    g_key_file_has_key(gkeyfile, "remmina", "name", NULL)) {
+			protocol = g_key_file_get_string(gkeyfile, "remmina", "protocol", NULL);
+			last_success = g_key_file_get_string(gkeyfile, "remmina", "last_success", NULL);
+			remmina_stats_profiles_set(profiles, protocols, filename, protocol, remmina_stats_parse_date(last_success));
+			g_free(protocol);
+			g_free(last_success);
+		}
+		g_key_file_free(gkeyfile);
+		g_free(filename);
+	}
+	g_dir_close(dir);
+}
+
+/**
+ * Persist the statistics, valid for the data dir at datadir_mtime.
+ * Called with the lock held
+ */
+static void remmina_stats_profiles_write(gint64 datadir_mtime)
+{
+	TRACE_CALL(__func__);
+	RemminaStatsProfile *profile;
+	GKeyFile *gkeyfile;
+	GHashTableIter iter;
+	gchar *filename, *cachefile, *basename, *value, *content;
+	gsize length;
+
+	gkeyfile = g_key_file_new();
+	g_key_file_set_string(gkeyfile, "profile_stats", "datadir", remmina_stats_profiles_datadir);
+	g_key_file_set_int64(gkeyfile, "profile_stats", "datadir_mtime", datadir_mtime);
+	g_hash_table_iter_init(&iter, remmina_stats_profiles);
+	while (g_hash_table_iter_next(&iter, (gpointer*)&filename, (gpointer*)&profile)) {
+		basename = g_path_get_basename(filename);
+		value = g_strdup_printf("%s;%u", profile->protocol ? profile->protocol : "", profile->last_success);
+		g_key_file_set_string(gkeyfile, "profiles", basename, value);
+		g_free(value);
+		g_free(basename);
+	}
+
+	content = g_key_file_to_data(gkeyfile, &length, NULL);
+	cachefile = remmina_stats_profiles_cache_file();
+	if (!g_file_set_contents(cachefile, content, length, NULL))
+		g_debug("Unable to write %s", cachefile);
+	g_free(cachefile);
+	g_free(content);
+	g_key_file_free(gkeyfile);
+}
+
+static gboolean remmina_stats_profiles_flush_cb(gpointer user_data)
+{
+	TRACE_CALL(__func__);
+	G_LOCK(remmina_stats_profiles);
+	remmina_stats_profiles_flush_source = 0;
+	if (remmina_stats_profiles)
+		remmina_stats_profiles_write(remmina_stats_datadir_mtime(remmina_stats_profiles_datadir));
+	G_UNLOCK(remmina_stats_profiles);
+	return G_SOURCE_REMOVE;
+}
+
+/** Schedule a write of the statistics, coalescing the changes. Called with the lock held */
+static void remmina_stats_profiles_changed(void)
+{
+	TRACE_CALL(__func__);
+	if (!remmina_stats_profiles_flush_source)
+		remmina_stats_profiles_flush_source = g_timeout_add_seconds(REMMINA_STATS_PROFILES_FLUSH_DELAY,
+			remmina_stats_profiles_flush_cb, NULL);
+}
+
+/** Profiles outside of the data dir, like remmina.pref, are not counted */
+static gboolean remmina_stats_profile_is_tracked(const gchar *filename)
+{
+	TRACE_CALL(__func__);
+	gchar *dirname;
+	gboolean ret;
+
+	if (!filename || !remmina_stats_profiles || !g_str_has_suffix(filename, ".remmina"))
+		return FALSE;
+	dirname = g_path_get_dirname(filename);
+	ret = (g_strcmp0(dirname, remmina_stats_profiles_datadir) == 0);
+	g_free(dirname);
+	return ret;
+}
+
+/**
+ * Update the statistics after a profile has been saved.
+ * Nothing is done while the statistics are not loaded: the next load will
+ * see that the data dir changed.
+ */
+void remmina_stats_profile_update(RemminaFile *remminafile)
+{
+	TRACE_CALL(__func__);
+	const gchar *filename;
+
+	filename = remmina_file_get_filename(remminafile);
+	G_LOCK(remmina_stats_profiles);
+	if (remmina_stats_profile_is_tracked(filename)) {
+		remmina_stats_profiles_set(remmina_stats_profiles, remmina_stats_protocols,
+			filename, remmina_file_get_string(remminafile, "protocol"),
+			remmina_stats_parse_date(remmina_file_get_string(remminafile, "last_success")));
+		remmina_stats_profiles_changed();
+	}
+	G_UNLOCK(remmina_stats_profiles);
+}
+
+/** Update the statistics after a profile has been deleted */
+void remmina_stats_profile_remove(const gchar *filename)
+{
+	TRACE_CALL(__func__);
+	RemminaStatsProfile *profile;
+	RemminaStatsProtocol *proto;
+
+	G_LOCK(remmina_stats_profiles);
+	if (remmina_stats_profile_is_tracked(filename)) {
+		profile = g_hash_table_lookup(remmina_stats_profiles, filename);
+		if (profile) {
+			proto = profile->protocol ? g_hash_table_lookup(remmina_stats_protocols, profile->protocol) : NULL;
+			if (proto) {
+				proto->count--;
+				if (profile->last_success && profile->last_success == proto->last_success)
+					proto->last_success_stale = TRUE;
 			}
+			g_hash_table_remove(remmina_stats_profiles, filename);
+			remmina_stats_profiles_changed();
+		}
+	}
+	G_UNLOCK(remmina_stats_profiles);
+}
+
+/** Write the statistics still waiting for the write-behind timer */
+void remmina_stats_profiles_flush(void)
+{
+	TRACE_CALL(__func__);
+	G_LOCK(remmina_stats_profiles);
+	if (remmina_stats_profiles_flush_source) {
+		g_source_remove(remmina_stats_profiles_flush_source);
+		remmina_stats_profiles_flush_source = 0;
+		remmina_stats_profiles_write(remmina_stats_datadir_mtime(remmina_stats_profiles_datadir));
+	}
+	G_UNLOCK(remmina_stats_profiles);
+}
+
+/** Latest success date of a protocol, found again when the profile holding it went away */
+static guint32 remmina_stats_protocol_last_success(const gchar *protocol, RemminaStatsProtocol *proto)
+{
+	TRACE_CALL(__func__);
+	RemminaStatsProfile *profile;
+	GHashTableIter iter;
+
+	if (proto->last_success_stale) {
+		proto->last_success = 0;
+		g_hash_table_iter_init(&iter, remmina_stats_profiles);
+		while (g_hash_table_iter_next(&iter, NULL, (gpointer*)&profile)) {
+			if (profile->protocol == protocol && profile->last_success > proto->last_success)
+				proto->last_success = profile->last_success;
 		}
+		proto->last_success_stale = FALSE;
 	}
-	if (dd)
-		g_date_time_unref(dd);
-	if (ds)
-		g_date_time_unref(ds);
+	return proto->last_success;
 }
 
 /**
@@ -695,15 +919,15 @@ JsonNode *remmina_stats_get_profiles()
 
 	JsonBuilder *b;
 	JsonNode *r;
-	gchar *s;
-
-	gint profiles_count;
-	GHashTableIter pcountiter, pdateiter;
-	gpointer pcountkey, pcountvalue;
-	gpointer pdatekey, pdatevalue;
+	gchar *s, *datadir;
+	GHashTable *profiles = NULL, *protocols = NULL;
+	gboolean loaded, cached = FALSE;
+	gint64 datadir_mtime = 0;
 
-	struct ProfilesData *pdata;
-	pdata = g_malloc0(sizeof(struct ProfilesData));
+	GHashTableIter iter;
+	const gchar *protocol;
+	RemminaStatsProtocol *proto;
+	guint32 last_success;
 
 	b = json_builder_new();
 	json_builder_begin_object(b);
@@ -713,42 +937,69 @@ JsonNode *remmina_stats_get_profiles()
 	/** @warning this function is usually executed on a dedicated thread,
 	 * not on the main thread */
 
-	pdata->proto_date = g_hash_table_new_full(g_str_hash, g_str_equal,
-		(GDestroyNotify)g_free, (GDestroyNotify)g_free);
-	pdata->proto_count = g_hash_table_new_full(g_str_hash, g_str_equal,
-		(GDestroyNotify)g_free, NULL);
+	/* Load the statistics without the lock, profile saves on the main
+	 * thread must not wait for a scan of the data dir */
+	datadir = remmina_file_get_datadir();
+	G_LOCK(remmina_stats_profiles);
+	loaded = remmina_stats_profiles && g_strcmp0(datadir, remmina_stats_profiles_datadir) == 0;
+	G_UNLOCK(remmina_stats_profiles);
+
+	if (!loaded) {
+		profiles = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+		protocols = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+		/* Taken before the scan: a profile saved meanwhile invalidates the cache */
+		datadir_mtime = remmina_stats_datadir_mtime(datadir);
+		cached = remmina_stats_profiles_read(datadir, profiles, protocols);
+		if (!cached)
+			remmina_stats_profiles_scan(datadir, profiles, protocols);
+	}
 
-	profiles_count = remmina_file_manager_iterate(
-		(GFunc)remmina_profiles_get_data,
-		(gpointer)pdata);
+	G_LOCK(remmina_stats_profiles);
+	if (!loaded) {
+		if (!remmina_stats_profiles || g_strcmp0(datadir, remmina_stats_profiles_datadir) != 0) {
+			remmina_stats_profiles_install(datadir, profiles, protocols);
+			if (!cached)
+				remmina_stats_profiles_write(datadir_mtime);
+		} else {
+			/* Another thread loaded them first */
+			g_hash_table_destroy(profiles);
+			g_hash_table_destroy(protocols);
+		}
+	}
+	g_free(datadir);
 
-	json_builder_add_int_value(b, profiles_count);
+	json_builder_add_int_value(b, g_hash_table_size(remmina_stats_profiles));
 
-	g_hash_table_iter_init(&pcountiter, pdata->proto_count);
-	while (g_hash_table_iter_next(&pcountiter, &pcountkey, &pcountvalue)) {
-		json_builder_set_member_name(b, (gchar*)pcountkey);
-		json_builder_add_int_value(b, GPOINTER_TO_INT(pcountvalue));
+	g_hash_table_iter_init(&iter, remmina_stats_protocols);
+	while (g_hash_table_iter_next(&iter, (gpointer*)&protocol, (gpointer*)&proto)) {
+		if (proto->count <= 0)
+			continue;
+		json_builder_set_member_name(b, protocol);
+		json_builder_add_int_value(b, proto->count);
 	}
 
-	g_hash_table_iter_init(&pdateiter, pdata->proto_date);
-	while (g_hash_table_iter_next(&pdateiter, &pdatekey, &pdatevalue)) {
-		s = g_strdup_printf("DATE_%s", (gchar*)pdatekey);
+	g_hash_table_iter_init(&iter, remmina_stats_protocols);
+	while (g_hash_table_iter_next(&iter, (gpointer*)&protocol, (gpointer*)&proto)) {
+		if (proto->count <= 0)
+			continue;
+		s = g_strdup_printf("DATE_%s", protocol);
 		json_builder_set_member_name(b, s);
 		g_free(s);
-		json_builder_add_string_value(b, (gchar*)pdatevalue);
+		last_success = remmina_stats_protocol_last_success(protocol, proto);
+		if (last_success) {
+			s = g_strdup_printf("%08u", last_success);
+			json_builder_add_string_value(b, s);
+			g_free(s);
+		} else {
+			json_builder_add_string_value(b, NULL);
+		}
 	}
+	G_UNLOCK(remmina_stats_profiles);
 
 	json_builder_end_object(b);
 	r = json_builder_get_root(b);
 	g_object_unref(b);
 
-	g_hash_table_remove_all(pdata->proto_date);
-	g_hash_table_unref(pdata->proto_date);
-	g_hash_table_remove_all(pdata->proto_count);
-	g_hash_table_unref(pdata->proto_count);
-
-	g_free(pdata);
-
 	return r;
 }
 
@@ -38,7 +38,13 @@ G_BEGIN_DECLS
 
 #include "json-glib/json-glib.h"
 
+#include "remmina_file.h"
+
 JsonNode *remmina_stats_get_all(void);
+/* Keep the profile statistics up to date without loading every profile */
+void remmina_stats_profile_update(RemminaFile *remminafile);
+void remmina_stats_profile_remove(const gchar *filename);
+void remmina_stats_profiles_flush(void);
 
 G_END_DECLS
 
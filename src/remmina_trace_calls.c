@@ -0,0 +1,253 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2016-2019 Antenore Gatta, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+
+
+/* Call tracing for builds configured with WITH_TRACE_CALLS.
+ *
+ * Every TRACE_CALL() site is registered once, then each call only costs two
+ * monotonic clock reads, a few relaxed atomic increments and two stores in
+ * a ring buffer owned by the calling thread. Nothing is printed at run time:
+ * send SIGUSR2 to the process, or call remmina_trace_calls_dump(), to write the
+ * per-function counters, the duration histograms and the latest events of
+ * every thread to a file. */
+
+#include "config.h"
+
+#ifdef WITH_TRACE_CALLS
+
+#include <glib.h>
+#include <glib-unix.h>
+#include <glib/gstdio.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "remmina/remmina_trace_calls.h"
+
+/* Events kept per thread, must be a power of two */
+#define TRACE_RING_SIZE 16384
+
+typedef struct _RemminaTraceEvent {
+	gint64	time;   /* Monotonic time in microseconds */
+	guint32 site;   /* Id of the RemminaTraceSite */
+	guint32 leave;  /* 0 on function entry, 1 on return */
+} RemminaTraceEvent;
+
+/* Written only by its owner thread, without locks. A ring is given back
+ * when its thread exits, and reused by the next new thread */
+typedef struct _RemminaTraceRing {
+	RemminaTraceEvent		events[TRACE_RING_SIZE];
+	guint64				count;  /* Number of events ever recorded */
+	gint				in_use;
+	gulong				thread;
+	struct _RemminaTraceRing *	next;
+} RemminaTraceRing;
+
+static RemminaTraceRing *trace_rings = NULL;
+static RemminaTraceSite *trace_sites = NULL;
+static gint trace_site_count = 0;
+static __thread RemminaTraceRing *trace_ring = NULL;
+
+static void remmina_trace_calls_ring_release(gpointer data)
+{
+	RemminaTraceRing *ring = (RemminaTraceRing *)data;
+
+	g_atomic_int_set(&ring->in_use, 0);
+}
+
+static GPrivate trace_ring_key = G_PRIVATE_INIT(remmina_trace_calls_ring_release);
+
+static RemminaTraceRing *remmina_trace_calls_ring_acquire(void)
+{
+	RemminaTraceRing *ring;
+
+	for (ring = g_atomic_pointer_get(&trace_rings); ring; ring = ring->next)
+		if (g_atomic_int_compare_and_exchange(&ring->in_use, 0, 1))
+			break;
+
+	if (!ring) {
+		ring = g_new0(RemminaTraceRing, 1);
+		ring->in_use = 1;
+		do
+			ring->next = g_atomic_pointer_get(&trace_rings);
+		while (!g_atomic_pointer_compare_and_exchange(&trace_rings, ring->next, ring));
+	}
+	ring->thread = (gulong)pthread_self();
+
+	trace_ring = ring;
+	g_private_set(&trace_ring_key, ring);
+	return ring;
+}
+
+static inline void remmina_trace_calls_record(RemminaTraceSite *site, gint64 time, guint32 leave)
+{
+	RemminaTraceRing *ring = trace_ring;
+	RemminaTraceEvent *event;
+
+	if (G_UNLIKELY(!ring))
+		ring = remmina_trace_calls_ring_acquire();
+
+	event = &ring->events[ring->count & (TRACE_RING_SIZE - 1)];
+	event->time = time;
+	event->site = (guint32)site->id;
+	event->leave = leave;
+	/* Publish the event to remmina_trace_calls_dump() */
+	__atomic_store_n(&ring->count, ring->count + 1, __ATOMIC_RELEASE);
+}
+
+RemminaTraceFrame remmina_trace_calls_enter(RemminaTraceSite *site, const gchar *name)
+{
+	RemminaTraceFrame frame;
+
+	if (g_once_init_enter(&site->id)) {
+		site->name = name;
+		do
+			site->next = g_atomic_pointer_get(&trace_sites);
+		while (!g_atomic_pointer_compare_and_exchange(&trace_sites, site->next, site));
+		g_once_init_leave(&site->id, (gsize)g_atomic_int_add(&trace_site_count, 1) + 1);
+	}
+
+	frame.site = site;
+	frame.start = g_get_monotonic_time();
+	__atomic_fetch_add(&site->calls, 1, __ATOMIC_RELAXED);
+	remmina_trace_calls_record(site, frame.start, 0);
+	return frame;
+}
+
+void remmina_trace_calls_leave(RemminaTraceFrame *frame)
+{
+	gint64 now, duration;
+	guint bucket;
+
+	now = g_get_monotonic_time();
+	duration = now - frame->start;
+	bucket = duration > 0 ? g_bit_storage((gulong)duration) : 0;
+	if (bucket >= REMMINA_TRACE_HISTOGRAM_BUCKETS)
+		bucket = REMMINA_TRACE_HISTOGRAM_BUCKETS - 1;
+
+	__atomic_fetch_add(&frame->site->total_time, (guint64)duration, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&frame->site->histogram[bucket], 1, __ATOMIC_RELAXED);
+	remmina_trace_calls_record(frame->site, now, 1);
+}
+
+static gint remmina_trace_calls_compare_sites(gconstpointer a, gconstpointer b)
+{
+	const RemminaTraceSite *sa = *(const RemminaTraceSite **)a;
+	const RemminaTraceSite *sb = *(const RemminaTraceSite **)b;
+
+	if (sa->total_time == sb->total_time)
+		return 0;
+	return sa->total_time < sb->total_time ? 1 : -1;
+}
+
+/* Write the counters of all the functions, sorted by cumulative time, and
+ * the events still in the ring buffer of every thread. Events may be
+ * overwritten by their thread while they are dumped */
+gboolean remmina_trace_calls_dump(const gchar *filename)
+{
+	RemminaTraceSite *site;
+	RemminaTraceRing *ring;
+	RemminaTraceEvent event;
+	GPtrArray *sites;
+	const gchar **names;
+	guint64 count, first, n;
+	guint i, j;
+	FILE *fp;
+
+	if ((fp = g_fopen(filename, "w")) == NULL)
+		return FALSE;
+
+	names = g_new0(const gchar *, g_atomic_int_get(&trace_site_count) + 1);
+	sites = g_ptr_array_new();
+	for (site = g_atomic_pointer_get(&trace_sites); site; site = site->next) {
+		g_ptr_array_add(sites, site);
+		if (site->id <= (gsize)g_atomic_int_get(&trace_site_count))
+			names[site->id] = site->name;
+	}
+	g_ptr_array_sort(sites, remmina_trace_calls_compare_sites);
+
+	fprintf(fp, "# Remmina trace calls, pid %d, %u functions\n", getpid(), sites->len);
+	fprintf(fp, "# calls total_us avg_us function histogram(bucket<2^n us:calls)\n");
+	for (i = 0; i < sites->len; i++) {
+		site = g_ptr_array_index(sites, i);
+		fprintf(fp, "%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %.1f %s",
+			site->calls, site->total_time,
+			site->calls ? (gdouble)site->total_time / site->calls : 0.0, site->name);
+		for (j = 0; j < REMMINA_TRACE_HISTOGRAM_BUCKETS; j++)
+			if (site->histogram[j])
+				fprintf(fp, " %u:%" G_GUINT64_FORMAT, j, site->histogram[j]);
+		fputc('\n', fp);
+	}
+
+	for (ring = g_atomic_pointer_get(&trace_rings); ring; ring = ring->next) {
+		count = __atomic_load_n(&ring->count, __ATOMIC_ACQUIRE);
+		first = count > TRACE_RING_SIZE ? count - TRACE_RING_SIZE : 0;
+		fprintf(fp, "# Thread %#lx, %" G_GUINT64_FORMAT " events\n", ring->thread, count);
+		for (n = first; n < count; n++) {
+			event = ring->events[n & (TRACE_RING_SIZE - 1)];
+			fprintf(fp, "%" G_GINT64_FORMAT " %c %s\n", event.time, event.leave ? '<' : '>',
+				event.site < (guint32)g_atomic_int_get(&trace_site_count) + 1 && names[event.site] ? names[event.site] : "?");
+		}
+	}
+
+	g_ptr_array_free(sites, TRUE);
+	g_free(names);
+	fclose(fp);
+	return TRUE;
+}
+
+static gboolean remmina_trace_calls_on_signal(gpointer user_data)
+{
+	gchar *filename;
+	gchar *name;
+
+	name = g_strdup_printf("trace-calls-%d.log", getpid());
+	filename = g_build_filename(g_get_user_cache_dir(), "remmina", name, NULL);
+	if (remmina_trace_calls_dump(filename))
+		g_print("Trace calls dumped to %s\n", filename);
+	else
+		g_print("Unable to dump trace calls to %s\n", filename);
+	g_free(filename);
+	g_free(name);
+	return G_SOURCE_CONTINUE;
+}
+
+/* Dump the trace calls to the cache directory on SIGUSR2 */
+void remmina_trace_calls_init(void)
+{
+	g_unix_signal_add(SIGUSR2, remmina_trace_calls_on_signal, NULL);
+}
+
+#endif  /* WITH_TRACE_CALLS */